@@ -0,0 +1,525 @@
+#include "stdafx.h"
+#include "AlternatingSolver.h"
+#include "OptimizerFunctors.h"
+#include "Settings.h"
+#include "Profiler.h"
+#include "Log.h"
+
+using namespace Eigen;
+
+// Stop once an iteration lowers the cost by less than this fraction, as Ceres does by default.
+const double FUNCTION_TOLERANCE = 1e-6;
+// The conjugate gradient solver stops once the residual of the step is reduced by this factor. The
+// next rasterization changes the problem anyway, so an exact step isn't worth its iterations.
+const double CG_TOLERANCE = 1e-2;
+
+// Normal equations J^T J x = J^T y of |J x - y|^2, with y.y to evaluate the cost. Only the upper
+// triangle of J^T J is stored.
+struct NormalEquations {
+	explicit NormalEquations(int numParams) : JtJ(MatrixXd::Zero(numParams, numParams)), Jty(VectorXd::Zero(numParams)) {}
+
+	void add(const NormalEquations& other) {
+		JtJ.triangularView<Upper>() += other.JtJ;
+		Jty += other.Jty;
+		yy += other.yy;
+	}
+
+	// 0.5 |J x - y|^2
+	double cost(const VectorXd& x) const {
+		return 0.5 * std::max(x.dot(JtJ.selfadjointView<Upper>() * x) - 2.0 * Jty.dot(x) + yy, 0.0);
+	}
+
+	// Minimizes 0.5 |J x - y|^2 + 0.5 regularization |x|^2.
+	VectorXd solve(double regularization) const {
+		MatrixXd A = JtJ.selfadjointView<Upper>();
+		A.diagonal().array() += regularization;
+		return A.ldlt().solve(Jty);
+	}
+
+	MatrixXd JtJ;
+	VectorXd Jty;
+	double yy = 0;
+};
+
+// Adds rows of J to normal equations. Rows are buffered as contiguous columns and added in blocks,
+// which is much faster than one rank update per pixel. With float, the products of a block are
+// computed in single precision (twice the SIMD lanes of double) and added to the double sums, so
+// the rounding error doesn't grow with the number of pixels.
+template <typename Scalar>
+class RowAccumulator {
+public:
+	explicit RowAccumulator(int numParams)
+		: equations(numParams), rowsT(numParams, BLOCK_ROWS), targets(BLOCK_ROWS), blockJtJ(numParams, numParams) {}
+
+	// Row of J (as column) and its target value.
+	template <typename Derived>
+	void addRow(const MatrixBase<Derived>& row, Scalar target) {
+		rowsT.col(numBuffered) = row;
+		targets(numBuffered) = target;
+		if (++numBuffered == BLOCK_ROWS) {
+			flush();
+		}
+	}
+
+	void flush() {
+		if (numBuffered > 0) {
+			auto rows = rowsT.leftCols(numBuffered);
+			auto values = targets.head(numBuffered);
+			blockJtJ.setZero();
+			blockJtJ.template selfadjointView<Upper>().rankUpdate(rows);
+			equations.JtJ.triangularView<Upper>() += blockJtJ.template cast<double>();
+			equations.Jty += (rows * values).template cast<double>();
+			equations.yy += double(values.squaredNorm());
+			numBuffered = 0;
+		}
+	}
+
+	NormalEquations equations;
+
+private:
+	static const int BLOCK_ROWS = 256;
+
+	Matrix<Scalar, Dynamic, Dynamic> rowsT;
+	Matrix<Scalar, Dynamic, 1> targets;
+	Matrix<Scalar, Dynamic, Dynamic> blockJtJ;
+	int numBuffered = 0;
+};
+
+namespace {
+	struct AlternatingProblem {
+		const FaceModel& model;
+		const pcl::PointCloud<pcl::PointXYZRGBNormal>& cloud;
+		const std::vector<PixelData>& pixelResults;
+		const std::function<void()>& rasterize;
+		const Matrix4f& pose;
+		const Matrix3f& intrinsics;
+		const Vector3f& colorDelta;
+		const AlternatingSolverOptions& options;
+		const ModelRank& rank;
+		Map<VectorXd> alpha;
+		Map<VectorXd> beta;
+		// The leading coefficients of alpha and beta that are solved for, the others are held constant
+		// and folded into the base mesh positions and albedo (see setActiveCoefficients).
+		int numAlpha;
+		int numBeta;
+		VectorXf basePositions;
+		Matrix3Xf baseAlbedo;
+
+		int numParams() const { return numAlpha + numBeta; }
+	};
+
+	// Rows of J and targets y of the residuals of one pixel for the current rasterization, in Scalar and
+	// scaled by the square root of the pixel's weight: point to point (0-2) and point to plane (3) over
+	// alpha, and color (0-2) over beta. One per thread, it keeps its buffers.
+	template <typename Scalar>
+	class PixelLinearization {
+	public:
+		typedef Matrix<Scalar, 3, 1> Vector3s;
+
+		explicit PixelLinearization(const AlternatingProblem& problem)
+			: geometryRows(4, problem.numAlpha), colorRows(3, problem.numBeta), problem(problem),
+			linear(problem.pose.topLeftCorner<3, 3>().cast<Scalar>()), translation(problem.pose.topRightCorner<3, 1>().cast<Scalar>()),
+			shapeStd(problem.model.m_shapeStd.head(problem.numAlpha).cast<Scalar>()),
+			albedoStd(problem.model.m_albedoStd.head(problem.numBeta).cast<Scalar>()), shapeRows(3, problem.numAlpha) {}
+
+		void compute(const PixelSample& sample) {
+			const FaceModel& model = problem.model;
+			const pcl::PointXYZRGBNormal& point = problem.cloud.points[sample.index];
+			const PixelData& pixel = problem.pixelResults[sample.index];
+			// Scales the rows and targets, which scales the squared residuals by the weight.
+			const Scalar scale = Scalar(std::sqrt(sample.weight));
+
+			// Interpolated position and albedo, and their derivatives by the active alpha and beta.
+			Vector3s meanPosition = Vector3s::Zero();
+			Vector3s meanAlbedo = Vector3s::Zero();
+			shapeRows.setZero();
+			colorRows.setZero();
+			for (int i = 0; i < 3; i++) {
+				const int v = pixel.vertexIndices[i];
+				const Scalar b = Scalar(pixel.barycentricCoordinates(i));
+				meanPosition += b * problem.basePositions.segment<3>(3 * v).cast<Scalar>();
+				meanAlbedo += b * problem.baseAlbedo.col(v).cast<Scalar>();
+				shapeRows += b * model.m_shapeBasis.block(3 * v, 0, 3, problem.numAlpha).cast<Scalar>();
+				colorRows += b * model.m_albedoBasis.block(3 * v, 0, 3, problem.numBeta).cast<Scalar>();
+			}
+			geometryRows.template topRows<3>().noalias() = linear * (shapeRows * (scale * shapeStd).asDiagonal());
+			colorRows = colorRows * (scale / Scalar(255) * albedoStd).asDiagonal();
+
+			// Point to point and point to plane distance to the input.
+			const Vector3s input(point.x, point.y, point.z);
+			const Vector3s normal(point.normal_x, point.normal_y, point.normal_z);
+			const Vector3s distance = scale * (input - (linear * meanPosition + translation));
+			geometryRows.row(3).noalias() = normal.transpose() * geometryRows.template topRows<3>();
+			geometryTargets << distance, normal.dot(distance);
+
+			// Color difference, corrected by the lighting difference.
+			colorTargets = (Vector3s(point.r, point.g, point.b) - meanAlbedo + problem.colorDelta.cast<Scalar>()) * (scale / Scalar(255));
+		}
+
+		Matrix<Scalar, 4, Dynamic> geometryRows;
+		Matrix<Scalar, 4, 1> geometryTargets;
+		Matrix<Scalar, 3, Dynamic> colorRows;
+		Vector3s colorTargets;
+
+	private:
+		const AlternatingProblem& problem;
+		const Matrix<Scalar, 3, 3> linear;
+		const Vector3s translation;
+		const Matrix<Scalar, Dynamic, 1> shapeStd;
+		const Matrix<Scalar, Dynamic, 1> albedoStd;
+		Matrix<Scalar, 3, Dynamic> shapeRows;
+	};
+}
+
+// Solves for the first numAlpha and numBeta coefficients from now on, holding the others at their
+// current values.
+static void setActiveCoefficients(AlternatingProblem& problem, int numAlpha, int numBeta) {
+	const FaceModel& model = problem.model;
+	problem.numAlpha = numAlpha;
+	problem.numBeta = numBeta;
+	const int numHeldAlpha = int(problem.alpha.size()) - numAlpha;
+	const int numHeldBeta = int(problem.beta.size()) - numBeta;
+	problem.basePositions = model.m_averageMesh.vertices;
+	problem.baseAlbedo = model.m_averageMesh.vertexColors.topRows<3>().cast<float>();
+	if (numHeldAlpha > 0) {
+		problem.basePositions.noalias() += model.m_shapeBasis.middleCols(numAlpha, numHeldAlpha)
+			* model.m_shapeStd.segment(numAlpha, numHeldAlpha).cwiseProduct(problem.alpha.tail(numHeldAlpha).cast<float>());
+	}
+	if (numHeldBeta > 0) {
+		const VectorXf albedoOffset = model.m_albedoBasis.middleCols(numBeta, numHeldBeta)
+			* model.m_albedoStd.segment(numBeta, numHeldBeta).cwiseProduct(problem.beta.tail(numHeldBeta).cast<float>());
+		problem.baseAlbedo += Map<const Matrix3Xf>(albedoOffset.data(), 3, albedoOffset.size() / 3);
+	}
+}
+
+// Normal equations of the sampled pixels for the current rasterization, evaluating the rows in Scalar.
+template <typename Scalar>
+static void buildNormalEquations(const AlternatingProblem& problem, const std::vector<PixelSample>& sample,
+	NormalEquations& outGeometry, NormalEquations& outColor) {
+	#pragma omp parallel
+	{
+		PixelLinearization<Scalar> rows(problem);
+		RowAccumulator<Scalar> localGeometry(problem.numAlpha);
+		RowAccumulator<Scalar> localColor(problem.numBeta);
+
+		#pragma omp for nowait
+		for (int s = 0; s < int(sample.size()); s++) {
+			rows.compute(sample[s]);
+			for (int c = 0; c < 4; c++) {
+				localGeometry.addRow(rows.geometryRows.row(c).transpose(), rows.geometryTargets(c));
+			}
+			for (int c = 0; c < 3; c++) {
+				localColor.addRow(rows.colorRows.row(c).transpose(), rows.colorTargets(c));
+			}
+		}
+		localGeometry.flush();
+		localColor.flush();
+
+		#pragma omp critical
+		{
+			outGeometry.add(localGeometry.equations);
+			outColor.add(localColor.equations);
+		}
+	}
+}
+
+// One pass over the sampled pixels at the current active parameters x = (alpha, beta): the descent direction
+// J^T (y - J x), the diagonal of J^T J and the cost 0.5 |J x - y|^2, without forming J or J^T J.
+template <typename Scalar>
+static double computeGradient(const AlternatingProblem& problem, const std::vector<PixelSample>& sample,
+	VectorXd& outGradient, VectorXd& outDiagonal) {
+	const int numAlpha = problem.numAlpha;
+	const int numBeta = problem.numBeta;
+	outGradient.setZero(problem.numParams());
+	outDiagonal.setZero(problem.numParams());
+	double cost = 0;
+	const Matrix<Scalar, Dynamic, 1> alpha = problem.alpha.head(numAlpha).cast<Scalar>();
+	const Matrix<Scalar, Dynamic, 1> beta = problem.beta.head(numBeta).cast<Scalar>();
+
+	#pragma omp parallel
+	{
+		PixelLinearization<Scalar> rows(problem);
+		Matrix<Scalar, Dynamic, 1> gradient = Matrix<Scalar, Dynamic, 1>::Zero(problem.numParams());
+		Matrix<Scalar, Dynamic, 1> diagonal = Matrix<Scalar, Dynamic, 1>::Zero(problem.numParams());
+		double localCost = 0;
+
+		#pragma omp for nowait
+		for (int s = 0; s < int(sample.size()); s++) {
+			rows.compute(sample[s]);
+			const Matrix<Scalar, 4, 1> geometryError = rows.geometryTargets - rows.geometryRows * alpha;
+			const Matrix<Scalar, 3, 1> colorError = rows.colorTargets - rows.colorRows * beta;
+			gradient.head(numAlpha).noalias() += rows.geometryRows.transpose() * geometryError;
+			gradient.tail(numBeta).noalias() += rows.colorRows.transpose() * colorError;
+			diagonal.head(numAlpha) += rows.geometryRows.colwise().squaredNorm().transpose();
+			diagonal.tail(numBeta) += rows.colorRows.colwise().squaredNorm().transpose();
+			localCost += 0.5 * double(geometryError.squaredNorm() + colorError.squaredNorm());
+		}
+
+		#pragma omp critical
+		{
+			outGradient += gradient.template cast<double>();
+			outDiagonal += diagonal.template cast<double>();
+			cost += localCost;
+		}
+	}
+	return cost;
+}
+
+// J^T (J v) for v = (alpha, beta) directions, streamed over the sampled pixels.
+template <typename Scalar>
+static void multiplyJtJ(const AlternatingProblem& problem, const std::vector<PixelSample>& sample, const VectorXd& v, VectorXd& outProduct) {
+	const int numAlpha = problem.numAlpha;
+	const int numBeta = problem.numBeta;
+	outProduct.setZero(problem.numParams());
+	const Matrix<Scalar, Dynamic, 1> vAlpha = v.head(numAlpha).cast<Scalar>();
+	const Matrix<Scalar, Dynamic, 1> vBeta = v.tail(numBeta).cast<Scalar>();
+
+	#pragma omp parallel
+	{
+		PixelLinearization<Scalar> rows(problem);
+		Matrix<Scalar, Dynamic, 1> product = Matrix<Scalar, Dynamic, 1>::Zero(problem.numParams());
+
+		#pragma omp for nowait
+		for (int s = 0; s < int(sample.size()); s++) {
+			rows.compute(sample[s]);
+			const Matrix<Scalar, 4, 1> geometryJv = rows.geometryRows * vAlpha;
+			const Matrix<Scalar, 3, 1> colorJv = rows.colorRows * vBeta;
+			product.head(numAlpha).noalias() += rows.geometryRows.transpose() * geometryJv;
+			product.tail(numBeta).noalias() += rows.colorRows.transpose() * colorJv;
+		}
+
+		#pragma omp critical
+		outProduct += product.template cast<double>();
+	}
+}
+
+// Inexact Newton step: solves (J^T J + R) step = J^T (y - J x) - R x, with R the regularization, by
+// conjugate gradients from step 0, preconditioned with the inverse diagonal. Geometry and color are
+// independent blocks of the one system.
+template <typename Scalar>
+static VectorXd solveConjugateGradient(const AlternatingProblem& problem, const std::vector<PixelSample>& sample,
+	const VectorXd& gradient, const VectorXd& diagonal, const VectorXd& regularization, AlternatingSolverReport& report) {
+	VectorXd x(problem.numParams());
+	x << problem.alpha.head(problem.numAlpha), problem.beta.head(problem.numBeta);
+	const VectorXd preconditioner = (diagonal + regularization).cwiseMax(std::numeric_limits<double>::min()).cwiseInverse();
+
+	VectorXd step = VectorXd::Zero(problem.numParams());
+	VectorXd residual = gradient - regularization.cwiseProduct(x);
+	const double threshold = CG_TOLERANCE * residual.norm();
+	VectorXd z = preconditioner.cwiseProduct(residual);
+	VectorXd direction = z;
+	VectorXd product(problem.numParams());
+	double rz = residual.dot(z);
+	for (int k = 0; k < problem.options.maxCGIterations && residual.norm() > threshold; k++) {
+		multiplyJtJ<Scalar>(problem, sample, direction, product);
+		product += regularization.cwiseProduct(direction);
+		const double curvature = direction.dot(product);
+		if (curvature <= 0) {
+			break;
+		}
+		const double length = rz / curvature;
+		step += length * direction;
+		residual -= length * product;
+		z = preconditioner.cwiseProduct(residual);
+		const double rzNext = residual.dot(z);
+		direction = z + (rzNext / rz) * direction;
+		rz = rzNext;
+		report.cgIterations++;
+	}
+	return step;
+}
+
+bool parseSolverPrecision(const std::string& name, SolverPrecision& outPrecision) {
+	if (name == "double") {
+		outPrecision = SolverPrecision::Double;
+	}
+	else if (name == "float") {
+		outPrecision = SolverPrecision::Float;
+	}
+	else if (name == "mixed") {
+		outPrecision = SolverPrecision::Mixed;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+bool parseLinearSolver(const std::string& name, LinearSolver& outSolver) {
+	if (name == "normal") {
+		outSolver = LinearSolver::NormalEquations;
+	}
+	else if (name == "cg") {
+		outSolver = LinearSolver::ConjugateGradient;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+// Pixels of the current rasterization to linearize: every stride-th valid input pixel that Steve is
+// rendered into (the others have zero residuals), or the sampler's sample of them.
+static void samplePixels(const AlternatingProblem& problem, std::vector<PixelSample>& outSample) {
+	const int width = int(problem.cloud.width);
+	const int height = int(problem.cloud.height);
+	const int step = int(std::max(problem.options.stride, 1u));
+	std::vector<unsigned int> candidates;
+	for (int y = 0; y < height; y += step) {
+		for (int x = 0; x < width; x += step) {
+			const pcl::PointXYZRGBNormal& point = problem.cloud(x, y);
+			if (!std::isnan(point.z) && !std::isnan(point.normal_x) && problem.pixelResults[y * width + x].isValid) {
+				candidates.push_back(y * width + x);
+			}
+		}
+	}
+	PixelSampler* sampler = problem.options.sampler;
+	if (!sampler) {
+		outSample.clear();
+		for (unsigned int index : candidates) {
+			outSample.push_back({ index, 1.0 });
+		}
+		return;
+	}
+	std::vector<double> norms;
+	if (sampler->usesImportance()) {
+		norms.resize(candidates.size());
+		#pragma omp parallel for
+		for (int i = 0; i < int(candidates.size()); i++) {
+			norms[i] = PixelResidual(problem.cloud.points[candidates[i]], problem.pixelResults[candidates[i]], problem.model,
+				problem.pose, problem.intrinsics, problem.colorDelta).residualNorm(problem.rank, problem.alpha.data(), problem.beta.data());
+		}
+	}
+	sampler->sample(candidates, norms, unsigned(width), outSample);
+}
+
+// Alternates solves and rasterizations from the current parameters until the cost stops decreasing
+// with all coefficients active, and leaves the best parameters and their rasterization. Returns the
+// final cost, and the first one if outInitialCost isn't null.
+template <typename Scalar>
+static double iterate(AlternatingProblem& problem, int maxIterations, AlternatingSolverReport& report, double* outInitialCost) {
+	// Squared factors of the RegularizerFunctor residuals.
+	const double regAlpha = std::pow(gSettings.regStrengthAlpha / NUM_ALPHA_VEC, 2);
+	const double regBeta = std::pow(gSettings.regStrengthBeta / NUM_BETA_VEC, 2);
+	const int numAlpha = int(problem.alpha.size());
+	const int numBeta = int(problem.beta.size());
+	const bool conjugateGradient = problem.options.linearSolver == LinearSolver::ConjugateGradient;
+
+	// Linearizes the current rasterization over the active coefficients and returns the cost.
+	std::vector<PixelSample> sample;
+	NormalEquations geometry(0);
+	NormalEquations color(0);
+	VectorXd gradient, diagonal;
+	auto linearize = [&] {
+		samplePixels(problem, sample);
+		report.numPixels = unsigned(sample.size());
+		double dataCost;
+		if (conjugateGradient) {
+			dataCost = computeGradient<Scalar>(problem, sample, gradient, diagonal);
+		}
+		else {
+			geometry = NormalEquations(problem.numAlpha);
+			color = NormalEquations(problem.numBeta);
+			buildNormalEquations<Scalar>(problem, sample, geometry, color);
+			dataCost = geometry.cost(problem.alpha.head(problem.numAlpha)) + color.cost(problem.beta.head(problem.numBeta));
+		}
+		// The rasterization matches the parameters, so this is the cost of the residual functors (with a
+		// sampler, its estimate from the sample, so the stopping test has the noise of the sample).
+		return dataCost + 0.5 * (regAlpha * problem.alpha.squaredNorm() + regBeta * problem.beta.squaredNorm());
+	};
+
+	VectorXd bestAlpha = problem.alpha;
+	VectorXd bestBeta = problem.beta;
+	double bestCost = std::numeric_limits<double>::infinity();
+	auto iterationStart = std::chrono::steady_clock::now();
+	for (int iteration = 0; ; iteration++) {
+		if (iteration > 0) {
+			problem.rasterize();
+		}
+		const double cost = linearize();
+		LOG_DEBUG << "alternating iteration " << iteration << (std::is_same<Scalar, float>::value ? " (float)" : "") << ": cost " << cost;
+		if (iteration == 0 && outInitialCost) {
+			*outInitialCost = cost;
+		}
+		// New triangles or visibility can make a step worse, then keep the best parameters.
+		const bool worse = cost >= bestCost;
+		bool converged = worse || bestCost - cost < FUNCTION_TOLERANCE * bestCost;
+		if (!worse) {
+			bestCost = cost;
+			bestAlpha = problem.alpha;
+			bestBeta = problem.beta;
+		}
+		const bool allActive = problem.numAlpha == numAlpha && problem.numBeta == numBeta;
+		if (converged && !allActive && iteration < maxIterations) {
+			// The active coefficients have converged, go on from the best parameters with twice as many.
+			if (worse) {
+				problem.alpha = bestAlpha;
+				problem.beta = bestBeta;
+				problem.rasterize();
+			}
+			setActiveCoefficients(problem, std::min(2 * problem.numAlpha, numAlpha), std::min(2 * problem.numBeta, numBeta));
+			LOG_DEBUG << "alternating iteration " << iteration << ": " << problem.numAlpha << " alpha and " << problem.numBeta << " beta coefficients active";
+			linearize();
+			converged = false;
+		}
+		if (converged || iteration >= maxIterations) {
+			break;
+		}
+		// Stop in time rather than run over with a better result.
+		const auto now = std::chrono::steady_clock::now();
+		if (now + (now - iterationStart) > problem.options.deadline) {
+			report.stoppedAtDeadline = true;
+			break;
+		}
+		iterationStart = now;
+
+		if (conjugateGradient) {
+			VectorXd regularization(problem.numParams());
+			regularization << VectorXd::Constant(problem.numAlpha, regAlpha), VectorXd::Constant(problem.numBeta, regBeta);
+			VectorXd step = solveConjugateGradient<Scalar>(problem, sample, gradient, diagonal, regularization, report);
+			problem.alpha.head(problem.numAlpha) += step.head(problem.numAlpha);
+			problem.beta.head(problem.numBeta) += step.tail(problem.numBeta);
+		}
+		else {
+			problem.alpha.head(problem.numAlpha) = geometry.solve(regAlpha);
+			problem.beta.head(problem.numBeta) = color.solve(regBeta);
+		}
+		report.iterations++;
+	}
+
+	if (problem.alpha != bestAlpha || problem.beta != bestBeta) {
+		problem.alpha = bestAlpha;
+		problem.beta = bestBeta;
+		problem.rasterize();
+	}
+	return bestCost;
+}
+
+AlternatingSolverReport solveAlternating(const FaceModel& model, const pcl::PointCloud<pcl::PointXYZRGBNormal>& cloud,
+	const std::vector<PixelData>& pixelResults, const std::function<void()>& rasterize, const Matrix4f& pose,
+	const Matrix3f& intrinsics, const Vector3f& colorDelta, const AlternatingSolverOptions& options, const ModelRank& rank,
+	double* alpha, double* beta) {
+	PROFILE_SCOPE("alternating solve");
+	auto start = std::chrono::steady_clock::now();
+	AlternatingSolverReport report;
+	AlternatingProblem problem{ model, cloud, pixelResults, rasterize, pose, intrinsics, colorDelta, options, rank,
+		Map<VectorXd>(alpha, rank.numAlpha), Map<VectorXd>(beta, rank.numBeta) };
+	const int numInitial = options.initialCoefficients > 0 ? int(options.initialCoefficients) : int(rank.numAlpha);
+	setActiveCoefficients(problem, std::min(numInitial, int(rank.numAlpha)), std::min(numInitial, int(rank.numBeta)));
+
+	if (options.precision == SolverPrecision::Double) {
+		report.finalCost = iterate<double>(problem, options.maxIterations, report, &report.initialCost);
+	}
+	else {
+		report.finalCost = iterate<float>(problem, options.maxIterations, report, &report.initialCost);
+	}
+	if (options.precision == SolverPrecision::Mixed && !report.stoppedAtDeadline) {
+		// One more solve in double, which also gives the final cost in double.
+		report.finalCost = iterate<double>(problem, 1, report, nullptr);
+	}
+	LOG_INFO << "Alternating solve: " << report.iterations << " iterations"
+		<< (options.linearSolver == LinearSolver::ConjugateGradient ? " (" + std::to_string(report.cgIterations) + " cg)" : "")
+		<< ", cost " << report.initialCost << " -> " << report.finalCost
+		<< " (" << report.numPixels << " pixels, " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms)";
+	return report;
+}
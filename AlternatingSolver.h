@@ -0,0 +1,66 @@
+#pragma once
+#include <chrono>
+#include <functional>
+#include <string>
+#include "FaceModel.h"
+#include "ModelRank.h"
+#include "Rasterizer.h"
+#include "PixelSampler.h"
+
+// Arithmetic of the linearization. Float evaluates the rows of the normal equations in single precision
+// and sums them in double (see RowAccumulator); enough for millimeter distances and 8-bit colors, and
+// faster. Mixed runs one more iteration in double after the float iterations.
+enum class SolverPrecision { Double, Float, Mixed };
+
+// double, float or mixed. Returns false for other names.
+bool parseSolverPrecision(const std::string& name, SolverPrecision& outPrecision);
+
+// How the linear least squares problem of an iteration is solved. NormalEquations forms J^T J
+// (parameters squared) and factorizes it. ConjugateGradient takes an inexact Newton step with
+// Jacobi preconditioned CG, streaming the products J^T (J v) over the pixels, so neither J nor J^T J
+// is formed and the memory grows only with the number of parameters.
+enum class LinearSolver { NormalEquations, ConjugateGradient };
+
+// normal or cg. Returns false for other names.
+bool parseLinearSolver(const std::string& name, LinearSolver& outSolver);
+
+struct AlternatingSolverOptions {
+	unsigned int stride = 1;
+	// Optional, draws the pixels of every iteration from the stride grid.
+	PixelSampler* sampler = nullptr;
+	int maxIterations = 50;
+	// No iteration is started that would end after the deadline (taking as long as the last one).
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+	SolverPrecision precision = SolverPrecision::Double;
+	LinearSolver linearSolver = LinearSolver::NormalEquations;
+	// Per step of the conjugate gradient solver.
+	int maxCGIterations = 25;
+	// Solve for only this many leading coefficients of alpha and beta at first, holding the others, and
+	// double them whenever the cost stops decreasing (0 = all from the start). The dominant components
+	// converge first, and the early iterations are cheaper.
+	unsigned int initialCoefficients = 0;
+};
+
+struct AlternatingSolverReport {
+	// Number of linear solves.
+	int iterations = 0;
+	// Products J^T (J v) of the conjugate gradient solver, over all iterations.
+	int cgIterations = 0;
+	// Cost as defined by the residual functors, before and after.
+	double initialCost = 0;
+	double finalCost = 0;
+	unsigned int numPixels = 0;
+	// Stopped because the next iteration would have ended after the deadline.
+	bool stoppedAtDeadline = false;
+};
+
+// Fits alpha and beta without Ceres. Once the rasterization fixes the triangle and barycentric
+// coordinates of each pixel, the position of a pixel is linear in alpha and its albedo linear in beta,
+// so the point to point, point to plane and color residuals become linear least squares problems.
+// Each iteration solves them (regularized) and rasterizes again, until the cost stops decreasing.
+// The pixel results must be those of the current parameters on entry; rasterize() updates them from
+// alpha and beta, which have the coefficients of the rank. The pose isn't changed.
+AlternatingSolverReport solveAlternating(const FaceModel& model, const pcl::PointCloud<pcl::PointXYZRGBNormal>& cloud,
+	const std::vector<PixelData>& pixelResults, const std::function<void()>& rasterize, const Eigen::Matrix4f& pose,
+	const Eigen::Matrix3f& intrinsics, const Eigen::Vector3f& colorDelta, const AlternatingSolverOptions& options,
+	const ModelRank& rank, double* alpha, double* beta);
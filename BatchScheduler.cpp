@@ -0,0 +1,77 @@
+#include "stdafx.h"
+#include "BatchScheduler.h"
+#include "Settings.h"
+#include "FrameSensor.h"
+#include "Log.h"
+#include "utils.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+static bool fileExists(const std::string& path) {
+	std::ifstream in(path);
+	return in.good();
+}
+
+BatchScheduler::BatchScheduler(const FaceModel& model, unsigned int numJobs)
+	: model(model), pool(numJobs), workspaces(pool.size()) {}
+
+std::vector<BatchItem> BatchScheduler::run(const std::vector<std::string>& files, const ResultHandler& onResult) {
+	std::vector<BatchItem> items(files.size());
+	std::mutex progressMutex;
+	size_t numDone = 0;
+	const unsigned int threadsPerJob = getThreadsPerJob();
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < files.size(); i++) {
+		pool.submit([&, i] {
+#ifdef _OPENMP
+			// Limits the OpenMP loops (e.g. ICP) of this job, the setting is per thread.
+			omp_set_num_threads(int(threadsPerJob));
+#endif
+			const std::string& file = files[i];
+			BatchItem& item = items[i];
+			item.file = file;
+			item.status = "ok";
+			std::string featuresFile = file.substr(0, file.length() - 3) + "points";
+
+			if (!fileExists(file)) {
+				item.status = "missing";
+			}
+			else if (!gSettings.autoLandmarks && !fileExists(featuresFile)) {
+				item.status = "no landmarks";
+			}
+			else {
+				LogContext logContext(fileStem(file));
+				// A bad input only fails its own item, the batch goes on.
+				FrameSensor inputSensor;
+				if (!inputSensor.loadFile(file)) {
+					LOG_WARNING << "Couldn't read the pcd file " << file;
+					item.status = "unreadable";
+				}
+				else if (inputSensor.m_featurePoints.empty() && (!gSettings.autoLandmarks || !inputSensor.detectFeaturePoints())) {
+					LOG_WARNING << "Couldn't detect feature points in " << file;
+					item.status = "no landmarks";
+				}
+				else {
+					ReconstructionResult result = reconstructFace(model, inputSensor, &workspaces[ThreadPool::currentWorker()]);
+					item.timings = result.timings;
+					if (!onResult(file, result)) {
+						item.status = "not saved";
+					}
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(progressMutex);
+			LOG_INFO << "[" << ++numDone << "/" << files.size() << "] " << file << ": " << item.status;
+		});
+	}
+	pool.wait();
+	lastRunSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	lastRunReconstructed = std::count_if(items.begin(), items.end(), [](const BatchItem& item) { return item.status == "ok"; });
+	return items;
+}
+
+double BatchScheduler::getFacesPerMinute() const {
+	return lastRunSeconds > 0 ? lastRunReconstructed * 60.0 / lastRunSeconds : 0.0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <functional>
+#include "Pipeline.h"
+#include "ThreadPool.h"
+
+// Outcome of one input of a batch.
+struct BatchItem {
+	std::string file;
+	// "ok", "missing", "unreadable", "no landmarks" or "not saved".
+	std::string status;
+	StageTimings timings;
+};
+
+// Fits many inputs with one face model, which all jobs share read-only. Jobs are scheduled on a
+// work-stealing thread pool and every worker reuses its own workspace.
+class BatchScheduler {
+public:
+	// Called on the worker thread after an input was reconstructed. Returns false if the result
+	// couldn't be saved, which fails the item.
+	typedef std::function<bool(const std::string& file, const ReconstructionResult& result)> ResultHandler;
+
+	BatchScheduler(const FaceModel& model, unsigned int numJobs);
+
+	// Fits all files, returns their outcomes in input order.
+	std::vector<BatchItem> run(const std::vector<std::string>& files, const ResultHandler& onResult);
+
+	// Wall time and throughput of the last run.
+	double getLastRunSeconds() const { return lastRunSeconds; }
+	double getFacesPerMinute() const;
+
+private:
+	const FaceModel& model;
+	ThreadPool pool;
+	std::vector<FitWorkspace> workspaces;
+
+	double lastRunSeconds = 0;
+	size_t lastRunReconstructed = 0;
+};
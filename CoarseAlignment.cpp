@@ -5,19 +5,79 @@
 #include "FaceModel.h"
 #include "Sensor.h"
 #include "ProcrustesAligner.h"
+#include "ProjectiveICP.h"
+#include "Settings.h"
+#include "Profiler.h"
+#include "Log.h"
 
 using namespace Eigen;
 
 Matrix4f computeCoarseAlignmentProcrustes(const FaceModel& model, const Sensor& inputSensor) {
-	std::cout << "  procrustes ..." << std::endl;
+	PROFILE_SCOPE("procrustes");
 	ProcrustesAligner pa;
 	return pa.estimatePose(model.m_averageFeaturePoints, inputSensor.m_featurePoints);
 }
 
-Eigen::Matrix4f computeCoarseAlignmentICP(const FaceModel& model, const Sensor& inputSensor, const Eigen::Matrix4f& initialPose) {
-	std::cout << "  icp ... " << std::flush;
-	Matrix3Xf modelNormals = model.computeNormals(model.m_averageMesh.vertices);
-	pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr modelCloud = pointsToCloud(model.m_averageMesh.vertices, modelNormals);
+// Gathers the vertices (packed, of the average face or a fitted shape) and normals used as ICP source:
+// the precomputed sample of the model if there is one, otherwise every n-th vertex as configured.
+static void gatherICPSource(const FaceModel& model, const VectorXf& vertices, bool fullSet, Matrix3Xf& outPoints, Matrix3Xf& outNormals) {
+	Map<const Matrix3Xf> modelVertices(vertices.data(), 3, model.getNumVertices());
+	if (fullSet) {
+		outPoints = modelVertices;
+		outNormals = model.m_averageNormals;
+		return;
+	}
+
+	std::vector<unsigned int> indices = model.m_icpSampleIndices;
+	if (indices.empty()) {
+		const unsigned int stride = std::max(1u, gSettings.icpStride);
+		for (unsigned int i = 0; i < model.getNumVertices(); i += stride) {
+			indices.push_back(i);
+		}
+	}
+	outPoints.resize(3, indices.size());
+	outNormals.resize(3, indices.size());
+	for (size_t i = 0; i < indices.size(); i++) {
+		outPoints.col(i) = modelVertices.col(indices[i]);
+		outNormals.col(i) = model.m_averageNormals.col(indices[i]);
+	}
+}
+
+Matrix4f computeCoarseAlignmentProjectiveICP(const FaceModel& model, const Sensor& inputSensor, const Matrix4f& initialPose) {
+	Matrix3Xf sourcePoints, sourceNormals;
+	gatherICPSource(model, model.m_averageMesh.vertices, false, sourcePoints, sourceNormals);
+	pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr target = inputSensor.compute_normals();
+
+	ProjectiveICP icp(inputSensor.m_cameraIntrinsics);
+	icp.maxIterations = gSettings.icpMaxIterations;
+
+	ICPStats stats;
+	Matrix4f pose = icp.estimatePose(sourcePoints, sourceNormals, *target, initialPose, &stats);
+
+	LOG_INFO << "Projective ICP " << (stats.converged ? "converged" : "not converged") << " after " << stats.iterations << " iterations ("
+		<< stats.numCorrespondences << "/" << sourcePoints.cols() << " correspondences, rmse " << stats.rmse << ", "
+		<< stats.timeMs << " ms)";
+
+	if (stats.numCorrespondences < 6) {
+		LOG_WARNING << "Projective ICP failed, keeping the initial pose.";
+		return initialPose;
+	}
+
+	if (gSettings.icpRefineFull) {
+		// A few more iterations on all vertices, starting close to the solution.
+		gatherICPSource(model, model.m_averageMesh.vertices, true, sourcePoints, sourceNormals);
+		icp.maxIterations = 3;
+		pose = icp.estimatePose(sourcePoints, sourceNormals, *target, pose, &stats);
+		LOG_INFO << "Refined on all " << sourcePoints.cols() << " vertices (rmse " << stats.rmse << ", "
+			<< stats.timeMs << " ms)";
+	}
+	return pose;
+}
+
+Matrix4f computeCoarseAlignmentPCLICP(const FaceModel& model, const Sensor& inputSensor, const Matrix4f& initialPose) {
+	Matrix3Xf sourcePoints, sourceNormals;
+	gatherICPSource(model, model.m_averageMesh.vertices, false, sourcePoints, sourceNormals);
+	pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr modelCloud = pointsToCloud(Map<const VectorXf>(sourcePoints.data(), sourcePoints.size()), sourceNormals);
 
 	pcl::IterativeClosestPointWithNormals<pcl::PointXYZRGBNormal, pcl::PointXYZRGBNormal> icp;
 	icp.setInputSource(modelCloud);
@@ -32,10 +92,51 @@ Eigen::Matrix4f computeCoarseAlignmentICP(const FaceModel& model, const Sensor&
     icp.align(icpAlignedCloud, initialPose);
 
 	if (icp.hasConverged()) {
-		std::cout << "converged" << std::endl;
+		LOG_INFO << "ICP converged";
 		return icp.getFinalTransformation();
 	} else {
-		std::cout << "failed" << std::endl;
+		LOG_WARNING << "ICP failed";
 		return Matrix4f::Identity();
 	}
 }
+
+bool parseICPMethod(const std::string& name, ICPMethod& outMethod) {
+	if (name == "projective") {
+		outMethod = ICPMethod::Projective;
+	}
+	else if (name == "pcl") {
+		outMethod = ICPMethod::PCL;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+Eigen::Matrix4f computeCoarseAlignmentICP(const FaceModel& model, const Sensor& inputSensor, const Eigen::Matrix4f& initialPose) {
+	PROFILE_SCOPE("icp");
+	ICPMethod method = ICPMethod::Projective;
+	if (!parseICPMethod(gSettings.icpMethod, method)) {
+		LOG_WARNING << "Unknown ICP variant " << gSettings.icpMethod << ", using projective";
+	}
+	if (method == ICPMethod::PCL) {
+		return computeCoarseAlignmentPCLICP(model, inputSensor, initialPose);
+	}
+	return computeCoarseAlignmentProjectiveICP(model, inputSensor, initialPose);
+}
+
+Matrix4f refinePoseProjectiveICP(const FaceModel& model, const FaceParameters& params, const Sensor& inputSensor,
+	const Matrix4f& initialPose, unsigned int maxIterations, ICPStats* stats) {
+	PROFILE_SCOPE("icp");
+	Matrix3Xf sourcePoints, sourceNormals;
+	gatherICPSource(model, model.computeShape(params), false, sourcePoints, sourceNormals);
+
+	ProjectiveICP icp(inputSensor.m_cameraIntrinsics);
+	icp.maxIterations = maxIterations;
+	ICPStats localStats;
+	Matrix4f pose = icp.estimatePose(sourcePoints, sourceNormals, *inputSensor.compute_normals(), initialPose, &localStats);
+	if (stats) {
+		*stats = localStats;
+	}
+	return localStats.numCorrespondences < 6 ? initialPose : pose;
+}
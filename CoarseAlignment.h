@@ -1,8 +1,26 @@
 #pragma once
 
+#include <string>
+#include "ProjectiveICP.h"
+
 class FaceModel;
 class Sensor;
+struct FaceParameters;
+
+// ICP variants of the coarse alignment.
+enum class ICPMethod { Projective, PCL };
+
+// "projective" or "pcl".
+bool parseICPMethod(const std::string& name, ICPMethod& outMethod);
 
 // returns pose
 Eigen::Matrix4f computeCoarseAlignmentProcrustes(const FaceModel& model, const Sensor& inputSensor);
-Eigen::Matrix4f computeCoarseAlignmentICP(const FaceModel& model, const Sensor& inputSensor, const Eigen::Matrix4f& initialPose);
\ No newline at end of file
+// Runs the ICP variant selected in the settings.
+Eigen::Matrix4f computeCoarseAlignmentICP(const FaceModel& model, const Sensor& inputSensor, const Eigen::Matrix4f& initialPose);
+// ICP with projective data association on the organized input cloud.
+Eigen::Matrix4f computeCoarseAlignmentProjectiveICP(const FaceModel& model, const Sensor& inputSensor, const Eigen::Matrix4f& initialPose);
+// ICP with kd-tree nearest neighbor search (pcl::IterativeClosestPointWithNormals).
+Eigen::Matrix4f computeCoarseAlignmentPCLICP(const FaceModel& model, const Sensor& inputSensor, const Eigen::Matrix4f& initialPose);
+// Short projective ICP of the fitted shape (instead of the average face), for tracking from the previous frame's pose.
+Eigen::Matrix4f refinePoseProjectiveICP(const FaceModel& model, const FaceParameters& params, const Sensor& inputSensor,
+	const Eigen::Matrix4f& initialPose, unsigned int maxIterations, ICPStats* stats = nullptr);
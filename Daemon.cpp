@@ -0,0 +1,401 @@
+#include "stdafx.h"
+#include <sstream>
+#include "Daemon.h"
+#include "Settings.h"
+#include "FaceModel.h"
+#include "FrameSensor.h"
+#include "VirtualSensor.h"
+#include "Pipeline.h"
+#include "ThreadPool.h"
+#include "Metrics.h"
+#include "Json.h"
+#include "Export.h"
+#include "Log.h"
+#ifdef HAVE_UNIX_SOCKETS
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <condition_variable>
+#include <set>
+#include "SocketFrameSource.h"
+#endif
+
+// Inline frames are a few MB, anything much larger is a broken client.
+const size_t MAX_REQUEST_LENGTH = 256 * 1024 * 1024;
+const uint64_t MAX_FRAME_POINTS = 1u << 24;
+
+typedef std::chrono::steady_clock Clock;
+
+static double millisecondsSince(Clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Destination of the result lines of one client, shared by all its jobs.
+class ResultChannel {
+public:
+	virtual ~ResultChannel() {}
+	virtual void send(const std::string& line) = 0;
+};
+
+class StreamResultChannel : public ResultChannel {
+public:
+	explicit StreamResultChannel(std::ostream& out) : out(out) {}
+
+	void send(const std::string& line) override {
+		std::lock_guard<std::mutex> lock(mutex);
+		out << line << std::endl;
+	}
+
+private:
+	std::ostream& out;
+	std::mutex mutex;
+};
+
+#ifdef HAVE_UNIX_SOCKETS
+// Owns the client connection, which is closed once the last job of the client answered.
+class SocketResultChannel : public ResultChannel {
+public:
+	explicit SocketResultChannel(int fd) : fd(fd) {}
+	~SocketResultChannel() {
+		::close(fd);
+	}
+
+	void send(const std::string& line) override {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::string data = line + "\n";
+		writeAll(fd, data.data(), data.size());
+	}
+
+private:
+	const int fd;
+	std::mutex mutex;
+};
+#endif
+
+static std::string errorResponse(const std::string& id, const std::string& message) {
+	return "{\"id\": " + id + ", \"status\": \"error\", \"error\": " + jsonString(message) + "}";
+}
+
+// Sensor for a file input. Uses the .points file next to the input if there is one,
+// otherwise the feature points are detected.
+static std::unique_ptr<FrameSensor> createFileSensor(const std::string& file, std::string& outError) {
+	std::unique_ptr<FrameSensor> sensor(new FrameSensor());
+	if (!sensor->loadFile(file)) {
+		outError = "Couldn't read the pcd file " + file;
+		return nullptr;
+	}
+	if (sensor->m_featurePoints.empty() && !sensor->detectFeaturePoints()) {
+		outError = "No face found in " + file;
+		return nullptr;
+	}
+	return sensor;
+}
+
+// Sensor for an inline frame: {"width", "height", "intrinsics" (optional), "points" (base64 WirePoints)}.
+static std::unique_ptr<FrameSensor> createInlineSensor(const JsonValue& frameJson, std::string& outError) {
+	uint64_t width = uint64_t(frameJson.getNumber("width"));
+	uint64_t height = uint64_t(frameJson.getNumber("height"));
+	if (width == 0 || height == 0 || width * height > MAX_FRAME_POINTS) {
+		outError = "Invalid frame size";
+		return nullptr;
+	}
+	std::vector<uint8_t> data;
+	if (!decodeBase64(frameJson.getString("points"), data) || data.size() != width * height * sizeof(WirePoint)) {
+		outError = "Frame points must be base64 encoded, " + std::to_string(sizeof(WirePoint)) + " bytes per pixel";
+		return nullptr;
+	}
+
+	Frame frame;
+	frame.cloud = wirePointsToCloud(reinterpret_cast<const WirePoint*>(data.data()), uint32_t(width), uint32_t(height));
+	frame.cameraIntrinsics = VirtualSensor::intrinsicsForWidth(uint32_t(width));
+	const JsonValue* intrinsics = frameJson.find("intrinsics");
+	if (intrinsics) {
+		if (intrinsics->array.size() != 9) {
+			outError = "Intrinsics must have 9 entries";
+			return nullptr;
+		}
+		for (int i = 0; i < 9; i++) {
+			frame.cameraIntrinsics(i / 3, i % 3) = float(intrinsics->array[i].number);
+		}
+	}
+	frame.captureTime = std::chrono::system_clock::now();
+
+	std::unique_ptr<FrameSensor> sensor(new FrameSensor(frame));
+	if (!sensor->detectFeaturePoints()) {
+		outError = "No face found in frame";
+		return nullptr;
+	}
+	return sensor;
+}
+
+template <typename Vector>
+static void writeJsonArray(std::ostream& out, const Vector& values) {
+	out << "[";
+	for (int i = 0; i < values.size(); i++) {
+		out << (i > 0 ? ", " : "") << values(i);
+	}
+	out << "]";
+}
+
+class Daemon {
+public:
+	Daemon(const FaceModel& model, unsigned int numJobs, const std::vector<ExportFormat>& exportFormats)
+		: model(model), exportFormats(exportFormats), pool(numJobs), workspaces(pool.size()) {}
+
+	// Handles one request line. Returns false if the daemon should shut down.
+	bool handleRequest(const std::string& line, const std::shared_ptr<ResultChannel>& channel) {
+		Clock::time_point received = Clock::now();
+
+		std::shared_ptr<JsonValue> request = std::make_shared<JsonValue>();
+		std::string error;
+		if (!parseJson(line, *request, error) || !request->isObject()) {
+			channel->send(errorResponse("null", "Malformed request: " + (error.empty() ? "expected an object" : error)));
+			return true;
+		}
+		const JsonValue* idValue = request->find("id");
+		std::string id = idValue ? toJson(*idValue) : "null";
+
+		std::string command = request->getString("command");
+		if (command == "shutdown") {
+			return false;
+		}
+		if (command == "stats") {
+			std::ostringstream response;
+			response << "{\"id\": " << id << ", \"status\": \"ok\", \"stats\": ";
+			writeStats(response);
+			response << "}";
+			channel->send(response.str());
+			return true;
+		}
+		if (!command.empty()) {
+			channel->send(errorResponse(id, "Unknown command " + command));
+			return true;
+		}
+		if (request->getString("input").empty() && !request->find("frame")) {
+			channel->send(errorResponse(id, "Request needs an input or a frame"));
+			return true;
+		}
+
+		pool.submit([this, request, id, channel, received] {
+			runJob(*request, id, *channel, received);
+		});
+		return true;
+	}
+
+	void wait() {
+		pool.wait();
+	}
+
+	// {"ok": ..., "failed": ..., "latency": {...}, "queue_wait": {...}}
+	void writeStats(std::ostream& out) const {
+		out << "{\"ok\": " << numOk << ", \"failed\": " << numFailed << ", \"latency\": ";
+		requestLatency.writeJson(out);
+		out << ", \"queue_wait\": ";
+		queueWait.writeJson(out);
+		out << "}";
+	}
+
+private:
+	const FaceModel& model;
+	const std::vector<ExportFormat> exportFormats;
+	ThreadPool pool;
+	std::vector<FitWorkspace> workspaces;
+
+	// From receiving a request to sending its result.
+	LatencyStats requestLatency;
+	// From receiving a request to starting its job.
+	LatencyStats queueWait;
+	std::atomic<uint64_t> numOk{ 0 };
+	std::atomic<uint64_t> numFailed{ 0 };
+
+	void runJob(const JsonValue& request, const std::string& id, ResultChannel& channel, Clock::time_point received) {
+		double waitMs = millisecondsSince(received);
+		queueWait.add(waitMs);
+		LogContext logContext("job " + id);
+
+		std::string error;
+		std::unique_ptr<FrameSensor> sensor = request.find("frame")
+			? createInlineSensor(*request.find("frame"), error)
+			: createFileSensor(request.getString("input"), error);
+		if (!sensor) {
+			numFailed++;
+			requestLatency.add(millisecondsSince(received));
+			channel.send(errorResponse(id, error));
+			return;
+		}
+
+		ReconstructionOptions options = ReconstructionOptions::fromSettings();
+		const JsonValue* optionsJson = request.find("options");
+		if (optionsJson) {
+			options.skipICP = optionsJson->getBool("skip_icp", options.skipICP);
+			options.skipOptimization = optionsJson->getBool("skip_optimization", options.skipOptimization);
+			options.timeBudgetMs = optionsJson->getNumber("time_budget_ms", options.timeBudgetMs);
+		}
+
+		ReconstructionResult result = reconstructFace(model, *sensor, &workspaces[ThreadPool::currentWorker()], options);
+
+		// Optionally write the result for consumers that read files instead of the response.
+		std::string exportPath = request.getString("export");
+		bool exported = false;
+		if (!exportPath.empty()) {
+			exported = exportFace(model, result.params, result.pose, exportPath, exportFormats);
+		}
+		double latencyMs = millisecondsSince(received);
+		requestLatency.add(latencyMs);
+		numOk++;
+
+		std::ostringstream response;
+		response << "{\"id\": " << id << ", \"status\": \"ok\", \"latency_ms\": " << latencyMs << ", \"queue_ms\": " << waitMs
+			<< ", \"timings\": {\"procrustes_ms\": " << result.timings.procrustesMs << ", \"icp_ms\": " << result.timings.icpMs
+			<< ", \"optimization_ms\": " << result.timings.optimizationMs << ", \"total_ms\": " << result.timings.totalMs << "}"
+			<< (exportPath.empty() ? "" : std::string(", \"exported\": ") + (exported ? "true" : "false"));
+		if (result.budget.budgetMs > 0) {
+			response << ", \"budget\": {\"budget_ms\": " << result.budget.budgetMs << ", \"met\": " << (result.budget.met ? "true" : "false")
+				<< ", \"cuts\": [";
+			for (size_t i = 0; i < result.budget.cuts.size(); i++) {
+				response << (i > 0 ? ", " : "") << jsonString(result.budget.cuts[i]);
+			}
+			response << "]}";
+		}
+		response << ", \"pose\": ";
+		Eigen::Matrix<float, 4, 4, Eigen::RowMajor> pose = result.pose;
+		writeJsonArray(response, Eigen::Map<const Eigen::VectorXf>(pose.data(), 16));
+		response << ", \"alpha\": ";
+		writeJsonArray(response, result.params.alpha);
+		response << ", \"beta\": ";
+		writeJsonArray(response, result.params.beta);
+		response << "}";
+		channel.send(response.str());
+	}
+};
+
+// Reads requests from stdin and writes results to stdout. Log output goes to stderr meanwhile.
+static void serveStdin(Daemon& daemon) {
+	Log::setOutput(std::cerr);
+	std::shared_ptr<ResultChannel> channel = std::make_shared<StreamResultChannel>(std::cout);
+
+	std::string line;
+	while (std::getline(std::cin, line)) {
+		if (line.empty()) {
+			continue;
+		}
+		if (!daemon.handleRequest(line, channel)) {
+			break;
+		}
+	}
+	daemon.wait();
+	Log::setOutput(std::cout);
+}
+
+#ifdef HAVE_UNIX_SOCKETS
+// Accepts clients on a UNIX domain socket until a client sends the shutdown command.
+static bool serveSocket(Daemon& daemon, const std::string& socketPath) {
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(address.sun_path)) {
+		LOG_ERROR << "Socket path too long: " << socketPath;
+		return false;
+	}
+	strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+	::unlink(socketPath.c_str());
+
+	int listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listenFd < 0 || ::bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || ::listen(listenFd, 64) < 0) {
+		LOG_ERROR << "Couldn't listen on " << socketPath << ": " << strerror(errno);
+		if (listenFd >= 0) {
+			::close(listenFd);
+		}
+		return false;
+	}
+	LOG_INFO << "Waiting for jobs on " << socketPath << " ...";
+
+	std::atomic<bool> running{ true };
+	// Client threads are detached, so finished ones don't pile up in a long-running daemon. The set
+	// holds the sockets of the live ones, which are waited for before returning.
+	std::mutex clientsMutex;
+	std::condition_variable clientsDone;
+	std::set<int> clientFds;
+
+	auto stop = [&] {
+		running = false;
+		// unblocks accept() and the reads of all clients
+		::shutdown(listenFd, SHUT_RDWR);
+		std::lock_guard<std::mutex> lock(clientsMutex);
+		for (int fd : clientFds) {
+			::shutdown(fd, SHUT_RD);
+		}
+	};
+
+	while (running) {
+		int fd = ::accept(listenFd, nullptr, nullptr);
+		if (fd < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		{
+			std::lock_guard<std::mutex> lock(clientsMutex);
+			clientFds.insert(fd);
+		}
+		std::thread([&, fd] {
+			std::shared_ptr<ResultChannel> channel = std::make_shared<SocketResultChannel>(fd);
+			SocketLineReader reader(fd, MAX_REQUEST_LENGTH);
+			std::string line;
+			while (running && reader.readLine(line)) {
+				if (!line.empty() && !daemon.handleRequest(line, channel)) {
+					stop();
+				}
+			}
+			std::lock_guard<std::mutex> lock(clientsMutex);
+			clientFds.erase(fd);
+			clientsDone.notify_all();
+		}).detach();
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(clientsMutex);
+		clientsDone.wait(lock, [&] { return clientFds.empty(); });
+	}
+	daemon.wait();
+	::close(listenFd);
+	::unlink(socketPath.c_str());
+	return true;
+}
+#endif
+
+int runDaemon() {
+	std::vector<ExportFormat> exportFormats;
+	if (!parseExportFormats(gSettings.exportFormats, exportFormats)) {
+		LOG_ERROR << "Unknown export format in " << gSettings.exportFormats;
+		return -2;
+	}
+
+	LOG_INFO << "Loading face model ...";
+	FaceModel model = FaceModel::fromSettings();
+	Daemon daemon(model, gSettings.jobs, exportFormats);
+
+	if (gSettings.daemonSocket.empty()) {
+		serveStdin(daemon);
+	}
+	else {
+#ifdef HAVE_UNIX_SOCKETS
+		if (!serveSocket(daemon, gSettings.daemonSocket)) {
+			return -1;
+		}
+#else
+		LOG_ERROR << "The daemon socket requires UNIX domain sockets, which are not available on this platform. Use stdin instead.";
+		return -2;
+#endif
+	}
+
+	if (gSettings.metricsFile.empty()) {
+		daemon.writeStats(std::cerr);
+		std::cerr << std::endl;
+	}
+	else {
+		std::ofstream metricsOut(gSettings.metricsFile);
+		daemon.writeStats(metricsOut);
+	}
+	return 0;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+// Long-running reconstruction service. Loads the face model once and fits jobs received as JSON
+// lines, either from clients of a UNIX domain socket or from stdin. Every job is answered with
+// one JSON line as soon as it is done, so results of concurrent jobs can arrive out of order.
+//
+// Requests:
+//   {"id": 1, "input": "face.pcd", "options": {"skip_icp": false, "skip_optimization": false},
+//    "export": "out/face"}             optional, writes the --export formats to out/face_*
+//   {"id": 2, "frame": {"width": 640, "height": 480, "intrinsics": [9 numbers, row-major],
+//                       "points": "<base64 of width * height WirePoints>"}}
+//   {"id": 3, "command": "stats"}      request latency percentiles
+//   {"command": "shutdown"}            finish the queued jobs and exit
+// Responses carry the id, "status" ("ok" or "error"), latencies, stage timings, pose and parameters.
+int runDaemon();
@@ -0,0 +1,206 @@
+#include "stdafx.h"
+#include "Export.h"
+#include "Profiler.h"
+#include "Log.h"
+
+// Collects small writes in a large buffer, so per-vertex output doesn't go through the stream one value at a time.
+class BufferedWriter {
+public:
+	explicit BufferedWriter(const std::string& path) : out(path, std::ios::binary) {
+		buffer.reserve(BUFFER_SIZE);
+	}
+	~BufferedWriter() {
+		flush();
+	}
+
+	bool good() const { return out.good(); }
+
+	void write(const void* data, size_t size) {
+		if (buffer.size() + size > BUFFER_SIZE) {
+			flush();
+		}
+		const char* bytes = static_cast<const char*>(data);
+		buffer.insert(buffer.end(), bytes, bytes + size);
+	}
+
+	template <typename T>
+	void write(const T& value) {
+		write(&value, sizeof(T));
+	}
+
+	void writeText(const std::string& text) {
+		write(text.data(), text.size());
+	}
+
+	// Appends printf-style formatted text of up to 255 characters.
+	template <typename... Args>
+	void format(const char* format, Args... args) {
+		char line[256];
+		int length = snprintf(line, sizeof(line), format, args...);
+		write(line, std::min<size_t>(std::max(length, 0), sizeof(line) - 1));
+	}
+
+	bool flush() {
+		if (!buffer.empty()) {
+			out.write(buffer.data(), buffer.size());
+			buffer.clear();
+		}
+		out.flush();
+		return out.good();
+	}
+
+private:
+	static const size_t BUFFER_SIZE = 1 << 20;
+
+	std::ofstream out;
+	std::vector<char> buffer;
+};
+
+bool parseExportFormats(const std::string& names, std::vector<ExportFormat>& outFormats) {
+	outFormats.clear();
+	std::stringstream stream(names);
+	std::string name;
+	while (std::getline(stream, name, ',')) {
+		if (name == "ply") {
+			outFormats.push_back(ExportFormat::PLY);
+		}
+		else if (name == "obj") {
+			outFormats.push_back(ExportFormat::OBJ);
+		}
+		else if (name == "npy") {
+			outFormats.push_back(ExportFormat::NPY);
+		}
+		else if (name == "txt") {
+			outFormats.push_back(ExportFormat::Text);
+		}
+		else if (!name.empty()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static Eigen::Vector3f posedVertex(const Eigen::VectorXf& vertices, unsigned int index, const Eigen::Matrix4f& pose) {
+	return pose.topLeftCorner<3, 3>() * vertices.segment<3>(3 * index) + pose.topRightCorner<3, 1>();
+}
+
+bool writeMeshPLY(const std::string& path, const Eigen::VectorXf& vertices, const Eigen::Matrix4Xi& colors,
+	const Eigen::Matrix3Xi& triangles, const Eigen::Matrix4f& pose) {
+	BufferedWriter out(path);
+	if (!out.good()) {
+		LOG_ERROR << "Can not write " << path;
+		return false;
+	}
+
+	const unsigned int numVertices = vertices.size() / 3;
+	// Binary data is written in host byte order, which is little-endian on all supported platforms.
+	out.writeText("ply\nformat binary_little_endian 1.0\n");
+	out.writeText("element vertex " + std::to_string(numVertices) + "\n");
+	out.writeText("property float x\nproperty float y\nproperty float z\n");
+	out.writeText("property uchar red\nproperty uchar green\nproperty uchar blue\n");
+	out.writeText("element face " + std::to_string(triangles.cols()) + "\n");
+	out.writeText("property list uchar int vertex_indices\nend_header\n");
+
+	for (unsigned int i = 0; i < numVertices; i++) {
+		Eigen::Vector3f v = posedVertex(vertices, i, pose);
+		out.write(v.data(), 3 * sizeof(float));
+		uint8_t rgb[3] = { uint8_t(colors(0, i)), uint8_t(colors(1, i)), uint8_t(colors(2, i)) };
+		out.write(rgb, sizeof(rgb));
+	}
+	for (int t = 0; t < triangles.cols(); t++) {
+		out.write(uint8_t(3));
+		out.write(triangles.col(t).data(), 3 * sizeof(int));
+	}
+	return out.flush();
+}
+
+bool writeMeshOBJ(const std::string& path, const Eigen::VectorXf& vertices, const Eigen::Matrix4Xi& colors,
+	const Eigen::Matrix3Xi& triangles, const Eigen::Matrix4f& pose) {
+	BufferedWriter out(path);
+	if (!out.good()) {
+		LOG_ERROR << "Can not write " << path;
+		return false;
+	}
+
+	const unsigned int numVertices = vertices.size() / 3;
+	for (unsigned int i = 0; i < numVertices; i++) {
+		Eigen::Vector3f v = posedVertex(vertices, i, pose);
+		out.format("v %.6f %.6f %.6f %.4f %.4f %.4f\n", v.x(), v.y(), v.z(),
+			colors(0, i) / 255.0f, colors(1, i) / 255.0f, colors(2, i) / 255.0f);
+	}
+	// OBJ indices start at 1.
+	for (int t = 0; t < triangles.cols(); t++) {
+		out.format("f %d %d %d\n", triangles(0, t) + 1, triangles(1, t) + 1, triangles(2, t) + 1);
+	}
+	return out.flush();
+}
+
+bool writeNpy(const std::string& path, const float* data, const std::vector<size_t>& shape) {
+	BufferedWriter out(path);
+	if (!out.good()) {
+		LOG_ERROR << "Can not write " << path;
+		return false;
+	}
+
+	size_t count = 1;
+	std::string shapeText = "(";
+	for (size_t i = 0; i < shape.size(); i++) {
+		shapeText += std::to_string(shape[i]) + (shape.size() == 1 || i + 1 < shape.size() ? ", " : "");
+		count *= shape[i];
+	}
+	shapeText += ")";
+	std::string header = "{'descr': '<f4', 'fortran_order': False, 'shape': " + shapeText + ", }";
+	// Magic (6) + version (2) + header length (2) + header must be a multiple of 64, the header ends with a newline.
+	header.append(63 - (10 + header.size()) % 64, ' ');
+	header += '\n';
+
+	out.writeText("\x93NUMPY");
+	out.write(uint8_t(1));
+	out.write(uint8_t(0));
+	out.write(uint16_t(header.size()));
+	out.writeText(header);
+	out.write(data, count * sizeof(float));
+	return out.flush();
+}
+
+bool exportFace(const FaceModel& model, const FaceParameters& params, const Eigen::Matrix4f& pose,
+	const std::string& basePath, const std::vector<ExportFormat>& formats) {
+	PROFILE_SCOPE("export");
+	bool ok = true;
+	Eigen::VectorXf vertices;
+	Eigen::Matrix4Xi colors;
+	auto computeMesh = [&] {
+		if (vertices.size() == 0) {
+			vertices = model.computeShape(params);
+			colors = model.computeColors(params);
+		}
+	};
+	Eigen::Matrix<float, 4, 4, Eigen::RowMajor> poseRowMajor = pose;
+
+	for (ExportFormat format : formats) {
+		switch (format) {
+		case ExportFormat::PLY:
+			computeMesh();
+			ok &= writeMeshPLY(basePath + "_mesh.ply", vertices, colors, model.m_averageMesh.triangles, pose);
+			break;
+		case ExportFormat::OBJ:
+			computeMesh();
+			ok &= writeMeshOBJ(basePath + "_mesh.obj", vertices, colors, model.m_averageMesh.triangles, pose);
+			break;
+		case ExportFormat::NPY:
+			ok &= writeNpy(basePath + "_alpha.npy", params.alpha.data(), { size_t(params.alpha.size()) });
+			ok &= writeNpy(basePath + "_beta.npy", params.beta.data(), { size_t(params.beta.size()) });
+			ok &= writeNpy(basePath + "_pose.npy", poseRowMajor.data(), { 4, 4 });
+			break;
+		case ExportFormat::Text: {
+			std::ofstream paramsOut(basePath + "_params.txt");
+			paramsOut << "alpha " << params.alpha.transpose() << std::endl;
+			paramsOut << "beta " << params.beta.transpose() << std::endl;
+			paramsOut << "pose" << std::endl << pose << std::endl;
+			ok &= paramsOut.good();
+			break;
+		}
+		}
+	}
+	return ok;
+}
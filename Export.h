@@ -0,0 +1,33 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "FaceModel.h"
+
+// Output formats for reconstruction results.
+enum class ExportFormat {
+	// Posed mesh with vertex colors, binary little-endian PLY.
+	PLY,
+	// Posed mesh with vertex colors (as "v x y z r g b"), Wavefront OBJ.
+	OBJ,
+	// alpha, beta (float32 vectors) and pose (float32 4x4, row-major) as NumPy .npy files.
+	NPY,
+	// alpha, beta and pose as text.
+	Text
+};
+
+// Parses a comma separated list of "ply", "obj", "npy" and "txt". Returns false for unknown names.
+bool parseExportFormats(const std::string& names, std::vector<ExportFormat>& outFormats);
+
+// Mesh writers. The vertices (packed, 3 * numVertices) are transformed by the pose while they are written.
+bool writeMeshPLY(const std::string& path, const Eigen::VectorXf& vertices, const Eigen::Matrix4Xi& colors,
+	const Eigen::Matrix3Xi& triangles, const Eigen::Matrix4f& pose);
+bool writeMeshOBJ(const std::string& path, const Eigen::VectorXf& vertices, const Eigen::Matrix4Xi& colors,
+	const Eigen::Matrix3Xi& triangles, const Eigen::Matrix4f& pose);
+
+// Writes a float32 array in C order as NumPy .npy (format version 1.0).
+bool writeNpy(const std::string& path, const float* data, const std::vector<size_t>& shape);
+
+// Writes the face with the given parameters and pose to <basePath>_mesh.ply, <basePath>_mesh.obj,
+// <basePath>_alpha.npy, <basePath>_beta.npy, <basePath>_pose.npy or <basePath>_params.txt.
+bool exportFace(const FaceModel& model, const FaceParameters& params, const Eigen::Matrix4f& pose,
+	const std::string& basePath, const std::vector<ExportFormat>& formats);
@@ -1,6 +1,9 @@
 #include "stdafx.h"
 #include "FaceModel.h"
 #include "FeaturePointExtractor.h"
+#include "Profiler.h"
+#include "Settings.h"
+#include "Log.h"
 
 const std::string filenameAverageMesh = "averageMesh.off";
 const std::string filenameAverageMeshFeaturePoints = "averageMesh_features.points";
@@ -21,7 +24,8 @@ Eigen::MatrixXf discardEvery4thRow(const Eigen::Ref<const Eigen::MatrixXf>& matr
 	return result;
 }
 
-FaceModel::FaceModel(const std::string& baseDir) {
+FaceModel::FaceModel(const std::string& baseDir, unsigned int numICPSamples) {
+	PROFILE_SCOPE("model load");
 	// load average shape
 	m_averageMesh = loadOFF(baseDir + filenameAverageMesh);
 	m_averageMesh.vertices /= 1000000.0f;
@@ -40,7 +44,7 @@ FaceModel::FaceModel(const std::string& baseDir) {
 	// load albedo basis
 	std::vector<float> albedoBasisRaw = loadBinaryVector(baseDir + filenameBasisAlbedo);
 	if (albedoBasisRaw.size() != shapeBasisRaw.size()) {
-		std::cout << "ERROR: Expected albedo basis to be the same size as shape basis." << std::endl;
+		LOG_ERROR << "Expected albedo basis to be the same size as shape basis.";
 		exit(1);
 	}
 	Eigen::Map<Eigen::MatrixXf> albedoBasis4(albedoBasisRaw.data(), 4 * nVertices, nEigenVec);
@@ -61,26 +65,110 @@ FaceModel::FaceModel(const std::string& baseDir) {
 	m_albedoStd = Eigen::Map<Eigen::RowVectorXf>(albedoStdRaw.data(), albedoStdRaw.size());
 	std::vector<float> expressionStdRaw = loadBinaryVector(baseDir + filenameStdDevExpression);
 	m_expressionStd = Eigen::Map<Eigen::RowVectorXf>(expressionStdRaw.data(), expressionStdRaw.size());
+
+	// precompute data for coarse alignment
+	m_averageCenter = Eigen::Map<const Eigen::Matrix3Xf>(m_averageMesh.vertices.data(), 3, nVertices).rowwise().mean();
+	m_averageNormals = computeNormals(m_averageMesh.vertices);
+	m_icpSampleIndices = computeNormalSpaceSample(numICPSamples);
+	Profiler::instance().recordMemory("model load");
 }
 
-Eigen::VectorXf FaceModel::computeShape(const FaceParameters& params) const
-{
-	assert(params.alpha.rows() == m_shapeBasis.cols() && "face parameter alpha has incorrect size");
-	auto& scaledAlpha = (params.alpha.array() * m_shapeStd.array()).matrix();
-	return m_averageMesh.vertices + m_shapeBasis * scaledAlpha;
+// Depth of the synthetic face surface at (x, y): an ellipsoid cap with a nose, flat outside the cap.
+static float syntheticFaceDepth(float x, float y) {
+	float cap = 1.0f - (x / 0.085f) * (x / 0.085f) - (y / 0.115f) * (y / 0.115f);
+	float nose = 0.03f * std::exp(-(x * x + (y + 0.005f) * (y + 0.005f)) / (2 * 0.012f * 0.012f));
+	return 0.09f * std::sqrt(std::max(cap, 0.0f)) + nose;
 }
 
-Eigen::Matrix4Xi FaceModel::computeColors(const FaceParameters& params) const
-{
-	assert(params.beta.rows() == m_albedoBasis.cols() && "face parameter beta has incorrect size");
-	// interpolate RGB values as floats
-	Eigen::Matrix3Xf colorsRGB = m_averageMesh.vertexColors.topRows<3>().cast<float>();
-	// reshape from matrix (3, numVertices) to vector (3 * numVertices)
-	Eigen::Map<Eigen::VectorXf> flatColorsRGB(colorsRGB.data(), 3 * getNumVertices());
+FaceModel FaceModel::createSynthetic(unsigned int gridSize, unsigned int numEigenVec, unsigned int numICPSamples, unsigned int seed) {
+	FaceModel model;
+	const unsigned int n = std::max(gridSize, 2u);
+	const unsigned int nVertices = n * n;
+	const float minX = -0.08f, maxX = 0.08f, minY = -0.11f, maxY = 0.1f;
 
-	auto& scaledBeta = (params.beta.array() * m_albedoStd.array()).matrix();
-	flatColorsRGB += m_albedoBasis * scaledBeta;
+	Mesh& mesh = model.m_averageMesh;
+	mesh.vertices.resize(3 * nVertices);
+	mesh.vertexColors.resize(4, nVertices);
+	for (unsigned int j = 0; j < n; j++) {
+		for (unsigned int i = 0; i < n; i++) {
+			unsigned int v = j * n + i;
+			float x = minX + (maxX - minX) * i / (n - 1);
+			float y = minY + (maxY - minY) * j / (n - 1);
+			mesh.vertices.segment<3>(3 * v) = Eigen::Vector3f(x, y, syntheticFaceDepth(x, y));
+			// Skin tone, slightly darker towards the chin.
+			int shade = int(20.0f * (maxY - y) / (maxY - minY));
+			mesh.vertexColors.col(v) = Eigen::Vector4i(210 - shade, 165 - shade, 140 - shade, 255);
+		}
+	}
+	// Two triangles per grid cell, counter-clockwise seen from +z.
+	mesh.triangles.resize(3, 2 * (n - 1) * (n - 1));
+	int t = 0;
+	for (unsigned int j = 0; j + 1 < n; j++) {
+		for (unsigned int i = 0; i + 1 < n; i++) {
+			int v00 = j * n + i, v10 = v00 + 1, v01 = v00 + n, v11 = v01 + 1;
+			mesh.triangles.col(t++) = Eigen::Vector3i(v00, v10, v11);
+			mesh.triangles.col(t++) = Eigen::Vector3i(v00, v11, v01);
+		}
+	}
+
+	// Eyes, nose tip, mouth corners and chin, in the order of the feature point files.
+	const float featureXY[NUM_EXPECTED_FEATURE_POINTS][2] = {
+		{ -0.031f, 0.033f }, { 0.032f, 0.033f }, { 0.0f, -0.005f },
+		{ -0.017f, -0.02f }, { 0.019f, -0.02f }, { 0.002f, -0.06f } };
+	for (const auto& xy : featureXY) {
+		model.m_averageFeaturePoints.emplace_back(xy[0], xy[1], syntheticFaceDepth(xy[0], xy[1]));
+	}
+
+	// Bases of low-frequency waves over the face, so that deformations stay smooth. Displacements are
+	// in meters per standard deviation (about 2 mm for the first vectors), albedos in [0, 255].
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> frequency(10.0f, 60.0f);
+	std::uniform_real_distribution<float> phase(0.0f, float(2 * EIGEN_PI));
+	std::normal_distribution<float> normal(0.0f, 1.0f);
+	model.m_shapeBasis.resize(3 * nVertices, numEigenVec);
+	model.m_albedoBasis.resize(3 * nVertices, numEigenVec);
+	model.m_shapeStd.resize(numEigenVec);
+	model.m_albedoStd.resize(numEigenVec);
+	for (unsigned int k = 0; k < numEigenVec; k++) {
+		Eigen::Vector2f shapeWave(frequency(rng), frequency(rng));
+		Eigen::Vector2f albedoWave(frequency(rng), frequency(rng));
+		float shapePhase = phase(rng), albedoPhase = phase(rng);
+		Eigen::Vector3f direction = Eigen::Vector3f(normal(rng), normal(rng), normal(rng)).normalized();
+		Eigen::Vector3f tint = Eigen::Vector3f(normal(rng), normal(rng), normal(rng)).normalized();
+		for (unsigned int v = 0; v < nVertices; v++) {
+			Eigen::Vector2f xy = mesh.vertices.segment<2>(3 * v);
+			model.m_shapeBasis.block<3, 1>(3 * v, k) = direction * std::sin(shapeWave.dot(xy) + shapePhase);
+			model.m_albedoBasis.block<3, 1>(3 * v, k) = tint * (0.03f * 255.0f * std::sin(albedoWave.dot(xy) + albedoPhase));
+		}
+		model.m_shapeStd(k) = 0.002f / (1.0f + k / 20.0f);
+		model.m_albedoStd(k) = 1.0f / (1.0f + k / 20.0f);
+	}
+	model.m_expressionBasis.resize(3 * nVertices, 0);
+	model.m_expressionStd.resize(0);
+
+	model.m_averageCenter = Eigen::Map<const Eigen::Matrix3Xf>(mesh.vertices.data(), 3, nVertices).rowwise().mean();
+	model.m_averageNormals = model.computeNormals(mesh.vertices);
+	model.m_icpSampleIndices = model.computeNormalSpaceSample(numICPSamples);
+	return model;
+}
 
+FaceModel FaceModel::fromSettings() {
+	if (gSettings.syntheticModel) {
+		return createSynthetic(SYNTHETIC_GRID_SIZE, SYNTHETIC_NUM_EIGEN_VEC, gSettings.icpSamples);
+	}
+	return FaceModel(gSettings.modelDir, gSettings.icpSamples);
+}
+
+// Adds the basis times the scaled first NumCoefficients coefficients to out, with a basis block of
+// fixed width.
+template <int NumCoefficients>
+static void addBasisProduct(const Eigen::MatrixXf& basis, const Eigen::VectorXf& std, const Eigen::VectorXf& coefficients, float* out) {
+	const Eigen::Matrix<float, NumCoefficients, 1> scaled = coefficients.head<NumCoefficients>().cwiseProduct(std.head<NumCoefficients>());
+	Eigen::Map<Eigen::VectorXf>(out, basis.rows()).noalias() += basis.leftCols<NumCoefficients>() * scaled;
+}
+
+// Clamps the colors (3, numVertices) and converts them to RGBA.
+static Eigen::Matrix4Xi toVertexColors(Eigen::Matrix3Xf& colorsRGB) {
 	// Clamp between 0 and 255.
 	int numClamped = 0;
 	for (size_t i = 0; i < colorsRGB.cols(); i++) {
@@ -98,16 +186,54 @@ Eigen::Matrix4Xi FaceModel::computeColors(const FaceParameters& params) const
 		numClamped += int(wasClamped);
 	}
 	if (numClamped > 0) {
-		std::cout << "Warning: Clamped " << numClamped << "/" << colorsRGB.cols() << " vertex colors when applying beta." << std::endl;
+		LOG_DEBUG << "Clamped " << numClamped << "/" << colorsRGB.cols() << " vertex colors when applying beta.";
 	}
 
 	// convert back to RGBA int representation
-	Eigen::Matrix4Xi result(4, getNumVertices());
+	Eigen::Matrix4Xi result(4, colorsRGB.cols());
 	result.topRows<3>() = colorsRGB.cast<int>();
 	result.row(3).setConstant(255);
 	return result;
 }
 
+Eigen::VectorXf FaceModel::computeShape(const FaceParameters& params) const
+{
+	assert(params.alpha.rows() == m_shapeBasis.cols() && "face parameter alpha has incorrect size");
+	auto& scaledAlpha = (params.alpha.array() * m_shapeStd.array()).matrix();
+	return m_averageMesh.vertices + m_shapeBasis * scaledAlpha;
+}
+
+Eigen::VectorXf FaceModel::computeShape(const FaceParameters& params, const ModelRank& rank) const
+{
+	Eigen::VectorXf vertices = m_averageMesh.vertices;
+	dispatchRank(rank, [&](auto fixedRank) {
+		addBasisProduct<decltype(fixedRank)::NUM_ALPHA>(m_shapeBasis, m_shapeStd, params.alpha, vertices.data());
+	});
+	return vertices;
+}
+
+Eigen::Matrix4Xi FaceModel::computeColors(const FaceParameters& params) const
+{
+	assert(params.beta.rows() == m_albedoBasis.cols() && "face parameter beta has incorrect size");
+	// interpolate RGB values as floats
+	Eigen::Matrix3Xf colorsRGB = m_averageMesh.vertexColors.topRows<3>().cast<float>();
+	// reshape from matrix (3, numVertices) to vector (3 * numVertices)
+	Eigen::Map<Eigen::VectorXf> flatColorsRGB(colorsRGB.data(), 3 * getNumVertices());
+
+	auto& scaledBeta = (params.beta.array() * m_albedoStd.array()).matrix();
+	flatColorsRGB += m_albedoBasis * scaledBeta;
+	return toVertexColors(colorsRGB);
+}
+
+Eigen::Matrix4Xi FaceModel::computeColors(const FaceParameters& params, const ModelRank& rank) const
+{
+	Eigen::Matrix3Xf colorsRGB = m_averageMesh.vertexColors.topRows<3>().cast<float>();
+	dispatchRank(rank, [&](auto fixedRank) {
+		addBasisProduct<decltype(fixedRank)::NUM_BETA>(m_albedoBasis, m_albedoStd, params.beta, colorsRGB.data());
+	});
+	return toVertexColors(colorsRGB);
+}
+
 Eigen::Matrix3Xf FaceModel::computeNormals(const Eigen::VectorXf& vertices) const
 {
 	int numVertices = getNumVertices();
@@ -138,6 +264,53 @@ Eigen::Matrix3Xf FaceModel::computeNormals(const Eigen::VectorXf& vertices) cons
 	return normals;
 }
 
+std::vector<unsigned int> FaceModel::computeNormalSpaceSample(unsigned int numSamples) const
+{
+	// Only consider the face region around the nose tip, the back of the head is never visible.
+	const float faceRadius = 0.1f;
+	const Eigen::Vector3f center = m_averageFeaturePoints.size() > 2 ? m_averageFeaturePoints[2] : Eigen::Vector3f::Zero();
+	const int numBinsPerAxis = 8;
+
+	// Bucket the face vertices by their normal direction (azimuth and inclination).
+	std::vector<std::vector<unsigned int>> bins(numBinsPerAxis * numBinsPerAxis);
+	for (unsigned int i = 0; i < getNumVertices(); i++) {
+		if ((m_averageMesh.vertices.segment<3>(3 * i) - center).norm() > faceRadius) {
+			continue;
+		}
+		const auto& n = m_averageNormals.col(i);
+		if (!n.allFinite()) {
+			continue;
+		}
+		float azimuth = std::atan2(n.y(), n.x()) / float(2 * EIGEN_PI) + 0.5f;
+		float inclination = std::acos(std::max(-1.0f, std::min(1.0f, n.z()))) / float(EIGEN_PI);
+		int bx = std::min(numBinsPerAxis - 1, int(azimuth * numBinsPerAxis));
+		int by = std::min(numBinsPerAxis - 1, int(inclination * numBinsPerAxis));
+		bins[by * numBinsPerAxis + bx].push_back(i);
+	}
+
+	std::mt19937 rng(42);
+	for (auto& bin : bins) {
+		std::shuffle(bin.begin(), bin.end(), rng);
+	}
+
+	// Draw from all non-empty bins in turn, so rare normal directions are not drowned out by flat regions.
+	std::vector<unsigned int> result;
+	for (size_t round = 0; result.size() < numSamples; round++) {
+		bool anyLeft = false;
+		for (const auto& bin : bins) {
+			if (round < bin.size() && result.size() < numSamples) {
+				result.push_back(bin[round]);
+				anyLeft = true;
+			}
+		}
+		if (!anyLeft) {
+			break;
+		}
+	}
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
 FaceParameters FaceModel::computeShapeAttribute(const FaceParameters& params, float age, float weight, float gender) const
 {
 	FaceParameters outparams = params;
@@ -169,7 +342,7 @@ FaceParameters FaceModel::computeShapeAttribute(const FaceParameters& params, fl
 const Mesh FaceModel::loadOFF(const std::string& filename) const {
 	std::ifstream in(filename, std::ifstream::in);
 	if (!in) {
-		std::cout << "ERROR:\tCan not open file: " << filename << std::endl;
+		LOG_ERROR << "Can not open file: " << filename;
 		exit(1);
 	}
 
@@ -185,7 +358,6 @@ const Mesh FaceModel::loadOFF(const std::string& filename) const {
 	mesh.vertexColors.resize(4, nVertices);
 	mesh.triangles.resize(3, nTriangles);
 
-	std::cout << "  vertices ..." << std::endl;
 	float x, y, z;
 	int r, g, b, a;
 	for (int i = 0; i < nVertices; i++) {
@@ -198,7 +370,6 @@ const Mesh FaceModel::loadOFF(const std::string& filename) const {
 		mesh.vertexColors.col(i) << r, g, b, a;
 	}
 
-	std::cout << "  triangles ..." << std::endl;
 	int count, v1, v2, v3;
 	for (int i = 0; i < nTriangles; i++) {
 		std::getline(in, line);
@@ -206,7 +377,7 @@ const Mesh FaceModel::loadOFF(const std::string& filename) const {
 		lineStream >> count >> v1 >> v2 >> v3;
 
 		if (count != 3) {
-			std::cerr << "WARNING: Can only process triangles, found face with " << count << " vertices while reading " << filename << std::endl;
+			LOG_WARNING << "Can only process triangles, found face with " << count << " vertices while reading " << filename;
 			v1 = v2 = v3 = 0;
 		}
 
@@ -221,7 +392,7 @@ const Mesh FaceModel::loadOFF(const std::string& filename) const {
 std::vector<float> FaceModel::loadBinaryVector(const std::string &filename) const {
 	std::ifstream in(filename, std::ifstream::in | std::ifstream::binary);
 	if (!in) {
-		std::cout << "ERROR:\tCan not open file: " << filename << std::endl;
+		LOG_ERROR << "Can not open file: " << filename;
 		exit(1);
 	}
 	unsigned int numberOfEntries;
@@ -1,5 +1,6 @@
 #pragma once
 #include "Mesh.h"
+#include "ModelRank.h"
 
 struct FaceParameters {
 	// Shape parameters expressed as multiples of the standard deviation.
@@ -9,10 +10,27 @@ struct FaceParameters {
 	// ... later: lighting, expression ...
 };
 
+// Default number of vertices sampled for coarse alignment.
+const unsigned int NUM_ICP_SAMPLES = 2000;
+
+// Size of the procedural model used in place of the morphable model (--synthetic-model).
+const unsigned int SYNTHETIC_GRID_SIZE = 150;
+const unsigned int SYNTHETIC_NUM_EIGEN_VEC = 199;
+
 class FaceModel
 {
 public:
-	FaceModel(const std::string& baseDir);
+	FaceModel(const std::string& baseDir, unsigned int numICPSamples = NUM_ICP_SAMPLES);
+
+	// Procedural stand-in for the MorphableModel data: a face-like height field on a grid of
+	// gridSize x gridSize vertices (same frame and units as the real model, nose towards +z) with
+	// smooth random shape and albedo bases. Deterministic for a given seed.
+	static FaceModel createSynthetic(unsigned int gridSize, unsigned int numEigenVec,
+		unsigned int numICPSamples = NUM_ICP_SAMPLES, unsigned int seed = 42);
+
+	// Loads the model of the model directory in the settings, or creates the default synthetic
+	// model if the settings ask for it.
+	static FaceModel fromSettings();
 
 	// 3D positions of 5 feature points used for coarse alignment.
 	std::vector<Eigen::Vector3f> m_averageFeaturePoints;
@@ -28,6 +46,13 @@ public:
 	// Orthogonal basis for the expression parameters delta. Shape (3 * numVertices, numExprVec)
 	Eigen::MatrixXf m_expressionBasis;
 
+	// Centroid of the vertices of the average face, the center of the pose correction of the optimizer.
+	Eigen::Vector3f m_averageCenter;
+	// Vertex normals of the average face. Shape (3, numVertices)
+	Eigen::Matrix3Xf m_averageNormals;
+	// Indices of the face region vertices used for coarse alignment, computed once at load time.
+	std::vector<unsigned int> m_icpSampleIndices;
+
 	// Standard deviation of the shape parameters alpha. Shape (numEigenVec)
 	Eigen::VectorXf m_shapeStd;
 	// Standard deviation of the albedo parameters beta. Shape (numEigenVec)
@@ -40,10 +65,18 @@ public:
 	Eigen::VectorXf computeShape(const FaceParameters& params) const;
 	// Computes the vertex colors based on a set of parameters.
 	Eigen::Matrix4Xi computeColors(const FaceParameters& params) const;
+	// The same from the parameters of the rank only, the others are taken as zero. The basis products
+	// are compiled for the rank.
+	Eigen::VectorXf computeShape(const FaceParameters& params, const ModelRank& rank) const;
+	Eigen::Matrix4Xi computeColors(const FaceParameters& params, const ModelRank& rank) const;
 
     // Computes the vertex positions based on a set of parameters.
     Eigen::Matrix3Xf computeNormals(const Eigen::VectorXf& vertices) const;
 
+	// Samples vertices of the face region such that their normals are spread as uniformly
+	// as possible over all directions (normal-space sampling). Deterministic.
+	std::vector<unsigned int> computeNormalSpaceSample(unsigned int numSamples) const;
+
 	FaceParameters computeShapeAttribute(const FaceParameters& params, float age, float weight, float gender) const;
 
 	inline FaceParameters createDefaultParameters() const {
@@ -60,6 +93,8 @@ public:
 	unsigned int getNumExprVec() const { return m_expressionBasis.cols(); }
 
 private:
+	FaceModel() {}
+
 	const Mesh loadOFF(const std::string & filename) const;
 	std::vector<float> loadBinaryVector(const std::string &filename) const;
 };
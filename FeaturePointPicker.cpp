@@ -0,0 +1,28 @@
+#include "stdafx.h"
+#include <pcl/visualization/pcl_visualizer.h>
+#include "FeaturePointPicker.h"
+
+static void pointPickingHandler(const pcl::visualization::PointPickingEvent &event, void *) {
+    int pInd = event.getPointIndex();
+    if (pInd == -1)
+        return;
+
+    float x, y, z;
+    event.getPoint(x, y, z);
+    std::cout << x << " " << y << " " << z << std::endl;
+}
+
+void pickFeaturePoints(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud) {
+    pcl::visualization::PCLVisualizer viewer("PCL Viewer");
+
+    // Draw output point cloud:
+    pcl::visualization::PointCloudColorHandlerRGBField<pcl::PointXYZRGB> rgb(cloud);
+    viewer.addPointCloud<pcl::PointXYZRGB>(cloud, rgb, "cloud");
+
+    viewer.setCameraPosition(-0.24917, -0.0187087, -1.29032, 0.0228136, -0.996651, 0.0785278);
+    viewer.registerPointPickingCallback(pointPickingHandler);
+
+    while (!viewer.wasStopped()) {
+        viewer.spinOnce(500);
+    }
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <pcl/common/common.h>
+
+/*
+ * Cloud rendering adapted from:
+ * http://robotics.dei.unipd.it/reid/index.php/8-dataset/9-overview-face
+ */
+// Opens a viewer in which feature points can be picked with shift+click, their coordinates are printed.
+void pickFeaturePoints(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud);
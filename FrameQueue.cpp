@@ -0,0 +1,124 @@
+#include "stdafx.h"
+#include "FrameQueue.h"
+
+std::vector<WirePoint> cloudToWirePoints(const pcl::PointCloud<pcl::PointXYZRGB>& cloud) {
+	std::vector<WirePoint> points(cloud.points.size());
+	for (size_t i = 0; i < points.size(); i++) {
+		const auto& p = cloud.points[i];
+		points[i] = WirePoint{ p.x, p.y, p.z, p.r, p.g, p.b, 0 };
+	}
+	return points;
+}
+
+pcl::PointCloud<pcl::PointXYZRGB>::Ptr wirePointsToCloud(const WirePoint* points, uint32_t width, uint32_t height) {
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGB>(width, height));
+	for (size_t i = 0; i < cloud->points.size(); i++) {
+		auto& p = cloud->points[i];
+		p.x = points[i].x;
+		p.y = points[i].y;
+		p.z = points[i].z;
+		p.r = points[i].r;
+		p.g = points[i].g;
+		p.b = points[i].b;
+	}
+	cloud->is_dense = false;
+	return cloud;
+}
+
+bool parseDropPolicy(const std::string& name, DropPolicy& outPolicy) {
+	if (name == "drop-oldest") {
+		outPolicy = DropPolicy::DropOldest;
+	}
+	else if (name == "drop-newest") {
+		outPolicy = DropPolicy::DropNewest;
+	}
+	else if (name == "block") {
+		outPolicy = DropPolicy::Block;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+bool FrameQueue::push(Frame frame) {
+	std::unique_lock<std::mutex> lock(mutex);
+	if (closed) {
+		return false;
+	}
+
+	if (frames.size() >= capacity) {
+		switch (policy) {
+		case DropPolicy::DropOldest:
+			frames.pop_front();
+			metrics.droppedOldest++;
+			break;
+		case DropPolicy::DropNewest:
+			metrics.droppedNewest++;
+			return false;
+		case DropPolicy::Block:
+			notFull.wait(lock, [this] { return closed || frames.size() < capacity; });
+			if (closed) {
+				return false;
+			}
+			break;
+		}
+	}
+
+	frames.emplace_back(std::move(frame), std::chrono::steady_clock::now());
+	metrics.pushed++;
+	metrics.maxDepth = std::max(metrics.maxDepth, frames.size());
+	lock.unlock();
+	notEmpty.notify_one();
+	return true;
+}
+
+bool FrameQueue::pop(Frame& outFrame) {
+	std::unique_lock<std::mutex> lock(mutex);
+	notEmpty.wait(lock, [this] { return closed || !frames.empty(); });
+	if (frames.empty()) {
+		return false;
+	}
+
+	outFrame = std::move(frames.front().first);
+	auto enqueueTime = frames.front().second;
+	frames.pop_front();
+	metrics.popped++;
+	lock.unlock();
+	notFull.notify_one();
+
+	queueLatency.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - enqueueTime).count());
+	return true;
+}
+
+void FrameQueue::close() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+	}
+	notEmpty.notify_all();
+	notFull.notify_all();
+}
+
+FrameQueue::Metrics FrameQueue::getMetrics() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	Metrics result = metrics;
+	result.depth = frames.size();
+	return result;
+}
+
+void writeIngestMetricsJson(std::ostream& out, const FrameQueue& queue, const LatencyStats& endToEndLatency) {
+	FrameQueue::Metrics m = queue.getMetrics();
+	out << "{" << std::endl
+		<< "  \"frames_pushed\": " << m.pushed << "," << std::endl
+		<< "  \"frames_popped\": " << m.popped << "," << std::endl
+		<< "  \"dropped_oldest\": " << m.droppedOldest << "," << std::endl
+		<< "  \"dropped_newest\": " << m.droppedNewest << "," << std::endl
+		<< "  \"queue_depth\": " << m.depth << "," << std::endl
+		<< "  \"queue_max_depth\": " << m.maxDepth << "," << std::endl
+		<< "  \"queue_latency\": ";
+	queue.queueLatency.writeJson(out);
+	out << "," << std::endl << "  \"end_to_end_latency\": ";
+	endToEndLatency.writeJson(out);
+	out << std::endl << "}" << std::endl;
+}
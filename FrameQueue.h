@@ -0,0 +1,92 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <pcl/common/common.h>
+#include "Metrics.h"
+
+// A single RGB-D frame delivered by a live source.
+struct Frame {
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud;
+	Eigen::Matrix3f cameraIntrinsics;
+	uint64_t sequence = 0;
+	// Time at which the frame was captured by the sender (wall clock, so it is comparable across processes).
+	std::chrono::system_clock::time_point captureTime;
+};
+
+// Packed point layout used to transfer frames between processes.
+#pragma pack(push, 1)
+struct WirePoint {
+	float x, y, z;
+	uint8_t r, g, b, pad;
+};
+#pragma pack(pop)
+
+// Converts between organized clouds and row-major wire points. Invalid points have NaN coordinates.
+std::vector<WirePoint> cloudToWirePoints(const pcl::PointCloud<pcl::PointXYZRGB>& cloud);
+pcl::PointCloud<pcl::PointXYZRGB>::Ptr wirePointsToCloud(const WirePoint* points, uint32_t width, uint32_t height);
+
+// What happens when a frame arrives while the queue is full.
+enum class DropPolicy {
+	// Discard the oldest queued frame to make room (lowest latency).
+	DropOldest,
+	// Discard the incoming frame (keeps the queued frames).
+	DropNewest,
+	// Block the producer until there is room (never drops).
+	Block
+};
+
+// Parses "drop-oldest", "drop-newest" or "block". Returns false for unknown names.
+bool parseDropPolicy(const std::string& name, DropPolicy& outPolicy);
+
+// Bounded multi-producer multi-consumer queue of frames with a configurable drop policy.
+class FrameQueue {
+public:
+	struct Metrics {
+		uint64_t pushed = 0;
+		uint64_t popped = 0;
+		uint64_t droppedOldest = 0;
+		uint64_t droppedNewest = 0;
+		size_t depth = 0;
+		size_t maxDepth = 0;
+	};
+
+	FrameQueue(size_t capacity, DropPolicy policy) : capacity(std::max<size_t>(capacity, 1)), policy(policy) {}
+
+	// Returns false if the frame was dropped or the queue is closed.
+	bool push(Frame frame);
+	// Blocks until a frame is available. Returns false once the queue is closed and empty.
+	bool pop(Frame& outFrame);
+	// Wakes up all waiting producers and consumers, no frames are accepted afterwards.
+	void close();
+
+	Metrics getMetrics() const;
+
+	// Time frames spent waiting in the queue.
+	LatencyStats queueLatency;
+
+private:
+	const size_t capacity;
+	const DropPolicy policy;
+
+	mutable std::mutex mutex;
+	std::condition_variable notEmpty;
+	std::condition_variable notFull;
+	std::deque<std::pair<Frame, std::chrono::steady_clock::time_point>> frames;
+	bool closed = false;
+	Metrics metrics;
+};
+
+// Writes the queue metrics together with the end-to-end latency as a JSON object.
+void writeIngestMetricsJson(std::ostream& out, const FrameQueue& queue, const LatencyStats& endToEndLatency);
+
+// Interface for push-style frame sources. A source delivers frames into a queue from its own
+// thread until it is stopped or runs out of frames, in which case it closes the queue.
+class FrameSource {
+public:
+	virtual ~FrameSource() {}
+
+	virtual bool start(FrameQueue& queue) = 0;
+	virtual void stop() = 0;
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include "Sensor.h"
+#include "FrameQueue.h"
+#include "LandmarkDetector.h"
+#include "VirtualSensor.h"
+
+// Sensor wrapping a frame received from a live frame source.
+// Live frames never come with hand-made .points files, so the feature points are always detected.
+class FrameSensor : public Sensor {
+public:
+	FrameSensor() : Sensor() {}
+
+	explicit FrameSensor(const Frame& frame) : Sensor() {
+		m_cloud = frame.cloud;
+		m_cameraIntrinsics = frame.cameraIntrinsics;
+		m_captureTime = frame.captureTime;
+	};
+
+	// Loads a recorded point cloud as frame, with the feature points of the .points file next to it
+	// if there is one. Returns false if the file can't be read.
+	bool loadFile(const std::string& file) {
+		PROFILE_SCOPE("sensor load");
+		if (!std::ifstream(file).good() || pcl::io::loadPCDFile<pcl::PointXYZRGB>(file, *m_cloud) == -1) {
+			return false;
+		}
+		m_cameraIntrinsics = VirtualSensor::intrinsicsForWidth(m_cloud->width);
+		m_captureTime = std::chrono::system_clock::now();
+
+		std::string featuresFile = file.substr(0, file.length() - 3) + "points";
+		if (std::ifstream(featuresFile).good()) {
+			m_featurePoints = FeaturePointExtractor(featuresFile, m_cloud).m_points;
+		}
+		return true;
+	}
+
+	// Returns false if no face was found in the frame.
+	bool detectFeaturePoints() {
+		PROFILE_SCOPE("landmark detection");
+		LandmarkDetector detector(m_cameraIntrinsics);
+		return detector.detect(*compute_normals(), m_featurePoints);
+	}
+};
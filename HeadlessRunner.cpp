@@ -0,0 +1,203 @@
+#include "stdafx.h"
+#include <iomanip>
+#ifndef _WIN32
+#include <glob.h>
+#endif
+#include "HeadlessRunner.h"
+#include "Settings.h"
+#include "FaceModel.h"
+#include "FrameSensor.h"
+#include "BatchScheduler.h"
+#include "Export.h"
+#include "Tracker.h"
+#include "utils.h"
+#include "Log.h"
+#ifdef HAVE_UNIX_SOCKETS
+#include "SocketFrameSource.h"
+#endif
+
+std::vector<std::string> expandInputs(const std::vector<std::string>& inputs) {
+	std::vector<std::string> result;
+	for (const std::string& input : inputs) {
+		if (!input.empty() && input[0] == '@') {
+			std::ifstream list(input.substr(1));
+			if (!list) {
+				LOG_ERROR << "Can not open input list " << input.substr(1);
+				continue;
+			}
+			std::vector<std::string> listed;
+			std::string line;
+			while (std::getline(list, line)) {
+				if (!line.empty() && line[0] != '#')
+					listed.push_back(line);
+			}
+			std::vector<std::string> expanded = expandInputs(listed);
+			result.insert(result.end(), expanded.begin(), expanded.end());
+		}
+#ifndef _WIN32
+		else if (input.find_first_of("*?[") != std::string::npos) {
+			glob_t matches;
+			if (glob(input.c_str(), 0, nullptr, &matches) == 0) {
+				for (size_t i = 0; i < matches.gl_pathc; i++) {
+					result.push_back(matches.gl_pathv[i]);
+				}
+			}
+			else {
+				LOG_ERROR << "No inputs match " << input;
+			}
+			globfree(&matches);
+		}
+#endif
+		else {
+			result.push_back(input);
+		}
+	}
+	return result;
+}
+
+// Fits the files in order as one frame sequence, each frame starting from the previous result.
+static int runTrackingSequence(const FaceModel& model, const std::vector<std::string>& files, const std::vector<ExportFormat>& exportFormats) {
+	FaceTracker tracker(model);
+	LatencyStats frameLatency;
+	int numFailed = 0;
+
+	std::cout << std::left << std::setw(40) << "frame" << std::right << std::setw(8) << "init"
+		<< std::setw(12) << "icp rmse" << std::setw(12) << "icp" << std::setw(12) << "optimize" << std::setw(12) << "total [ms]" << std::endl;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (const std::string& file : files) {
+		FrameSensor inputSensor;
+		if (!inputSensor.loadFile(file)) {
+			LOG_ERROR << "Couldn't read the pcd file " << file;
+			numFailed++;
+			continue;
+		}
+
+		TrackingResult result = tracker.track(inputSensor);
+		if (!result.faceFound) {
+			LOG_ERROR << "No face found in " << file << ", can't initialize tracking.";
+			numFailed++;
+			continue;
+		}
+		if (!exportFace(model, result.params, result.pose, gSettings.outputDir + "/" + fileStem(file), exportFormats)) {
+			LOG_ERROR << "Couldn't save the result of " << file;
+			numFailed++;
+		}
+		frameLatency.add(result.timings.totalMs);
+
+		std::cout << std::left << std::setw(40) << fileStem(file) << std::right << std::setw(8) << (result.reinitialized ? "yes" : "")
+			<< std::fixed << std::setprecision(1)
+			<< std::setw(12) << result.icpStats.rmse * 1000.0f << std::setw(12) << result.timings.icpMs
+			<< std::setw(12) << result.timings.optimizationMs << std::setw(12) << result.timings.totalMs << std::endl;
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	std::cout << frameLatency.count() << " frames tracked in " << seconds << " s (" << frameLatency.count() / seconds << " fps), "
+		<< tracker.getNumReinitializations() << " fitted from scratch, results in " << gSettings.outputDir << std::endl;
+	std::cout << "Per-frame latency: ";
+	frameLatency.writeJson(std::cout);
+	std::cout << std::endl;
+	return numFailed == 0 ? 0 : 1;
+}
+
+int runHeadlessBatch(const std::vector<std::string>& inputs) {
+	std::vector<std::string> files = expandInputs(inputs);
+	if (files.empty()) {
+		LOG_ERROR << "No input files given.";
+		return -2;
+	}
+	std::vector<ExportFormat> exportFormats;
+	if (!parseExportFormats(gSettings.exportFormats, exportFormats)) {
+		LOG_ERROR << "Unknown export format in " << gSettings.exportFormats;
+		return -2;
+	}
+	if (!makeDirectory(gSettings.outputDir)) {
+		LOG_ERROR << "Can not create output directory " << gSettings.outputDir;
+		return -1;
+	}
+
+	LOG_INFO << "Loading face model ...";
+	FaceModel model = FaceModel::fromSettings();
+
+	if (gSettings.track) {
+		return runTrackingSequence(model, files, exportFormats);
+	}
+
+	BatchScheduler scheduler(model, gSettings.jobs);
+	LOG_INFO << "Fitting " << files.size() << " inputs with " << gSettings.jobs << " jobs of " << getThreadsPerJob() << " threads ...";
+	std::vector<BatchItem> rows = scheduler.run(files, [&](const std::string& file, const ReconstructionResult& result) {
+		return exportFace(model, result.params, result.pose, gSettings.outputDir + "/" + fileStem(file), exportFormats);
+	});
+
+	int numFailed = 0;
+	std::cout << std::endl << std::left << std::setw(40) << "file" << std::right << std::setw(14) << "status"
+		<< std::setw(12) << "procrustes" << std::setw(12) << "icp" << std::setw(12) << "optimize" << std::setw(12) << "total [ms]" << std::endl;
+	for (const BatchItem& row : rows) {
+		std::cout << std::left << std::setw(40) << fileStem(row.file) << std::right << std::setw(14) << row.status
+			<< std::fixed << std::setprecision(1)
+			<< std::setw(12) << row.timings.procrustesMs << std::setw(12) << row.timings.icpMs
+			<< std::setw(12) << row.timings.optimizationMs << std::setw(12) << row.timings.totalMs << std::endl;
+		numFailed += row.status != "ok";
+	}
+	std::cout << rows.size() - numFailed << "/" << rows.size() << " reconstructed in " << scheduler.getLastRunSeconds() << " s ("
+		<< scheduler.getFacesPerMinute() << " faces/min), results in " << gSettings.outputDir << std::endl;
+	return numFailed == 0 ? 0 : 1;
+}
+
+int runLiveIngest() {
+#ifdef HAVE_UNIX_SOCKETS
+	DropPolicy policy;
+	if (!parseDropPolicy(gSettings.dropPolicy, policy)) {
+		LOG_ERROR << "Unknown drop policy " << gSettings.dropPolicy;
+		return -2;
+	}
+
+	LOG_INFO << "Loading face model ...";
+	FaceModel model = FaceModel::fromSettings();
+
+	FrameQueue queue(gSettings.queueCapacity, policy);
+	SocketFrameSource source(gSettings.liveSocket);
+	if (!source.start(queue)) {
+		return -1;
+	}
+	LOG_INFO << "Waiting for frames on " << gSettings.liveSocket << " ...";
+
+	LatencyStats endToEndLatency;
+	FaceTracker tracker(model);
+	Frame frame;
+	while (queue.pop(frame)) {
+		FrameSensor inputSensor(frame);
+		if (gSettings.track) {
+			// The tracker only needs feature points when it (re)initializes.
+			if (!tracker.track(inputSensor).faceFound) {
+				LOG_ERROR << "No face found in frame " << frame.sequence << ", can't initialize tracking.";
+				continue;
+			}
+		}
+		else {
+			if (!inputSensor.detectFeaturePoints()) {
+				LOG_ERROR << "No face found in frame " << frame.sequence << ", skipping.";
+				continue;
+			}
+			reconstructFace(model, inputSensor);
+		}
+
+		double latency = std::chrono::duration<double, std::milli>(std::chrono::system_clock::now() - frame.captureTime).count();
+		endToEndLatency.add(latency);
+		LOG_INFO << "Frame " << frame.sequence << " done, end-to-end latency " << latency << " ms, queue depth "
+			<< queue.getMetrics().depth;
+	}
+	source.stop();
+
+	if (gSettings.metricsFile.empty()) {
+		writeIngestMetricsJson(std::cout, queue, endToEndLatency);
+	}
+	else {
+		std::ofstream metricsOut(gSettings.metricsFile);
+		writeIngestMetricsJson(metricsOut, queue, endToEndLatency);
+	}
+	return 0;
+#else
+	LOG_ERROR << "Live ingestion requires UNIX domain sockets, which are not available on this platform.";
+	return -2;
+#endif
+}
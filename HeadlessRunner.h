@@ -0,0 +1,15 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Entry points of the pipeline that don't need a viewer.
+
+// Expands files, glob patterns and @list files (one path per line) into a list of input files.
+std::vector<std::string> expandInputs(const std::vector<std::string>& inputs);
+
+// Fits every input file, writes the results to the output directory and prints a summary table.
+// Returns 0 if all inputs were reconstructed.
+int runHeadlessBatch(const std::vector<std::string>& inputs);
+
+// Fits every frame received from the live frame source until the source closes.
+int runLiveIngest();
@@ -0,0 +1,364 @@
+#include "stdafx.h"
+#include "Json.h"
+#include <sstream>
+
+const JsonValue* JsonValue::find(const std::string& key) const {
+	if (type != Type::Object) {
+		return nullptr;
+	}
+	auto it = object.find(key);
+	return it == object.end() ? nullptr : &it->second;
+}
+
+std::string JsonValue::getString(const std::string& key, const std::string& defaultValue) const {
+	const JsonValue* value = find(key);
+	return value && value->type == Type::String ? value->string : defaultValue;
+}
+
+double JsonValue::getNumber(const std::string& key, double defaultValue) const {
+	const JsonValue* value = find(key);
+	return value && value->type == Type::Number ? value->number : defaultValue;
+}
+
+bool JsonValue::getBool(const std::string& key, bool defaultValue) const {
+	const JsonValue* value = find(key);
+	return value && value->type == Type::Bool ? value->boolean : defaultValue;
+}
+
+// Recursive descent parser over the whole document.
+class JsonParser {
+public:
+	explicit JsonParser(const std::string& text) : text(text) {}
+
+	bool parse(JsonValue& out, std::string& outError) {
+		bool ok = parseValue(out, 0) && (skipWhitespace(), pos == text.size() || fail("trailing characters"));
+		if (!ok) {
+			outError = error + " at offset " + std::to_string(pos);
+		}
+		return ok;
+	}
+
+private:
+	// Nesting limit, so malicious input can't overflow the stack.
+	static const int MAX_DEPTH = 64;
+
+	const std::string& text;
+	size_t pos = 0;
+	std::string error;
+
+	bool fail(const std::string& message) {
+		error = message;
+		return false;
+	}
+
+	void skipWhitespace() {
+		while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+			pos++;
+		}
+	}
+
+	bool consume(const char* literal) {
+		size_t length = strlen(literal);
+		if (text.compare(pos, length, literal) != 0) {
+			return false;
+		}
+		pos += length;
+		return true;
+	}
+
+	bool parseValue(JsonValue& out, int depth) {
+		if (depth > MAX_DEPTH) {
+			return fail("nesting too deep");
+		}
+		skipWhitespace();
+		if (pos >= text.size()) {
+			return fail("unexpected end");
+		}
+		char c = text[pos];
+		if (c == '{') {
+			return parseObject(out, depth);
+		}
+		if (c == '[') {
+			return parseArray(out, depth);
+		}
+		if (c == '"') {
+			out.type = JsonValue::Type::String;
+			return parseString(out.string);
+		}
+		if (consume("true")) {
+			out.type = JsonValue::Type::Bool;
+			out.boolean = true;
+			return true;
+		}
+		if (consume("false")) {
+			out.type = JsonValue::Type::Bool;
+			out.boolean = false;
+			return true;
+		}
+		if (consume("null")) {
+			out.type = JsonValue::Type::Null;
+			return true;
+		}
+		return parseNumber(out);
+	}
+
+	bool parseNumber(JsonValue& out) {
+		const char* start = text.c_str() + pos;
+		char* end = nullptr;
+		double value = strtod(start, &end);
+		if (end == start) {
+			return fail("unexpected character");
+		}
+		pos += end - start;
+		out.type = JsonValue::Type::Number;
+		out.number = value;
+		return true;
+	}
+
+	bool parseHex4(unsigned int& out) {
+		if (pos + 4 > text.size()) {
+			return fail("truncated escape");
+		}
+		out = 0;
+		for (int i = 0; i < 4; i++) {
+			char c = text[pos++];
+			out <<= 4;
+			if (c >= '0' && c <= '9') out |= c - '0';
+			else if (c >= 'a' && c <= 'f') out |= c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F') out |= c - 'A' + 10;
+			else return fail("invalid escape");
+		}
+		return true;
+	}
+
+	static void appendUtf8(std::string& out, unsigned int codePoint) {
+		if (codePoint < 0x80) {
+			out += char(codePoint);
+		}
+		else if (codePoint < 0x800) {
+			out += char(0xc0 | (codePoint >> 6));
+			out += char(0x80 | (codePoint & 0x3f));
+		}
+		else if (codePoint < 0x10000) {
+			out += char(0xe0 | (codePoint >> 12));
+			out += char(0x80 | ((codePoint >> 6) & 0x3f));
+			out += char(0x80 | (codePoint & 0x3f));
+		}
+		else {
+			out += char(0xf0 | (codePoint >> 18));
+			out += char(0x80 | ((codePoint >> 12) & 0x3f));
+			out += char(0x80 | ((codePoint >> 6) & 0x3f));
+			out += char(0x80 | (codePoint & 0x3f));
+		}
+	}
+
+	bool parseString(std::string& out) {
+		pos++; // opening quote
+		out.clear();
+		while (pos < text.size()) {
+			char c = text[pos++];
+			if (c == '"') {
+				return true;
+			}
+			if (c != '\\') {
+				out += c;
+				continue;
+			}
+			if (pos >= text.size()) {
+				break;
+			}
+			char escape = text[pos++];
+			switch (escape) {
+			case '"': out += '"'; break;
+			case '\\': out += '\\'; break;
+			case '/': out += '/'; break;
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'n': out += '\n'; break;
+			case 'r': out += '\r'; break;
+			case 't': out += '\t'; break;
+			case 'u': {
+				unsigned int codePoint;
+				if (!parseHex4(codePoint)) {
+					return false;
+				}
+				// Surrogate pair.
+				if (codePoint >= 0xd800 && codePoint < 0xdc00 && consume("\\u")) {
+					unsigned int low;
+					if (!parseHex4(low)) {
+						return false;
+					}
+					codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (low - 0xdc00);
+				}
+				appendUtf8(out, codePoint);
+				break;
+			}
+			default:
+				return fail("invalid escape");
+			}
+		}
+		return fail("unterminated string");
+	}
+
+	bool parseArray(JsonValue& out, int depth) {
+		pos++; // [
+		out.type = JsonValue::Type::Array;
+		skipWhitespace();
+		if (consume("]")) {
+			return true;
+		}
+		while (true) {
+			out.array.emplace_back();
+			if (!parseValue(out.array.back(), depth + 1)) {
+				return false;
+			}
+			skipWhitespace();
+			if (consume("]")) {
+				return true;
+			}
+			if (!consume(",")) {
+				return fail("expected ',' or ']'");
+			}
+		}
+	}
+
+	bool parseObject(JsonValue& out, int depth) {
+		pos++; // {
+		out.type = JsonValue::Type::Object;
+		skipWhitespace();
+		if (consume("}")) {
+			return true;
+		}
+		while (true) {
+			skipWhitespace();
+			if (pos >= text.size() || text[pos] != '"') {
+				return fail("expected key");
+			}
+			std::string key;
+			if (!parseString(key)) {
+				return false;
+			}
+			skipWhitespace();
+			if (!consume(":")) {
+				return fail("expected ':'");
+			}
+			if (!parseValue(out.object[key], depth + 1)) {
+				return false;
+			}
+			skipWhitespace();
+			if (consume("}")) {
+				return true;
+			}
+			if (!consume(",")) {
+				return fail("expected ',' or '}'");
+			}
+		}
+	}
+};
+
+bool parseJson(const std::string& text, JsonValue& outValue, std::string& outError) {
+	outValue = JsonValue();
+	return JsonParser(text).parse(outValue, outError);
+}
+
+std::string jsonString(const std::string& text) {
+	std::string out = "\"";
+	for (char c : text) {
+		switch (c) {
+		case '"': out += "\\\""; break;
+		case '\\': out += "\\\\"; break;
+		case '\n': out += "\\n"; break;
+		case '\r': out += "\\r"; break;
+		case '\t': out += "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20) {
+				char escaped[8];
+				snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+				out += escaped;
+			}
+			else {
+				out += c;
+			}
+		}
+	}
+	return out + "\"";
+}
+
+std::string toJson(const JsonValue& value) {
+	switch (value.type) {
+	case JsonValue::Type::Null:
+		return "null";
+	case JsonValue::Type::Bool:
+		return value.boolean ? "true" : "false";
+	case JsonValue::Type::Number: {
+		std::ostringstream out;
+		out.precision(17);
+		out << value.number;
+		return out.str();
+	}
+	case JsonValue::Type::String:
+		return jsonString(value.string);
+	case JsonValue::Type::Array: {
+		std::string out = "[";
+		for (size_t i = 0; i < value.array.size(); i++) {
+			out += (i > 0 ? "," : "") + toJson(value.array[i]);
+		}
+		return out + "]";
+	}
+	case JsonValue::Type::Object: {
+		std::string out = "{";
+		for (const auto& member : value.object) {
+			out += (out.size() > 1 ? "," : "") + jsonString(member.first) + ":" + toJson(member.second);
+		}
+		return out + "}";
+	}
+	}
+	return "null";
+}
+
+static const char BASE64_CHARS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+std::string encodeBase64(const void* data, size_t size) {
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	std::string out;
+	out.reserve((size + 2) / 3 * 4);
+	for (size_t i = 0; i < size; i += 3) {
+		uint32_t chunk = uint32_t(bytes[i]) << 16;
+		if (i + 1 < size) chunk |= uint32_t(bytes[i + 1]) << 8;
+		if (i + 2 < size) chunk |= bytes[i + 2];
+		out += BASE64_CHARS[(chunk >> 18) & 0x3f];
+		out += BASE64_CHARS[(chunk >> 12) & 0x3f];
+		out += i + 1 < size ? BASE64_CHARS[(chunk >> 6) & 0x3f] : '=';
+		out += i + 2 < size ? BASE64_CHARS[chunk & 0x3f] : '=';
+	}
+	return out;
+}
+
+bool decodeBase64(const std::string& text, std::vector<uint8_t>& outData) {
+	int8_t lookup[256];
+	std::fill(lookup, lookup + 256, int8_t(-1));
+	for (int i = 0; i < 64; i++) {
+		lookup[uint8_t(BASE64_CHARS[i])] = int8_t(i);
+	}
+
+	outData.clear();
+	outData.reserve(text.size() / 4 * 3);
+	uint32_t chunk = 0;
+	int numBits = 0;
+	for (char c : text) {
+		if (c == '=') {
+			break;
+		}
+		int8_t value = lookup[uint8_t(c)];
+		if (value < 0) {
+			return false;
+		}
+		chunk = (chunk << 6) | uint32_t(value);
+		numBits += 6;
+		if (numBits >= 8) {
+			numBits -= 8;
+			outData.push_back(uint8_t((chunk >> numBits) & 0xff));
+		}
+	}
+	return true;
+}
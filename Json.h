@@ -0,0 +1,39 @@
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+
+// Minimal JSON document model, enough for the line-based daemon protocol.
+struct JsonValue {
+	enum class Type { Null, Bool, Number, String, Array, Object };
+
+	Type type = Type::Null;
+	bool boolean = false;
+	double number = 0;
+	std::string string;
+	std::vector<JsonValue> array;
+	std::map<std::string, JsonValue> object;
+
+	bool isObject() const { return type == Type::Object; }
+
+	// Member of an object, or null if missing (or this isn't an object).
+	const JsonValue* find(const std::string& key) const;
+
+	// Typed members of an object, with a default if missing or of another type.
+	std::string getString(const std::string& key, const std::string& defaultValue = "") const;
+	double getNumber(const std::string& key, double defaultValue = 0) const;
+	bool getBool(const std::string& key, bool defaultValue = false) const;
+};
+
+// Parses a complete JSON document. Returns false and a message in outError for malformed input.
+bool parseJson(const std::string& text, JsonValue& outValue, std::string& outError);
+
+// Writes a value back as compact JSON.
+std::string toJson(const JsonValue& value);
+
+// Quoted and escaped JSON string literal.
+std::string jsonString(const std::string& text);
+
+// Standard base64 (RFC 4648) for binary payloads inside JSON strings.
+std::string encodeBase64(const void* data, size_t size);
+bool decodeBase64(const std::string& text, std::vector<uint8_t>& outData);
@@ -0,0 +1,229 @@
+#include "stdafx.h"
+#include "LandmarkDetector.h"
+#include "Log.h"
+
+using namespace Eigen;
+
+// Offsets of the feature points relative to the nose tip in camera space (x right, y down, z away
+// from the camera), taken from data/MorphableModel/averageMesh_features.points and made symmetric.
+const Vector3f offsetEye(0.0316f, -0.0331f, 0.0363f);
+const Vector3f offsetMouth(0.0178f, 0.0190f, 0.0228f);
+const Vector3f offsetChin(0.0f, 0.0586f, 0.0217f);
+
+// Faces further away than this behind the closest valid point are ignored.
+const float MAX_FACE_DEPTH_RANGE = 0.3f;
+// Radius around the nose tip used to measure how much it protrudes.
+const float NOSE_RADIUS = 0.03f;
+
+static bool isValid(const pcl::PointXYZRGBNormal& p) {
+	return std::isfinite(p.z) && p.z > 0;
+}
+
+LandmarkDetector::DepthIntegral::DepthIntegral(const pcl::PointCloud<pcl::PointXYZRGBNormal>& cloud)
+	: width(cloud.width), height(cloud.height), sum((width + 1) * (height + 1), 0.0), count((width + 1) * (height + 1), 0) {
+	for (int y = 0; y < height; y++) {
+		double rowSum = 0;
+		int rowCount = 0;
+		for (int x = 0; x < width; x++) {
+			const auto& p = cloud(x, y);
+			if (isValid(p)) {
+				rowSum += p.z;
+				rowCount++;
+			}
+			int i = (y + 1) * (width + 1) + (x + 1);
+			sum[i] = sum[i - (width + 1)] + rowSum;
+			count[i] = count[i - (width + 1)] + rowCount;
+		}
+	}
+}
+
+float LandmarkDetector::DepthIntegral::mean(int x0, int y0, int x1, int y1) const {
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, width);
+	y1 = std::min(y1, height);
+	if (x0 >= x1 || y0 >= y1) {
+		return std::numeric_limits<float>::quiet_NaN();
+	}
+	const int stride = width + 1;
+	auto boxSum = [=](const auto& v) {
+		return v[y1 * stride + x1] - v[y0 * stride + x1] - v[y1 * stride + x0] + v[y0 * stride + x0];
+	};
+	int n = boxSum(count);
+	if (n == 0) {
+		return std::numeric_limits<float>::quiet_NaN();
+	}
+	double s = boxSum(sum);
+	return float(s / n);
+}
+
+int LandmarkDetector::toPixels(float meters, float depth) const {
+	return std::max(1, int(intrinsics(0, 0) * meters / depth + 0.5f));
+}
+
+Vector2i LandmarkDetector::project(const Vector3f& point) const {
+	Vector3f p = intrinsics * point;
+	return Vector2i(int(p.x() / p.z()), int(p.y() / p.z()));
+}
+
+bool LandmarkDetector::findNoseTip(const pcl::PointCloud<pcl::PointXYZRGBNormal>& cloud, const DepthIntegral& integral, Vector2i& outPixel) const {
+	const int width = cloud.width;
+	const int height = cloud.height;
+
+	float minDepth = std::numeric_limits<float>::infinity();
+	for (const auto& p : cloud.points) {
+		if (isValid(p)) {
+			minDepth = std::min(minDepth, p.z);
+		}
+	}
+	if (std::isinf(minDepth)) {
+		return false;
+	}
+
+	float bestScore = -std::numeric_limits<float>::infinity();
+	for (int y = 0; y < height; y += 2) {
+		for (int x = 0; x < width; x += 2) {
+			const auto& p = cloud(x, y);
+			if (!isValid(p) || p.z > minDepth + MAX_FACE_DEPTH_RANGE) {
+				continue;
+			}
+			// The nose tip faces the camera.
+			if (!std::isfinite(p.normal_z) || p.normal_z > -0.5f) {
+				continue;
+			}
+
+			int r = toPixels(NOSE_RADIUS, p.z);
+			float surrounding = integral.mean(x - r, y - r, x + r + 1, y + r + 1);
+			if (std::isnan(surrounding)) {
+				continue;
+			}
+			float protrusion = surrounding - p.z;
+
+			// The face is left/right symmetric around the vertical line through the nose tip.
+			float asymmetry = 0;
+			int numSamples = 0;
+			for (int k = r / 3; k <= r; k += std::max(1, r / 3)) {
+				if (x - k < 0 || x + k >= width) {
+					break;
+				}
+				const auto& left = cloud(x - k, y);
+				const auto& right = cloud(x + k, y);
+				if (isValid(left) && isValid(right)) {
+					asymmetry += std::abs(left.z - right.z);
+					numSamples++;
+				}
+			}
+			if (numSamples == 0) {
+				continue;
+			}
+			asymmetry /= numSamples;
+
+			float score = protrusion - 0.5f * asymmetry;
+			if (score > bestScore) {
+				bestScore = score;
+				outPixel = Vector2i(x, y);
+			}
+		}
+	}
+	return bestScore > 0;
+}
+
+Vector2i LandmarkDetector::refine(const pcl::PointCloud<pcl::PointXYZRGBNormal>& cloud, const DepthIntegral& integral,
+	const Vector2i& predicted, int radius, float concavityWeight, float darknessWeight) const {
+	Vector2i best = predicted;
+	float bestScore = -std::numeric_limits<float>::infinity();
+	int boxRadius = std::max(1, radius / 2);
+
+	for (int y = std::max(0, predicted.y() - radius); y <= std::min(int(cloud.height) - 1, predicted.y() + radius); y++) {
+		for (int x = std::max(0, predicted.x() - radius); x <= std::min(int(cloud.width) - 1, predicted.x() + radius); x++) {
+			const auto& p = cloud(x, y);
+			if (!isValid(p)) {
+				continue;
+			}
+			float surrounding = integral.mean(x - boxRadius, y - boxRadius, x + boxRadius + 1, y + boxRadius + 1);
+			// in centimeters, positive where the point lies deeper than its surrounding
+			float concavity = std::isnan(surrounding) ? 0.0f : 100.0f * (p.z - surrounding);
+			float darkness = 1.0f - (0.299f * p.r + 0.587f * p.g + 0.114f * p.b) / 255.0f;
+			// prefer points close to the prediction
+			float distance = (Vector2i(x, y) - predicted).cast<float>().norm() / radius;
+
+			float score = concavityWeight * concavity + darknessWeight * darkness - 0.25f * distance;
+			if (score > bestScore) {
+				bestScore = score;
+				best = Vector2i(x, y);
+			}
+		}
+	}
+	return best;
+}
+
+bool LandmarkDetector::detect(const pcl::PointCloud<pcl::PointXYZRGBNormal>& cloud, std::vector<Vector3f>& outPoints) const {
+	if (cloud.height <= 1) {
+		LOG_ERROR << "Automatic feature point detection requires an organized point cloud.";
+		return false;
+	}
+	auto start = std::chrono::high_resolution_clock::now();
+
+	DepthIntegral integral(cloud);
+
+	Vector2i nosePx;
+	if (!findNoseTip(cloud, integral, nosePx)) {
+		return false;
+	}
+	const auto& noseTip = cloud(nosePx.x(), nosePx.y());
+	Vector3f nose(noseTip.x, noseTip.y, noseTip.z);
+
+	// Predict the remaining points from the average face layout and refine them in the image.
+	Vector3f mirror(-1, 1, 1);
+	Vector2i leftEye = refine(cloud, integral, project(nose + offsetEye.cwiseProduct(mirror)), toPixels(0.012f, nose.z()), 1.0f, 0.5f);
+	Vector2i rightEye = refine(cloud, integral, project(nose + offsetEye), toPixels(0.012f, nose.z()), 1.0f, 0.5f);
+	Vector2i leftMouth = refine(cloud, integral, project(nose + offsetMouth.cwiseProduct(mirror)), toPixels(0.01f, nose.z()), 0.5f, 1.0f);
+	Vector2i rightMouth = refine(cloud, integral, project(nose + offsetMouth), toPixels(0.01f, nose.z()), 0.5f, 1.0f);
+	// The chin is convex, so look for the most protruding point instead.
+	Vector2i chin = refine(cloud, integral, project(nose + offsetChin), toPixels(0.012f, nose.z()), -1.0f, 0.0f);
+
+	// Enforce symmetry of the left/right pairs around the nose: both points of a pair share their
+	// height, and a side that strays much further from the nose than the other one is mirrored.
+	auto symmetrize = [&nosePx](Vector2i& left, Vector2i& right) {
+		int dy = ((left.y() - nosePx.y()) + (right.y() - nosePx.y())) / 2;
+		left.y() = right.y() = nosePx.y() + dy;
+		int dxLeft = nosePx.x() - left.x();
+		int dxRight = right.x() - nosePx.x();
+		if (dxLeft > 1.3f * dxRight || dxLeft <= 0) {
+			left.x() = nosePx.x() - dxRight;
+		}
+		else if (dxRight > 1.3f * dxLeft || dxRight <= 0) {
+			right.x() = nosePx.x() + dxLeft;
+		}
+	};
+	symmetrize(leftEye, rightEye);
+	symmetrize(leftMouth, rightMouth);
+
+	// Look up the 3D position of a pixel, using the closest valid neighbor for holes.
+	auto lookup = [&cloud](const Vector2i& px, const Vector3f& fallback) {
+		for (int r = 0; r <= 3; r++) {
+			for (int y = px.y() - r; y <= px.y() + r; y++) {
+				for (int x = px.x() - r; x <= px.x() + r; x++) {
+					if (x < 0 || y < 0 || x >= int(cloud.width) || y >= int(cloud.height))
+						continue;
+					const auto& p = cloud(x, y);
+					if (isValid(p))
+						return Vector3f(p.x, p.y, p.z);
+				}
+			}
+		}
+		return fallback;
+	};
+
+	outPoints.clear();
+	outPoints.push_back(lookup(leftEye, nose + offsetEye.cwiseProduct(mirror)));
+	outPoints.push_back(lookup(rightEye, nose + offsetEye));
+	outPoints.push_back(nose);
+	outPoints.push_back(lookup(leftMouth, nose + offsetMouth.cwiseProduct(mirror)));
+	outPoints.push_back(lookup(rightMouth, nose + offsetMouth));
+	outPoints.push_back(lookup(chin, nose + offsetChin));
+
+	auto end = std::chrono::high_resolution_clock::now();
+	LOG_INFO << "Detected feature points in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms";
+	return true;
+}
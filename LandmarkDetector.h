@@ -0,0 +1,42 @@
+#pragma once
+#include <pcl/common/common.h>
+
+// Automatically finds the facial feature points in an organized RGB-D frame, so that no
+// hand-made .points file is needed. The points are returned in the same order as in the
+// .points files: left eye, right eye, nose tip, left mouth corner, right mouth corner, chin.
+//
+// The nose tip is located as the most protruding, left/right symmetric surface point that
+// faces the camera. The remaining points are predicted from the average face layout and
+// refined in small image windows using depth concavity, color and symmetry around the nose.
+class LandmarkDetector {
+public:
+	explicit LandmarkDetector(const Eigen::Matrix3f& intrinsics) : intrinsics(intrinsics) {}
+
+	// Returns false if no face could be found in the cloud.
+	bool detect(const pcl::PointCloud<pcl::PointXYZRGBNormal>& cloud, std::vector<Eigen::Vector3f>& outPoints) const;
+
+private:
+	const Eigen::Matrix3f intrinsics;
+
+	// Integral images over valid depth values for O(1) box means.
+	struct DepthIntegral {
+		int width, height;
+		std::vector<double> sum;
+		std::vector<int> count;
+
+		DepthIntegral(const pcl::PointCloud<pcl::PointXYZRGBNormal>& cloud);
+		// Mean depth of valid pixels in the box [x0, x1) x [y0, y1), clipped to the image. NaN if empty.
+		float mean(int x0, int y0, int x1, int y1) const;
+	};
+
+	// Converts a metric length at the given depth to pixels.
+	int toPixels(float meters, float depth) const;
+	Eigen::Vector2i project(const Eigen::Vector3f& point) const;
+
+	bool findNoseTip(const pcl::PointCloud<pcl::PointXYZRGBNormal>& cloud, const DepthIntegral& integral, Eigen::Vector2i& outPixel) const;
+
+	// Searches a window around the predicted pixel for the best scoring valid pixel.
+	// Concavity rewards points lying deeper than their surrounding, darkness rewards dark colors.
+	Eigen::Vector2i refine(const pcl::PointCloud<pcl::PointXYZRGBNormal>& cloud, const DepthIntegral& integral,
+		const Eigen::Vector2i& predicted, int radius, float concavityWeight, float darknessWeight) const;
+};
@@ -0,0 +1,109 @@
+#include "stdafx.h"
+#include <atomic>
+#include <mutex>
+#include "Log.h"
+
+namespace {
+	std::atomic<int> gLevel{ static_cast<int>(LogLevel::Info) };
+	std::ostream* gOutput = &std::cout;
+	std::ostream* gErrorOutput = &std::cerr;
+	std::mutex gOutputMutex;
+
+	// Lines are written once this much is buffered, even if the job context hasn't ended.
+	const size_t MAX_BUFFERED = 16 * 1024;
+
+	struct ThreadLog {
+		std::string context;
+		std::string buffer;
+
+		~ThreadLog() { write(); }
+
+		void write() {
+			if (buffer.empty()) {
+				return;
+			}
+			std::lock_guard<std::mutex> lock(gOutputMutex);
+			gOutput->write(buffer.data(), buffer.size());
+			gOutput->flush();
+			buffer.clear();
+		}
+	};
+
+	ThreadLog& threadLog() {
+		static thread_local ThreadLog log;
+		return log;
+	}
+}
+
+namespace Log {
+	void setLevel(LogLevel level) {
+		gLevel = static_cast<int>(level);
+	}
+
+	bool setLevel(const std::string& name) {
+		const std::pair<const char*, LogLevel> levels[] = {
+			{ "error", LogLevel::Error }, { "warning", LogLevel::Warning }, { "info", LogLevel::Info }, { "debug", LogLevel::Debug } };
+		for (const auto& level : levels) {
+			if (name == level.first) {
+				setLevel(level.second);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool isEnabled(LogLevel level) {
+		return static_cast<int>(level) <= gLevel.load(std::memory_order_relaxed);
+	}
+
+	void setOutput(std::ostream& out) {
+		gOutput = &out;
+	}
+
+	void setErrorOutput(std::ostream& out) {
+		gErrorOutput = &out;
+	}
+
+	void flush() {
+		threadLog().write();
+	}
+}
+
+LogContext::LogContext(const std::string& context) : previous(threadLog().context) {
+	threadLog().context = context;
+}
+
+LogContext::~LogContext() {
+	ThreadLog& log = threadLog();
+	log.context = previous;
+	log.write();
+}
+
+LogLine::~LogLine() {
+	ThreadLog& log = threadLog();
+	std::string line;
+	if (!log.context.empty()) {
+		line += "[" + log.context + "] ";
+	}
+	if (level == LogLevel::Error) {
+		line += "Error: ";
+	}
+	else if (level == LogLevel::Warning) {
+		line += "Warning: ";
+	}
+	line += stream.str();
+	line += '\n';
+
+	if (level <= LogLevel::Warning) {
+		// Keep the order with the buffered messages of the job.
+		log.write();
+		std::lock_guard<std::mutex> lock(gOutputMutex);
+		*gErrorOutput << line << std::flush;
+		return;
+	}
+	log.buffer += line;
+	// Outside of jobs, messages are written right away (e.g. progress of the interactive application).
+	if (log.context.empty() || log.buffer.size() >= MAX_BUFFERED) {
+		log.write();
+	}
+}
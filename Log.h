@@ -0,0 +1,62 @@
+#pragma once
+#include <ostream>
+#include <sstream>
+#include <string>
+
+enum class LogLevel { Error, Warning, Info, Debug };
+
+// Within a job context, messages are collected in a buffer per thread and written to the output in
+// whole lines when the job ends, the buffer is full or a warning or error is logged. So logging from
+// the fitting loops takes no lock, and lines of concurrent jobs don't interleave. Outside of jobs,
+// lines are written right away. Warnings and errors go to the error output.
+namespace Log {
+	void setLevel(LogLevel level);
+	// error, warning, info or debug. Returns false for other names.
+	bool setLevel(const std::string& name);
+	bool isEnabled(LogLevel level);
+	// The outputs must outlive all logging threads; set them before starting any.
+	void setOutput(std::ostream& out);
+	void setErrorOutput(std::ostream& out);
+	// Writes the buffered messages of the calling thread.
+	void flush();
+}
+
+// Names the job the calling thread works on (e.g. the input file) while in scope. Its messages are
+// prefixed with it and written when the scope ends.
+class LogContext {
+public:
+	explicit LogContext(const std::string& context);
+	~LogContext();
+
+private:
+	std::string previous;
+};
+
+// One message, added to the buffer of the thread at the end of the statement.
+class LogLine {
+public:
+	explicit LogLine(LogLevel level) : level(level) {}
+	~LogLine();
+
+	template <typename T>
+	LogLine& operator<<(const T& value) {
+		stream << value;
+		return *this;
+	}
+
+private:
+	LogLevel level;
+	std::ostringstream stream;
+};
+
+// LOG_INFO << "Fitting " << file; The arguments are only evaluated if the level is enabled.
+#define LOG_AT(level) if (!Log::isEnabled(level)) {} else LogLine(level)
+#define LOG_ERROR LOG_AT(LogLevel::Error)
+#define LOG_WARNING LOG_AT(LogLevel::Warning)
+#define LOG_INFO LOG_AT(LogLevel::Info)
+// Debug messages are removed by the compiler unless built with ENABLE_DEBUG_LOG.
+#ifdef ENABLE_DEBUG_LOG
+#define LOG_DEBUG LOG_AT(LogLevel::Debug)
+#else
+#define LOG_DEBUG if (true) {} else LogLine(LogLevel::Debug)
+#endif
@@ -0,0 +1,53 @@
+#include "stdafx.h"
+#include "Metrics.h"
+
+void LatencyStats::add(double ms) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (samples.size() < MAX_SAMPLES) {
+		samples.push_back(ms);
+	}
+	else {
+		samples[numAdded % MAX_SAMPLES] = ms;
+	}
+	numAdded++;
+	sum += ms;
+	maxValue = std::max(maxValue, ms);
+}
+
+size_t LatencyStats::count() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return numAdded;
+}
+
+double LatencyStats::mean() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return numAdded > 0 ? sum / numAdded : 0.0;
+}
+
+double LatencyStats::max() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return maxValue;
+}
+
+double LatencyStats::percentile(double p) const {
+	std::vector<double> sorted;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		sorted = samples;
+	}
+	if (sorted.empty()) {
+		return 0.0;
+	}
+	size_t index = std::min(sorted.size() - 1, size_t(p / 100.0 * sorted.size()));
+	std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+	return sorted[index];
+}
+
+void LatencyStats::writeJson(std::ostream& out) const {
+	out << "{\"count\": " << count()
+		<< ", \"mean_ms\": " << mean()
+		<< ", \"p50_ms\": " << percentile(50)
+		<< ", \"p90_ms\": " << percentile(90)
+		<< ", \"p99_ms\": " << percentile(99)
+		<< ", \"max_ms\": " << max() << "}";
+}
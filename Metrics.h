@@ -0,0 +1,29 @@
+#pragma once
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// Thread-safe collection of latency samples (in milliseconds) with percentile queries.
+class LatencyStats {
+public:
+	void add(double ms);
+
+	size_t count() const;
+	double mean() const;
+	double max() const;
+	// p in [0, 100]. Returns 0 if there are no samples.
+	double percentile(double p) const;
+
+	// Writes {"count": ..., "mean_ms": ..., "p50_ms": ..., "p90_ms": ..., "p99_ms": ..., "max_ms": ...}.
+	void writeJson(std::ostream& out) const;
+
+private:
+	// Keep memory bounded for long-running processes, older samples are overwritten.
+	static const size_t MAX_SAMPLES = 100000;
+
+	mutable std::mutex mutex;
+	std::vector<double> samples;
+	size_t numAdded = 0;
+	double sum = 0;
+	double maxValue = 0;
+};
@@ -0,0 +1,29 @@
+#include "stdafx.h"
+#include "ModelRank.h"
+#include "Log.h"
+
+bool selectModelRank(unsigned int numAlpha, unsigned int numShapeVectors, unsigned int numAlbedoVectors, ModelRank& outRank) {
+	const ModelRank ranks[] = {
+#define MODEL_RANK_ENTRY(A, B) { A, B },
+		FOR_EACH_MODEL_RANK(MODEL_RANK_ENTRY)
+#undef MODEL_RANK_ENTRY
+	};
+	bool found = false;
+	for (const ModelRank& rank : ranks) {
+		if (rank.numAlpha <= numAlpha && rank.numAlpha <= numShapeVectors && rank.numBeta <= numAlbedoVectors) {
+			outRank = rank;
+			found = true;
+		}
+	}
+	if (!found) {
+		// The basis products of even the smallest rank would read past the basis of the model.
+		LOG_ERROR << "No kernels for " << numAlpha << " shape coefficients of a model with " << numShapeVectors
+			<< " shape and " << numAlbedoVectors << " albedo vectors";
+		return false;
+	}
+	if (outRank.numAlpha != numAlpha) {
+		LOG_WARNING << "No kernels for " << numAlpha << " shape coefficients (model has " << numShapeVectors << "), using "
+			<< outRank.numAlpha << " shape and " << outRank.numBeta << " albedo coefficients";
+	}
+	return true;
+}
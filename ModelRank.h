@@ -0,0 +1,44 @@
+#pragma once
+#include <cassert>
+
+// Default numbers of shape (alpha) and albedo (beta) coefficients that are optimized.
+const unsigned int NUM_ALPHA_VEC = 160;
+const unsigned int NUM_BETA_VEC = 80;
+
+// Numbers of shape and albedo coefficients that are optimized, the leading ones of the model.
+struct ModelRank {
+	unsigned int numAlpha = NUM_ALPHA_VEC;
+	unsigned int numBeta = NUM_BETA_VEC;
+};
+
+// A rank at compile time. The residual functors, the regularizer and the basis products are
+// instantiated per rank, so Ceres uses fixed-size Jets and the loops have fixed trip counts.
+template <int NumAlpha, int NumBeta>
+struct FixedRank {
+	static const int NUM_ALPHA = NumAlpha;
+	static const int NUM_BETA = NumBeta;
+};
+
+typedef FixedRank<NUM_ALPHA_VEC, NUM_BETA_VEC> DefaultRank;
+
+// The ranks with compiled kernels: the number of shape coefficients, with half as many albedo
+// coefficients as the default 160 and 80. Each one costs compile time and binary size.
+#define FOR_EACH_MODEL_RANK(X) X(10, 5) X(20, 10) X(40, 20) X(80, 40) X(160, 80) X(199, 100)
+
+// The compiled rank with the most shape coefficients up to the requested number, limited by the
+// coefficients of the model. Logs a warning if that isn't the requested one. Returns false if even
+// the smallest compiled rank needs more vectors than the model has.
+bool selectModelRank(unsigned int numAlpha, unsigned int numShapeVectors, unsigned int numAlbedoVectors, ModelRank& outRank);
+
+// Calls function(FixedRank<...>()) with the compiled rank that matches the runtime rank, which must be
+// one of selectModelRank. Returns its result.
+template <typename Function>
+auto dispatchRank(const ModelRank& rank, Function&& function) -> decltype(function(DefaultRank())) {
+	switch (rank.numAlpha) {
+#define DISPATCH_MODEL_RANK(A, B) case A: assert(rank.numBeta == B); return function(FixedRank<A, B>());
+	FOR_EACH_MODEL_RANK(DISPATCH_MODEL_RANK)
+#undef DISPATCH_MODEL_RANK
+	}
+	assert(false && "rank without compiled kernels, see selectModelRank");
+	return function(DefaultRank());
+}
@@ -1,162 +1,214 @@
 #include "stdafx.h"
 #include <pcl/filters/crop_box.h>
 #include "Optimizer.h"
+#include "OptimizerFunctors.h"
+#include "AlternatingSolver.h"
+#include "PixelSampler.h"
+#include "TimeBudget.h"
 #include "Rasterizer.h"
 #include "BMP.h"
 #include "utils.h"
 #include "Settings.h"
+#include "Profiler.h"
+#include "Log.h"
 
 using namespace Eigen;
 
-// Constant to allow better compile-time optimization.
-// If this is smaller than the number of actual eigen vectors (160),
-// only the first ones will be optimized over.
-const unsigned int NUM_ALPHA_VEC = 160;
-const unsigned int NUM_BETA_VEC = 80;
-
-const unsigned int NUM_DENSE_RESIDUALS = 4 + 3;
-
-struct ResidualFunctor {
-	// x is the source (pos mesh), y is the target (input cloud)
-	ResidualFunctor(const pcl::PointXYZRGBNormal& inputPoint, const PixelData& rasterizerResult, const FaceModel& model, const Matrix4f& pose, const Matrix3f& intrinsics, const Vector3f& colorDelta)
-		: inputPoint(inputPoint), rasterizerResult(rasterizerResult), model(model), pose(pose), intrinsics(intrinsics), colorDelta(colorDelta) {}
-
-	template <typename T>
-	bool operator()(T const* alpha, T const* beta, T* residual) const {
-		typedef Matrix<T, 2, 1> Vector2T;
-		typedef Matrix<T, 3, 1> Vector3T;
-		typedef Matrix<T, 2, 2> Matrix2T;
-		typedef Matrix<T, 3, 3> Matrix3T;
-
-		if (!rasterizerResult.isValid) {
-			// Skip pixels where Steve isn't rendered into.
-			std::fill(residual, residual + NUM_DENSE_RESIDUALS, T(0));
-			return true;
-		}
-
-		Vector3T vertexWorldPositions[3];
-		Vector3T vertexAlbedos[3];
-		Vector2T vertexScreenPositions[3];
-
-		// For each vertex that is part of the triangle at this pixel.
-		for (int i = 0; i < 3; i++) {
-			int vertexIndex = rasterizerResult.vertexIndices[i];
-
-			// Albedo of average face (ignore alpha).
-			vertexAlbedos[i] = model.m_averageMesh.vertexColors.col(vertexIndex).head<3>().cast<T>();
-			// Apply beta to albedo.
-			for (int j = 0; j < NUM_BETA_VEC; j++) {
-				T std = T(model.m_albedoStd(j));
-				vertexAlbedos[i] += model.m_albedoBasis.block(3 * vertexIndex, j, 3, 1).cast<T>() * std * beta[j];
-			}
-
-			// Vertex position of average face.
-			Vector3T pos = model.m_averageMesh.vertices.segment(3 * vertexIndex, 3).cast<T>();
-			// Displace by applying alpha.
-			for (int j = 0; j < NUM_ALPHA_VEC; j++) {
-				T std = T(model.m_shapeStd(j));
-				pos += model.m_shapeBasis.block(3 * vertexIndex, j, 3, 1).cast<T>() * std * alpha[j];
-			}
+// Returns the pose with the correction (rotation quaternion about the posed model center, as in the
+// functors, and translation) applied after it.
+Matrix4f applyPoseCorrection(const Matrix4f& pose, const Vector3f& modelCenter, const double* rotation, const double* translation) {
+	const Vector3f center = pose.topLeftCorner<3, 3>() * modelCenter + pose.topRightCorner<3, 1>();
+	const Matrix3f correctionRotation = Quaterniond(rotation[0], rotation[1], rotation[2], rotation[3]).normalized().toRotationMatrix().cast<float>();
+	Matrix4f correction = Matrix4f::Identity();
+	correction.topLeftCorner<3, 3>() = correctionRotation;
+	correction.topRightCorner<3, 1>() = center - correctionRotation * center + Map<const Vector3d>(translation).cast<float>();
+	return correction * pose;
+}
 
-			// Transform to world space.
-			vertexWorldPositions[i] = pose.topLeftCorner<3, 3>().cast<T>() * pos + pose.topRightCorner<3, 1>().cast<T>();
-			// Transform to screen space.
-			Vector3T projectedPos = intrinsics.cast<T>() * vertexWorldPositions[i];
-			vertexScreenPositions[i] = ((projectedPos.template head<2>() / projectedPos.z()).array()).matrix();
-		}
+bool parseOptimizationSolver(const std::string& name, OptimizationSolver& outSolver) {
+	if (name == "ceres") {
+		outSolver = OptimizationSolver::Ceres;
+	}
+	else if (name == "alternating") {
+		outSolver = OptimizationSolver::Alternating;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
 
-		// Compute barycentric coordinates from screen positions;
-		Matrix2T mT;
-		mT << (vertexScreenPositions[0] - vertexScreenPositions[2]),
-			(vertexScreenPositions[1] - vertexScreenPositions[2]);
-		Matrix2T mTi = mT.inverse();
-
-		Vector2T b = mTi * (rasterizerResult.pixelCenter.cast<T>() - vertexScreenPositions[2]);
-		T barycentricCoordinates[] = {
-			b(0),
-			b(1),
-			T(1.0f) - b(0) - b(1)
-		};
-
-		// Interpolate final values for this pixel.
-		Vector3T worldPos = Vector3T::Zero();
-		Vector3T albedo = Vector3T::Zero();
-		for (int i = 0; i < 3; i++) {
-			worldPos += barycentricCoordinates[i] * vertexWorldPositions[i];
-			albedo += barycentricCoordinates[i] * vertexAlbedos[i];
+// Records every solver iteration as a profiler event.
+struct ProfilerCallback : public ceres::IterationCallback {
+	virtual ceres::CallbackReturnType operator()(const ceres::IterationSummary& summary) override {
+		Profiler& profiler = Profiler::instance();
+		if (profiler.isEnabled()) {
+			auto end = Profiler::Clock::now();
+			auto duration = std::chrono::duration_cast<Profiler::Clock::duration>(std::chrono::duration<double>(summary.iteration_time_in_seconds));
+			profiler.recordEvent("ceres iteration", end - duration, end);
 		}
-
-		Vector3T inputPos = Vector3T(T(inputPoint.x), T(inputPoint.y), T(inputPoint.z));
-		Vector3T pointToPointDist = inputPos - worldPos;
-		residual[0] = pointToPointDist(0);
-		residual[1] = pointToPointDist(1);
-		residual[2] = pointToPointDist(2);
-
-		// TODO: point to plane distance, but for this we need normals
-		residual[6] = pointToPointDist(0)*T(inputPoint.normal_x) + pointToPointDist(1)*T(inputPoint.normal_y) + pointToPointDist(2)*T(inputPoint.normal_z);
-
-		Vector3T inputCol = Vector3T(T(inputPoint.r), T(inputPoint.g), T(inputPoint.b));
-		T colorScaling = T(1.f / 255.f);
-		Vector3T colorDist = (inputCol - albedo + colorDelta.cast<T>()) / T(255.0f);
-		residual[3] = colorDist(0);
-		residual[4] = colorDist(1);
-		residual[5] = colorDist(2);
-		return true;
+		return ceres::CallbackReturnType::SOLVER_CONTINUE;
 	}
-
-private:
-	// Input pixel that this residual is computing.
-	const pcl::PointXYZRGBNormal& inputPoint;
-
-	const FaceModel& model;
-	const Matrix4f& pose;
-	const Matrix3f& intrinsics;
-	const Vector3f& colorDelta;
-
-	// Rasterization result for this pixel.
-	const PixelData& rasterizerResult;
 };
 
-struct RegularizerFunctor
-{
-	template <typename T>
-	bool operator()(T const* alpha, T const* beta, T* residual) const {
-		T factor = T(gSettings.regStrengthAlpha / NUM_ALPHA_VEC);
-		for (size_t i = 0; i < NUM_ALPHA_VEC; i++) {
-			residual[i] = factor * alpha[i];
-		}
-		factor = T(gSettings.regStrengthBeta / NUM_BETA_VEC);
-		for (size_t i = 0; i < NUM_BETA_VEC; i++) {
-			residual[NUM_ALPHA_VEC + i] = factor * beta[i];
-		}
-		return true;
+// Logs the progress of every solver iteration at debug level.
+struct LogCallback : public ceres::IterationCallback {
+	virtual ceres::CallbackReturnType operator()(const ceres::IterationSummary& summary) override {
+		LOG_DEBUG << "iteration " << summary.iteration << ": cost " << summary.cost << ", cost change " << summary.cost_change
+			<< ", step " << summary.step_norm << ", trust region " << summary.trust_region_radius
+			<< ", " << summary.iteration_time_in_seconds * 1000.0 << " ms";
+		return ceres::CallbackReturnType::SOLVER_CONTINUE;
 	}
 };
 
 struct RasterizerFunctor : public ceres::IterationCallback {
-	RasterizerFunctor(Rasterizer& rasterizer, const double* alpha, const double* beta)
-		: alpha(alpha), beta(beta), rasterizer(rasterizer) {}
+	RasterizerFunctor(Rasterizer& rasterizer, const ModelRank& rank, const double* alpha, const double* beta)
+		: rasterizer(rasterizer), rank(rank), alpha(alpha), beta(beta) {}
+
+	// When the pose is optimized as well, the rendering pose is updated from the base pose and the correction.
+	void setPoseCorrection(Matrix4f* renderPose, const Matrix4f& basePose, const double* rotation, const double* translation) {
+		this->renderPose = renderPose;
+		this->basePose = basePose;
+		this->rotation = rotation;
+		this->translation = translation;
+	}
 
 	virtual ceres::CallbackReturnType operator()(const ceres::IterationSummary& summary) override {
 		FaceParameters params = rasterizer.model.createDefaultParameters();
-		params.alpha.head<NUM_ALPHA_VEC>() = Map<const VectorXd>(alpha, NUM_ALPHA_VEC).cast<float>();
-		params.beta.head<NUM_BETA_VEC>() = Map<const VectorXd>(beta, NUM_BETA_VEC).cast<float>();
+		params.alpha.head(rank.numAlpha) = Map<const VectorXd>(alpha, rank.numAlpha).cast<float>();
+		params.beta.head(rank.numBeta) = Map<const VectorXd>(beta, rank.numBeta).cast<float>();
 
+		if (renderPose) {
+			*renderPose = applyPoseCorrection(basePose, rasterizer.model.m_averageCenter, rotation, translation);
+		}
+		auto start = std::chrono::steady_clock::now();
 		rasterizer.compute(params);
+		totalSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 		return ceres::CallbackReturnType::SOLVER_CONTINUE;
 	}
 
+	// Time spent rasterizing, part of the solver time.
+	double getTotalSeconds() const { return totalSeconds; }
+
 private:
 	Rasterizer& rasterizer;
+	const ModelRank rank;
 	const double* alpha;
 	const double* beta;
+
+	Matrix4f* renderPose = nullptr;
+	Matrix4f basePose;
+	const double* rotation = nullptr;
+	const double* translation = nullptr;
+	double totalSeconds = 0;
 };
 
+// Adds the pixels as residual blocks over the given parameter blocks, one block per pixel or, if
+// tiled, one per group of pixels.
+template <typename PixelFunctor, int... ParameterSizes>
+static void addResidualBlocks(ceres::Problem& problem, const std::vector<std::vector<PixelResidual>>& groups, bool tiled,
+	const std::vector<double*>& parameters) {
+	for (const std::vector<PixelResidual>& group : groups) {
+		if (tiled && !group.empty()) {
+			TileResidualFunctor<PixelFunctor>* tile = new TileResidualFunctor<PixelFunctor>();
+			tile->pixels.reserve(group.size());
+			for (const PixelResidual& pixel : group) {
+				tile->pixels.emplace_back(pixel);
+			}
+			const int numResiduals = int(PixelFunctor::NUM_RESIDUALS * group.size());
+			ceres::CostFunction* costFunc = new ceres::AutoDiffCostFunction<TileResidualFunctor<PixelFunctor>, ceres::DYNAMIC, ParameterSizes...>(tile, numResiduals);
+			problem.AddResidualBlock(costFunc, NULL, parameters);
+		}
+		else if (!tiled) {
+			for (const PixelResidual& pixel : group) {
+				ceres::CostFunction* costFunc = new ceres::AutoDiffCostFunction<PixelFunctor, PixelFunctor::NUM_RESIDUALS, ParameterSizes...>(new PixelFunctor(pixel));
+				problem.AddResidualBlock(costFunc, NULL, parameters);
+			}
+		}
+	}
+}
+
+unsigned int addPixelResidualBlocks(ceres::Problem& problem, const pcl::PointCloud<pcl::PointXYZRGBNormal>& cloud,
+	const std::vector<PixelData>& pixelResults, const FaceModel& model, const Matrix4f& pose,
+	const Matrix3f& intrinsics, const Vector3f& colorDelta, unsigned int stride, unsigned int tileSize,
+	bool separateColor, PixelSampler* sampler, const ModelRank& rank, double* alpha, double* beta, double* rotation, double* translation) {
+	const uint32_t width = cloud.width;
+	const uint32_t height = cloud.height;
+	stride = std::max(stride, 1u);
+	const bool tiled = tileSize > 0;
+	const unsigned int tilesX = tiled ? (width + tileSize - 1) / tileSize : 1;
+	const unsigned int tilesY = tiled ? (height + tileSize - 1) / tileSize : 1;
+
+	std::vector<unsigned int> candidates;
+	for (unsigned int y = 0; y < height; y += stride) {
+		for (unsigned int x = 0; x < width; x += stride) {
+			const pcl::PointXYZRGBNormal& point = cloud(x, y);
+			if (std::isnan(point.z)) {
+				continue;
+			}
+			if (std::isnan(point.normal_x)) {
+				continue;
+			}
+			candidates.push_back(y * width + x);
+		}
+	}
+	std::vector<PixelSample> sample;
+	if (sampler) {
+		std::vector<double> norms;
+		if (sampler->usesImportance()) {
+			norms.resize(candidates.size());
+			#pragma omp parallel for
+			for (int i = 0; i < int(candidates.size()); i++) {
+				norms[i] = PixelResidual(cloud.points[candidates[i]], pixelResults[candidates[i]], model, pose, intrinsics, colorDelta)
+					.residualNorm(rank, alpha, beta);
+			}
+		}
+		sampler->sample(candidates, norms, width, sample);
+	}
+	else {
+		for (unsigned int index : candidates) {
+			sample.push_back({ index, 1.0 });
+		}
+	}
+
+	// Pixels per tile, or all of them in one group without tiles.
+	std::vector<std::vector<PixelResidual>> groups(tilesX * tilesY);
+	for (const PixelSample& pixel : sample) {
+		const unsigned int x = pixel.index % width;
+		const unsigned int y = pixel.index / width;
+		size_t group = tiled ? (y / tileSize) * tilesX + x / tileSize : 0;
+		groups[group].emplace_back(cloud.points[pixel.index], pixelResults[pixel.index], model, pose, intrinsics, colorDelta, pixel.weight);
+	}
+	const unsigned int numPixels = unsigned(sample.size());
+
+	const bool withPose = rotation && translation;
+	dispatchRank(rank, [&](auto fixedRank) {
+		typedef decltype(fixedRank) Rank;
+		if (separateColor) {
+			if (withPose) {
+				addResidualBlocks<GeometryResidualFunctor<Rank>, Rank::NUM_ALPHA, NUM_ROTATION_PARAMS, NUM_TRANSLATION_PARAMS>(problem, groups, tiled, { alpha, rotation, translation });
+			}
+			else {
+				addResidualBlocks<GeometryResidualFunctor<Rank>, Rank::NUM_ALPHA>(problem, groups, tiled, { alpha });
+			}
+			addResidualBlocks<ColorResidualFunctor<Rank>, Rank::NUM_BETA>(problem, groups, tiled, { beta });
+		}
+		else if (withPose) {
+			addResidualBlocks<ResidualFunctor<Rank>, Rank::NUM_ALPHA, Rank::NUM_BETA, NUM_ROTATION_PARAMS, NUM_TRANSLATION_PARAMS>(problem, groups, tiled, { alpha, beta, rotation, translation });
+		}
+		else {
+			addResidualBlocks<ResidualFunctor<Rank>, Rank::NUM_ALPHA, Rank::NUM_BETA>(problem, groups, tiled, { alpha, beta });
+		}
+	});
+	return numPixels;
+}
+
 pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cropCloudToHeadRegion(
 	pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr inputCloud,
 	const Matrix4f& pose,
 	const FaceModel& model)
 {
+	PROFILE_SCOPE("crop");
 	// find average Steve's size
 	pcl::PointCloud<pcl::PointXYZRGB> transformedSteve;
 	pcl::transformPointCloud(*pointsToCloud(model.m_averageMesh.vertices), transformedSteve, pose);
@@ -170,7 +222,7 @@ pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cropCloudToHeadRegion(
 	min.w() = 1;
 	max.w() = 1;
 
-	std::cout << "Crop region: " << min.transpose() << " to " << max.transpose() << std::endl;
+	LOG_DEBUG << "Crop region: " << min.transpose() << " to " << max.transpose();
 
 	pcl::CropBox<pcl::PointXYZRGB> boxFilter;
 	boxFilter.setMin(min);
@@ -186,24 +238,22 @@ pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cropCloudToHeadRegion(
 	// estimate normals
 	pcl::PointCloud<pcl::Normal>::Ptr normals(new pcl::PointCloud<pcl::Normal>);
 
-	pcl::IntegralImageNormalEstimation<pcl::PointXYZRGB, pcl::Normal> ne;
-	ne.setInputCloud(cloud);
-	ne.setNormalEstimationMethod(pcl::IntegralImageNormalEstimation<pcl::PointXYZRGB, pcl::Normal>::COVARIANCE_MATRIX);
-	ne.setNormalSmoothingSize(10.0f);
-	ne.setDepthDependentSmoothing(true);
-	ne.compute(*normals);
+	{
+		PROFILE_SCOPE("normals");
+		pcl::IntegralImageNormalEstimation<pcl::PointXYZRGB, pcl::Normal> ne;
+		ne.setInputCloud(cloud);
+		ne.setNormalEstimationMethod(pcl::IntegralImageNormalEstimation<pcl::PointXYZRGB, pcl::Normal>::COVARIANCE_MATRIX);
+		ne.setNormalSmoothingSize(10.0f);
+		ne.setDepthDependentSmoothing(true);
+		ne.compute(*normals);
+	}
 	
 	pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr dst(new pcl::PointCloud<pcl::PointXYZRGBNormal>); // To be created
-	std::cout << "1" << endl;
 	// Initialization part
 	dst->width = out->width;
-	std::cout << "2" << endl;
 	dst->height = out->height;
-	std::cout << "3" << endl;
 	dst->is_dense = true;
-	std::cout << "4" << endl;
 	dst->points.resize(dst->width * dst->height);
-	std::cout << "intialisation pointNormal" << endl;
 	// Assignment part
 	for (int i = 0; i < normals->points.size(); i++)
 	{
@@ -226,17 +276,136 @@ pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cropCloudToHeadRegion(
 	return dst;
 }
 
-FaceParameters optimizeParameters(FaceModel& model, const Matrix4f& pose, const Sensor& inputSensor) {
+// Builds the problem of the pixel residuals and the regularizer and solves it. The rasterizer
+// callback updates the pixel results after every iteration. Ceres keeps the residual blocks for the
+// whole solve, so the pixels are sampled once. The solve stops after maxSeconds. The pose correction is
+// optimized if rotation and translation are not null.
+static void solveWithCeres(const FaceModel& model, const pcl::PointCloud<pcl::PointXYZRGBNormal>& cloud,
+	const std::vector<PixelData>& pixelResults, const Matrix4f& pose, const Matrix3f& intrinsics, const Vector3f& colorDelta,
+	unsigned int stride, int maxIterations, double maxSeconds, PixelSampler& sampler, RasterizerFunctor& rasterizerCallback,
+	const ModelRank& rank, double* alpha, double* beta, double* rotation, double* translation, OptimizerReport& outReport) {
+	ceres::Problem problem;
+	auto problemBuildStart = Profiler::Clock::now();
+	const double rasterizerSecondsBefore = rasterizerCallback.getTotalSeconds();
+	unsigned int numPixels = addPixelResidualBlocks(problem, cloud, pixelResults, model, pose, intrinsics, colorDelta,
+		stride, gSettings.optimizationTileSize, !gSettings.jointResiduals, &sampler, rank, alpha, beta, rotation, translation);
+
+	if (rotation) {
+		// Keep the rotation quaternion on the unit sphere, so together with the translation the
+		// correction stays a rigid transform (SO(3) x R^3).
+#if CERES_VERSION_MAJOR > 2 || (CERES_VERSION_MAJOR == 2 && CERES_VERSION_MINOR >= 1)
+		problem.SetManifold(rotation, new ceres::QuaternionManifold());
+#else
+		problem.SetParameterization(rotation, new ceres::QuaternionParameterization());
+#endif
+	}
+
+	// Add regularization error term.
+	ceres::CostFunction* regFunc = dispatchRank(rank, [](auto fixedRank) -> ceres::CostFunction* {
+		typedef decltype(fixedRank) Rank;
+		return new ceres::AutoDiffCostFunction<RegularizerFunctor<Rank>, RegularizerFunctor<Rank>::NUM_RESIDUALS, Rank::NUM_ALPHA, Rank::NUM_BETA>(
+			new RegularizerFunctor<Rank>());
+	});
+	problem.AddResidualBlock(regFunc, NULL, alpha, beta);
+
+	auto problemBuildEnd = Profiler::Clock::now();
+	const double problemBuildMs = std::chrono::duration<double, std::milli>(problemBuildEnd - problemBuildStart).count();
+	if (Profiler::instance().isEnabled()) {
+		Profiler::instance().recordEvent("problem build", problemBuildStart, problemBuildEnd);
+		Profiler::instance().recordMemory("problem build");
+	}
+
+	ceres::Solver::Options options;
+	options.minimizer_progress_to_stdout = false;
+	options.update_state_every_iteration = true;
+	options.max_num_iterations = maxIterations;
+	options.max_solver_time_in_seconds = maxSeconds;
+	options.linear_solver_type = ceres::LinearSolverType::DENSE_QR;
+	options.minimizer_type = ceres::MinimizerType::TRUST_REGION;
+	options.num_threads = int(getThreadsPerJob());
+	options.initial_trust_region_radius = gSettings.initialStepSize;
+	options.max_trust_region_radius = gSettings.maxStepSize;
+	ProfilerCallback profilerCallback;
+	options.callbacks.push_back(&profilerCallback);
+	LogCallback logCallback;
+	options.callbacks.push_back(&logCallback);
+	options.callbacks.push_back(&rasterizerCallback);
+	ceres::Solver::Summary summary;
+	{
+		PROFILE_SCOPE("solve");
+		ceres::Solve(options, &problem, &summary);
+	}
+	Profiler::instance().recordMemory("solve");
+
+	LOG_INFO << summary.BriefReport();
+	LOG_DEBUG << summary.FullReport();
+
+	// Time per iteration the solver spends outside of cost evaluation, the linear solver and the
+	// rasterizer, i.e. its bookkeeping of the residual blocks.
+	const int numIterations = std::max(int(summary.iterations.size()), 1);
+	const double evaluationSeconds = summary.residual_evaluation_time_in_seconds + summary.jacobian_evaluation_time_in_seconds;
+	const double rasterizerSeconds = rasterizerCallback.getTotalSeconds() - rasterizerSecondsBefore;
+	const double overheadSeconds = summary.minimizer_time_in_seconds - evaluationSeconds - summary.linear_solver_time_in_seconds
+		- rasterizerSeconds;
+	LOG_INFO << numPixels << " pixels in " << problem.NumResidualBlocks() << " residual blocks, problem build " << problemBuildMs
+		<< " ms, per iteration: evaluation " << evaluationSeconds * 1000.0 / numIterations << " ms, overhead "
+		<< std::max(overheadSeconds, 0.0) * 1000.0 / numIterations << " ms";
+
+	outReport.iterations = int(summary.iterations.size());
+	outReport.initialCost = summary.initial_cost;
+	outReport.finalCost = summary.final_cost;
+	outReport.numPixels = numPixels;
+	outReport.numResidualBlocks = static_cast<unsigned int>(problem.NumResidualBlocks());
+	outReport.problemBuildMs = problemBuildMs;
+	outReport.evaluationMsPerIteration = evaluationSeconds * 1000.0 / numIterations;
+	outReport.overheadMsPerIteration = std::max(overheadSeconds, 0.0) * 1000.0 / numIterations;
+	if (summary.termination_type == ceres::NO_CONVERGENCE && summary.num_successful_steps + summary.num_unsuccessful_steps < maxIterations) {
+		outReport.budgetCuts.push_back("solver stopped at deadline");
+	}
+	StageCostModel::instance().addOptimization(OptimizationSolver::Ceres, numPixels, numIterations, problemBuildMs,
+		(summary.minimizer_time_in_seconds - rasterizerSeconds) * 1000.0);
+}
+
+FaceParameters optimizeParameters(const FaceModel& model, const Matrix4f& pose, const Sensor& inputSensor, const OptimizerOptions& optimizerOptions, OptimizerReport* report) {
+	const auto start = std::chrono::steady_clock::now();
+	const auto deadline = optimizerOptions.timeBudgetMs > 0
+		? start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(optimizerOptions.timeBudgetMs))
+		: std::chrono::steady_clock::time_point::max();
+	auto secondsLeft = [&deadline] {
+		return deadline == std::chrono::steady_clock::time_point::max() ? 1e9
+			: std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+	};
+	ModelRank rank;
+	if (!selectModelRank(gSettings.modelRank, model.getNumEigenVec(), unsigned(model.m_albedoBasis.cols()), rank)) {
+		LOG_ERROR << "Can't fit the model, keeping the initial parameters.";
+		if (report) {
+			*report = OptimizerReport();
+			report->refinedPose = pose;
+		}
+		return optimizerOptions.initialParams ? *optimizerOptions.initialParams : model.createDefaultParameters();
+	}
+
 	auto croppedCloud = cropCloudToHeadRegion(inputSensor.m_cloud, pose, model);
 
 	const uint32_t width = croppedCloud->width;
 	const uint32_t height = croppedCloud->height;
 
-	std::array<double, NUM_ALPHA_VEC> alpha{};
-	std::array<double, NUM_BETA_VEC> beta{};
+	std::vector<double> alpha(rank.numAlpha);
+	std::vector<double> beta(rank.numBeta);
+	if (optimizerOptions.initialParams) {
+		// Warm start, coefficients beyond the optimized ones are ignored.
+		for (unsigned int i = 0; i < rank.numAlpha && i < optimizerOptions.initialParams->alpha.size(); i++)
+			alpha[i] = optimizerOptions.initialParams->alpha(i);
+		for (unsigned int i = 0; i < rank.numBeta && i < optimizerOptions.initialParams->beta.size(); i++)
+			beta[i] = optimizerOptions.initialParams->beta(i);
+	}
+	// Pose correction, starts at identity.
+	std::array<double, NUM_ROTATION_PARAMS> rotation{ 1.0, 0.0, 0.0, 0.0 };
+	std::array<double, NUM_TRANSLATION_PARAMS> translation{};
+	const bool optimizePose = gSettings.optimizePose;
 
-	{
-		std::cout << "Saving inputsensor.bmp ..." << std::endl;
+	if (gSettings.debugImages) {
+		LOG_INFO << "Saving inputsensor.bmp ...";
 		int warnCount = 0;
 		BMP bmp(width, height);
 		for (unsigned int y = 0; y < height; y++) {
@@ -250,7 +419,7 @@ FaceParameters optimizeParameters(FaceModel& model, const Matrix4f& pose, const
 				int sy = int(s.y() + 0.5f);
 
 				if ((sx != x || sy != y) && warnCount++ < 10) {
-					std::cout << "    (" << x << "," << y << ") goes to (" << sx << "," << sy << ")" << std::endl;
+					LOG_DEBUG << "(" << x << "," << y << ") goes to (" << sx << "," << sy << ")";
 				}
 
 				if (sx >= 0 && sx < width && sy >= 0 && sy < height) {
@@ -269,8 +438,15 @@ FaceParameters optimizeParameters(FaceModel& model, const Matrix4f& pose, const
 
 	// Set up the rasterizer, which will be called once for each Ceres iteration and 
 	// which updates rasterResults with the current per-pixel rendering results.
-	Rasterizer rasterizer({ width, height }, model, pose, inputSensor.m_cameraIntrinsics);
-	RasterizerFunctor rasterizerCallback(rasterizer, alpha.data(), beta.data());
+	Matrix4f renderPose = pose;
+	Rasterizer rasterizer({ width, height }, model, renderPose, inputSensor.m_cameraIntrinsics,
+		optimizerOptions.workspace ? &optimizerOptions.workspace->rasterizerBuffers : nullptr);
+	// Only the coefficients of the rank are set, so the projection uses the basis products of the rank.
+	rasterizer.setRank(rank);
+	RasterizerFunctor rasterizerCallback(rasterizer, rank, alpha.data(), beta.data());
+	if (optimizePose) {
+		rasterizerCallback.setPoseCorrection(&renderPose, pose, rotation.data(), translation.data());
+	}
 	// Initially call rasterizer once as the callback is only invoked AFTER each iteration.
 	rasterizerCallback(ceres::IterationSummary());
 
@@ -281,53 +457,131 @@ FaceParameters optimizeParameters(FaceModel& model, const Matrix4f& pose, const
 	// Contains the RGB difference due to lighting from the input face to the synthetic face.
 	Vector3f colorDelta = modelAverageCol - inputAverageCol;
 
-	std::cout << "| input average: " << inputAverageCol.transpose() << std::endl;
-	std::cout << "| model average: " << modelAverageCol.transpose() << std::endl;
-	std::cout << "|        delta: " << colorDelta.transpose() << std::endl;
+	LOG_DEBUG << "Average color of the input " << inputAverageCol.transpose() << ", of the model " << modelAverageCol.transpose()
+		<< ", delta " << colorDelta.transpose();
 
 
-	ceres::Problem problem;
-	unsigned int stride = gSettings.optimizationStride;
-	for (unsigned int y = 0; y < height; y += stride) {
-		for (unsigned int x = 0; x < width; x += stride) {
-			const pcl::PointXYZRGBNormal& point = (*croppedCloud)(x, y);
-			if (std::isnan(point.z)) {
-				continue;
+	OptimizationSolver solver = OptimizationSolver::Ceres;
+	if (!parseOptimizationSolver(gSettings.optimizationSolver, solver)) {
+		LOG_WARNING << "Unknown solver " << gSettings.optimizationSolver << ", using ceres";
+	}
+	const bool alternating = solver == OptimizationSolver::Alternating;
+	OptimizerReport solveReport;
+	OptimizationPlan plan;
+	plan.stride = std::max(gSettings.optimizationStride, 1u);
+	plan.sampleBudget = gSettings.sampleBudget;
+	plan.maxIterations = optimizerOptions.maxIterations;
+	const bool budgeted = optimizerOptions.timeBudgetMs > 0;
+	// Time of one rasterization, from the one just done.
+	const double rasterizeMs = rasterizerCallback.getTotalSeconds() * 1000.0;
+	unsigned int numValidPixels = 0;
+	if (budgeted) {
+		// Scale the fit to the time left, from the rasterization and the costs of earlier fits.
+		for (const pcl::PointXYZRGBNormal& point : croppedCloud->points) {
+			numValidPixels += !std::isnan(point.z) && !std::isnan(point.normal_x);
+		}
+		plan = StageCostModel::instance().planOptimization(solver, secondsLeft() * 1000.0, rasterizeMs,
+			numValidPixels, gSettings.optimizationStride, gSettings.sampleBudget, optimizerOptions.maxIterations);
+		if (plan.skip) {
+			solveReport.budgetCuts.push_back("optimization skipped");
+		}
+		else {
+			if (plan.stride != std::max(gSettings.optimizationStride, 1u)) {
+				solveReport.budgetCuts.push_back("stride " + std::to_string(std::max(gSettings.optimizationStride, 1u)) + " -> " + std::to_string(plan.stride));
 			}
-			if (std::isnan(point.normal_x)) {
-				continue;
+			if (plan.sampleBudget != gSettings.sampleBudget) {
+				solveReport.budgetCuts.push_back("pixels per iteration " + std::to_string(plan.sampleBudget));
+			}
+			if (plan.maxIterations != optimizerOptions.maxIterations) {
+				solveReport.budgetCuts.push_back("iterations " + std::to_string(optimizerOptions.maxIterations) + " -> " + std::to_string(plan.maxIterations));
 			}
-			ceres::CostFunction* costFunc = new ceres::AutoDiffCostFunction<ResidualFunctor, NUM_DENSE_RESIDUALS, NUM_ALPHA_VEC, NUM_BETA_VEC>(
-				new ResidualFunctor(point, rasterizer.pixelResults[y * width + x], model, pose, inputSensor.m_cameraIntrinsics, colorDelta));
-			problem.AddResidualBlock(costFunc, NULL, alpha.data(), beta.data());
 		}
 	}
 
-	// Add regularization error term.
-	ceres::CostFunction* regFunc = new ceres::AutoDiffCostFunction<RegularizerFunctor, NUM_ALPHA_VEC + NUM_BETA_VEC, NUM_ALPHA_VEC, NUM_BETA_VEC>(new RegularizerFunctor());
-	problem.AddResidualBlock(regFunc, NULL, alpha.data(), beta.data());
-
-	std::cout << "Cost function has " << problem.NumResidualBlocks() << " residual blocks." << std::endl;
-
-	ceres::Solver::Options options;
-	options.minimizer_progress_to_stdout = true;
-	options.update_state_every_iteration = true;
-	options.linear_solver_type = ceres::LinearSolverType::DENSE_QR;
-	options.minimizer_type = ceres::MinimizerType::TRUST_REGION;
-	options.initial_trust_region_radius = gSettings.initialStepSize;
-	options.max_trust_region_radius = gSettings.maxStepSize;
-	options.callbacks.push_back(&rasterizerCallback);
-	ceres::Solver::Summary summary;
-	ceres::Solve(options, &problem, &summary);
-
-	std::cout << summary.FullReport() << std::endl;
+	// Without a sample budget, this keeps all pixels of the stride grid.
+	PixelSampler sampler(plan.sampleBudget, gSettings.sampleTileSize, gSettings.sampleImportance, gSettings.sampleSeed);
+	if (alternating && !plan.skip) {
+		AlternatingSolverOptions alternatingOptions;
+		alternatingOptions.stride = plan.stride;
+		alternatingOptions.sampler = &sampler;
+		alternatingOptions.maxIterations = plan.maxIterations;
+		alternatingOptions.deadline = deadline;
+		alternatingOptions.maxCGIterations = int(gSettings.cgIterations);
+		alternatingOptions.initialCoefficients = gSettings.unlockCoefficients;
+		if (!parseSolverPrecision(gSettings.optimizationPrecision, alternatingOptions.precision)) {
+			LOG_WARNING << "Unknown solver precision " << gSettings.optimizationPrecision << ", using double";
+		}
+		if (!parseLinearSolver(gSettings.linearSolver, alternatingOptions.linearSolver)) {
+			LOG_WARNING << "Unknown linear solver " << gSettings.linearSolver << ", using normal";
+		}
+		auto solveStart = std::chrono::steady_clock::now();
+		const double rasterizerSecondsBefore = rasterizerCallback.getTotalSeconds();
+		AlternatingSolverReport alternatingReport = solveAlternating(model, *croppedCloud, rasterizer.pixelResults,
+			[&rasterizerCallback] { rasterizerCallback(ceres::IterationSummary()); }, pose, inputSensor.m_cameraIntrinsics, colorDelta,
+			alternatingOptions, rank, alpha.data(), beta.data());
+		const double solveMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - solveStart).count();
+		StageCostModel::instance().addOptimization(OptimizationSolver::Alternating, alternatingReport.numPixels, std::max(alternatingReport.iterations, 1), 0.0,
+			solveMs - (rasterizerCallback.getTotalSeconds() - rasterizerSecondsBefore) * 1000.0);
+		solveReport.iterations = alternatingReport.iterations;
+		solveReport.initialCost = alternatingReport.initialCost;
+		solveReport.finalCost = alternatingReport.finalCost;
+		solveReport.numPixels = alternatingReport.numPixels;
+		if (alternatingReport.stoppedAtDeadline) {
+			solveReport.budgetCuts.push_back("solver stopped at deadline");
+		}
+	}
+	// With the alternating solver, Ceres only polishes the result (and the pose correction). The polish
+	// is planned on its own, with the Ceres costs and the time the alternating solve left.
+	int ceresIterations = alternating ? int(gSettings.polishIterations) : plan.maxIterations;
+	OptimizationPlan ceresPlan = plan;
+	if (alternating && budgeted && ceresIterations > 0 && !plan.skip) {
+		ceresPlan = StageCostModel::instance().planOptimization(OptimizationSolver::Ceres, secondsLeft() * 1000.0, rasterizeMs,
+			numValidPixels, plan.stride, plan.sampleBudget, ceresIterations);
+		if (ceresPlan.skip) {
+			solveReport.budgetCuts.push_back("polish skipped");
+			ceresIterations = 0;
+		}
+		else if (ceresPlan.maxIterations != ceresIterations || ceresPlan.stride != plan.stride || ceresPlan.sampleBudget != plan.sampleBudget) {
+			solveReport.budgetCuts.push_back("polish iterations " + std::to_string(ceresIterations) + " -> " + std::to_string(ceresPlan.maxIterations)
+				+ ", pixels per iteration " + std::to_string(ceresPlan.sampleBudget));
+			ceresIterations = ceresPlan.maxIterations;
+		}
+	}
+	if (ceresIterations > 0 && !plan.skip && secondsLeft() <= 0) {
+		solveReport.budgetCuts.push_back(alternating ? "polish skipped" : "optimization skipped");
+		ceresIterations = 0;
+	}
+	if (ceresIterations > 0 && !plan.skip) {
+		OptimizerReport ceresReport;
+		PixelSampler polishSampler(ceresPlan.sampleBudget, gSettings.sampleTileSize, gSettings.sampleImportance, gSettings.sampleSeed);
+		solveWithCeres(model, *croppedCloud, rasterizer.pixelResults, pose, inputSensor.m_cameraIntrinsics, colorDelta, ceresPlan.stride,
+			ceresIterations, secondsLeft(), ceresPlan.sampleBudget == plan.sampleBudget ? sampler : polishSampler, rasterizerCallback, rank, alpha.data(), beta.data(),
+			optimizePose ? rotation.data() : nullptr, optimizePose ? translation.data() : nullptr, ceresReport);
+		if (alternating) {
+			ceresReport.iterations += solveReport.iterations;
+			ceresReport.initialCost = solveReport.initialCost;
+		}
+		ceresReport.budgetCuts.insert(ceresReport.budgetCuts.begin(), solveReport.budgetCuts.begin(), solveReport.budgetCuts.end());
+		solveReport = ceresReport;
+	}
 
 	FaceParameters params = model.createDefaultParameters();
-	params.alpha.head<NUM_ALPHA_VEC>() = Map<const VectorXd>(alpha.data(), NUM_ALPHA_VEC).cast<float>();
-	params.beta.head<NUM_BETA_VEC>() = Map<const VectorXd>(beta.data(), NUM_BETA_VEC).cast<float>();
+	params.alpha.head(rank.numAlpha) = Map<const VectorXd>(alpha.data(), rank.numAlpha).cast<float>();
+	params.beta.head(rank.numBeta) = Map<const VectorXd>(beta.data(), rank.numBeta).cast<float>();
+
+	Matrix4f refinedPose = pose;
+	if (optimizePose) {
+		refinedPose = applyPoseCorrection(pose, model.m_averageCenter, rotation.data(), translation.data());
+		LOG_DEBUG << "Pose correction: rotation " << Map<const Vector4d>(rotation.data()).transpose()
+			<< ", translation " << Map<const Vector3d>(translation.data()).transpose();
+	}
+	if (report) {
+		*report = solveReport;
+		report->refinedPose = refinedPose;
+	}
 
-	std::cout << "Some final values of alpha: " << params.alpha.head<10>().transpose() << std::endl;
-	std::cout << "Some final values of beta: " << params.beta.head<10>().transpose() << std::endl;
+	LOG_DEBUG << "Some final values of alpha: " << params.alpha.head(std::min<Index>(10, params.alpha.size())).transpose();
+	LOG_DEBUG << "Some final values of beta: " << params.beta.head(std::min<Index>(10, params.beta.size())).transpose();
 
 	return params;
 }
@@ -1,5 +1,51 @@
 #pragma once
 #include "FaceModel.h"
 #include "Sensor.h"
+#include "Rasterizer.h"
+#include "TimeBudget.h"
 
-FaceParameters optimizeParameters(FaceModel& model, const Eigen::Matrix4f& pose, const Sensor& inputSensor);
+// Buffers reused by consecutive fits on the same thread.
+struct FitWorkspace {
+	RasterizerBuffers rasterizerBuffers;
+};
+
+// Per-call options of the optimization.
+struct OptimizerOptions {
+	// Parameters to start from (e.g. those of the previous frame), zero if null.
+	const FaceParameters* initialParams = nullptr;
+	// Maximum number of solver iterations.
+	int maxIterations = 50;
+	// Optional, reuses its buffers.
+	FitWorkspace* workspace = nullptr;
+	// Wall time from the call to the result (0 = unlimited). The stride, the pixels per iteration and
+	// the iterations are reduced to fit it (see StageCostModel), and the solver stops at the deadline
+	// with the best parameters found so far.
+	double timeBudgetMs = 0;
+};
+
+struct OptimizerReport {
+	// Pose with the optimized rigid correction, or the input pose if the pose isn't optimized.
+	Eigen::Matrix4f refinedPose;
+	int iterations = 0;
+	double initialCost = 0;
+	double finalCost = 0;
+	// Number of input pixels with residuals, and of residual blocks (pixels or tiles, plus the regularizer).
+	unsigned int numPixels = 0;
+	unsigned int numResidualBlocks = 0;
+	// Solver overhead: problem construction, and time per iteration in cost evaluation and in the
+	// bookkeeping of the solver (all but evaluation, linear solver and rasterization).
+	double problemBuildMs = 0;
+	double evaluationMsPerIteration = 0;
+	double overheadMsPerIteration = 0;
+	// What was reduced to fit the time budget, e.g. "iterations 50 -> 12" or "solver stopped at deadline".
+	std::vector<std::string> budgetCuts;
+};
+
+// Fits the face parameters to the input. If enabled in the settings, a rigid correction of the
+// pose is optimized jointly with the parameters.
+// The model is only read, so it can be shared by concurrent fits with separate workspaces.
+FaceParameters optimizeParameters(const FaceModel& model, const Eigen::Matrix4f& pose, const Sensor& inputSensor,
+	const OptimizerOptions& options = OptimizerOptions(), OptimizerReport* report = nullptr);
+
+// "ceres" or "alternating" (see AlternatingSolver.h).
+bool parseOptimizationSolver(const std::string& name, OptimizationSolver& outSolver);
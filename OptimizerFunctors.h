@@ -0,0 +1,350 @@
+#pragma once
+#include <ceres/rotation.h>
+#include "FaceModel.h"
+#include "Rasterizer.h"
+#include "Settings.h"
+#include "PixelSampler.h"
+#include "ModelRank.h"
+
+const unsigned int NUM_DENSE_RESIDUALS = 4 + 3;
+
+// Optional pose correction applied on top of the coarse alignment: a rotation quaternion
+// (w, x, y, z) on the unit sphere and a translation. The rotation is about the center of the posed
+// model (m_averageCenter), so that it barely moves the face and doesn't trade off with the translation.
+const unsigned int NUM_ROTATION_PARAMS = 4;
+const unsigned int NUM_TRANSLATION_PARAMS = 3;
+
+// Inputs of the residuals of one pixel, shared by the functors below.
+struct PixelResidual {
+	// x is the source (pos mesh), y is the target (input cloud). The squared residuals are scaled by the
+	// weight of the pixel (see PixelSampler).
+	PixelResidual(const pcl::PointXYZRGBNormal& inputPoint, const PixelData& rasterizerResult, const FaceModel& model, const Eigen::Matrix4f& pose, const Eigen::Matrix3f& intrinsics, const Eigen::Vector3f& colorDelta, double weight = 1.0)
+		: inputPoint(inputPoint), rasterizerResult(rasterizerResult), model(model), pose(pose), intrinsics(intrinsics), colorDelta(colorDelta),
+		residualScale(std::sqrt(weight)) {}
+
+	// Norm of all residuals of the pixel, without pose correction and with the barycentric coordinates of
+	// the rasterization, which equal the functors' for the rasterized parameters. Zero if Steve isn't
+	// rendered into the pixel.
+	double residualNorm(const ModelRank& rank, const double* alpha, const double* beta) const {
+		return dispatchRank(rank, [&](auto fixedRank) { return residualNorm<decltype(fixedRank)>(alpha, beta); });
+	}
+
+	template <typename Rank>
+	double residualNorm(const double* alpha, const double* beta) const {
+		if (!rasterizerResult.isValid) {
+			return 0.0;
+		}
+		Vector3T<double> vertexWorldPositions[3];
+		Vector2T<double> vertexScreenPositions[3];
+		Vector3T<double> vertexAlbedos[3];
+		computeVertexPositions<Rank::NUM_ALPHA>(alpha, (const double*)nullptr, (const double*)nullptr, vertexWorldPositions, vertexScreenPositions);
+		computeVertexAlbedos<Rank::NUM_BETA>(beta, vertexAlbedos);
+		Vector3T<double> worldPos = Vector3T<double>::Zero();
+		Vector3T<double> albedo = Vector3T<double>::Zero();
+		for (int i = 0; i < 3; i++) {
+			worldPos += double(rasterizerResult.barycentricCoordinates(i)) * vertexWorldPositions[i];
+			albedo += double(rasterizerResult.barycentricCoordinates(i)) * vertexAlbedos[i];
+		}
+		double residual[NUM_DENSE_RESIDUALS];
+		writeGeometryResiduals(worldPos, residual);
+		writeColorResiduals(albedo, residual + 4);
+		return Eigen::Map<const Eigen::Matrix<double, NUM_DENSE_RESIDUALS, 1>>(residual).norm();
+	}
+
+protected:
+	template <typename T> using Vector2T = Eigen::Matrix<T, 2, 1>;
+	template <typename T> using Vector3T = Eigen::Matrix<T, 3, 1>;
+
+	// World and screen positions of the vertices of the triangle at this pixel from the first NumAlpha
+	// coefficients, with the pose correction applied if rotation isn't null.
+	template <int NumAlpha, typename T>
+	void computeVertexPositions(T const* alpha, T const* rotation, T const* translation, Vector3T<T>* outWorld, Vector2T<T>* outScreen) const {
+		Vector3T<T> center;
+		if (rotation) {
+			center = (pose.topLeftCorner<3, 3>() * model.m_averageCenter + pose.topRightCorner<3, 1>()).cast<T>();
+		}
+		for (int i = 0; i < 3; i++) {
+			int vertexIndex = rasterizerResult.vertexIndices[i];
+			// Vertex position of average face.
+			Vector3T<T> pos = model.m_averageMesh.vertices.segment(3 * vertexIndex, 3).cast<T>();
+			// Displace by applying alpha.
+			for (int j = 0; j < NumAlpha; j++) {
+				T std = T(model.m_shapeStd(j));
+				pos += model.m_shapeBasis.block(3 * vertexIndex, j, 3, 1).cast<T>() * std * alpha[j];
+			}
+
+			// Transform to world space.
+			outWorld[i] = pose.topLeftCorner<3, 3>().cast<T>() * pos + pose.topRightCorner<3, 1>().cast<T>();
+			if (rotation) {
+				Vector3T<T> offset = outWorld[i] - center;
+				Vector3T<T> corrected;
+				ceres::QuaternionRotatePoint(rotation, offset.data(), corrected.data());
+				outWorld[i] = corrected + center + Vector3T<T>(translation[0], translation[1], translation[2]);
+			}
+			// Transform to screen space.
+			Vector3T<T> projectedPos = intrinsics.cast<T>() * outWorld[i];
+			outScreen[i] = ((projectedPos.template head<2>() / projectedPos.z()).array()).matrix();
+		}
+	}
+
+	// Albedos of the vertices of the triangle at this pixel from the first NumBeta coefficients.
+	template <int NumBeta, typename T>
+	void computeVertexAlbedos(T const* beta, Vector3T<T>* outAlbedos) const {
+		for (int i = 0; i < 3; i++) {
+			int vertexIndex = rasterizerResult.vertexIndices[i];
+			// Albedo of average face (ignore alpha).
+			outAlbedos[i] = model.m_averageMesh.vertexColors.col(vertexIndex).head<3>().cast<T>();
+			// Apply beta to albedo.
+			for (int j = 0; j < NumBeta; j++) {
+				T std = T(model.m_albedoStd(j));
+				outAlbedos[i] += model.m_albedoBasis.block(3 * vertexIndex, j, 3, 1).cast<T>() * std * beta[j];
+			}
+		}
+	}
+
+	// Barycentric coordinates of the pixel center in the projected triangle.
+	template <typename T>
+	void computeBarycentricCoordinates(const Vector2T<T>* screen, T* outCoordinates) const {
+		Eigen::Matrix<T, 2, 2> mT;
+		mT << (screen[0] - screen[2]), (screen[1] - screen[2]);
+		Vector2T<T> b = mT.inverse() * (rasterizerResult.pixelCenter.cast<T>() - screen[2]);
+		outCoordinates[0] = b(0);
+		outCoordinates[1] = b(1);
+		outCoordinates[2] = T(1.0f) - b(0) - b(1);
+	}
+
+	// Point to point (0-2) and point to plane (3) distance to the input.
+	template <typename T>
+	void writeGeometryResiduals(const Vector3T<T>& worldPos, T* residual) const {
+		Vector3T<T> inputPos = Vector3T<T>(T(inputPoint.x), T(inputPoint.y), T(inputPoint.z));
+		Vector3T<T> pointToPointDist = inputPos - worldPos;
+		residual[0] = pointToPointDist(0);
+		residual[1] = pointToPointDist(1);
+		residual[2] = pointToPointDist(2);
+		residual[3] = pointToPointDist(0)*T(inputPoint.normal_x) + pointToPointDist(1)*T(inputPoint.normal_y) + pointToPointDist(2)*T(inputPoint.normal_z);
+		if (residualScale != 1.0) {
+			for (int i = 0; i < 4; i++) {
+				residual[i] *= T(residualScale);
+			}
+		}
+	}
+
+	// Color difference to the input (0-2), corrected by the lighting difference.
+	template <typename T>
+	void writeColorResiduals(const Vector3T<T>& albedo, T* residual) const {
+		Vector3T<T> inputCol = Vector3T<T>(T(inputPoint.r), T(inputPoint.g), T(inputPoint.b));
+		Vector3T<T> colorDist = (inputCol - albedo + colorDelta.cast<T>()) * T(residualScale / 255.0);
+		residual[0] = colorDist(0);
+		residual[1] = colorDist(1);
+		residual[2] = colorDist(2);
+	}
+
+	// Input pixel that this residual is computing.
+	const pcl::PointXYZRGBNormal& inputPoint;
+
+	const FaceModel& model;
+	const Eigen::Matrix4f& pose;
+	const Eigen::Matrix3f& intrinsics;
+	const Eigen::Vector3f& colorDelta;
+
+	// Rasterization result for this pixel.
+	const PixelData& rasterizerResult;
+
+	// Square root of the weight.
+	double residualScale;
+};
+
+// All residuals of a pixel over alpha and beta: positions (0-2), colors (3-5) and point to plane (6).
+// The colors depend on alpha through the barycentric coordinates. Rank is a FixedRank.
+template <typename Rank>
+struct ResidualFunctor : public PixelResidual {
+	static const int NUM_RESIDUALS = NUM_DENSE_RESIDUALS;
+
+	using PixelResidual::PixelResidual;
+	explicit ResidualFunctor(const PixelResidual& pixel) : PixelResidual(pixel) {}
+
+	// Residuals for a fixed pose.
+	template <typename T>
+	bool operator()(T const* alpha, T const* beta, T* residual) const {
+		return evaluate(alpha, beta, (T const*)nullptr, (T const*)nullptr, residual);
+	}
+
+	// Residuals with a pose correction (rotation quaternion and translation) applied after the pose.
+	template <typename T>
+	bool operator()(T const* alpha, T const* beta, T const* rotation, T const* translation, T* residual) const {
+		return evaluate(alpha, beta, rotation, translation, residual);
+	}
+
+private:
+	template <typename T>
+	bool evaluate(T const* alpha, T const* beta, T const* rotation, T const* translation, T* residual) const {
+		if (!rasterizerResult.isValid) {
+			// Skip pixels where Steve isn't rendered into.
+			std::fill(residual, residual + NUM_RESIDUALS, T(0));
+			return true;
+		}
+
+		Vector3T<T> vertexWorldPositions[3];
+		Vector2T<T> vertexScreenPositions[3];
+		Vector3T<T> vertexAlbedos[3];
+		computeVertexPositions<Rank::NUM_ALPHA>(alpha, rotation, translation, vertexWorldPositions, vertexScreenPositions);
+		computeVertexAlbedos<Rank::NUM_BETA>(beta, vertexAlbedos);
+		T barycentricCoordinates[3];
+		computeBarycentricCoordinates(vertexScreenPositions, barycentricCoordinates);
+
+		// Interpolate final values for this pixel.
+		Vector3T<T> worldPos = Vector3T<T>::Zero();
+		Vector3T<T> albedo = Vector3T<T>::Zero();
+		for (int i = 0; i < 3; i++) {
+			worldPos += barycentricCoordinates[i] * vertexWorldPositions[i];
+			albedo += barycentricCoordinates[i] * vertexAlbedos[i];
+		}
+
+		T geometry[4];
+		writeGeometryResiduals(worldPos, geometry);
+		std::copy(geometry, geometry + 3, residual);
+		residual[6] = geometry[3];
+		writeColorResiduals(albedo, residual + 3);
+		return true;
+	}
+};
+
+// Geometry residuals of a pixel (point to point 0-2, point to plane 3), over alpha and the pose correction.
+template <typename Rank>
+struct GeometryResidualFunctor : public PixelResidual {
+	static const int NUM_RESIDUALS = 4;
+
+	explicit GeometryResidualFunctor(const PixelResidual& pixel) : PixelResidual(pixel) {}
+
+	template <typename T>
+	bool operator()(T const* alpha, T* residual) const {
+		return evaluate(alpha, (T const*)nullptr, (T const*)nullptr, residual);
+	}
+
+	template <typename T>
+	bool operator()(T const* alpha, T const* rotation, T const* translation, T* residual) const {
+		return evaluate(alpha, rotation, translation, residual);
+	}
+
+private:
+	template <typename T>
+	bool evaluate(T const* alpha, T const* rotation, T const* translation, T* residual) const {
+		if (!rasterizerResult.isValid) {
+			std::fill(residual, residual + NUM_RESIDUALS, T(0));
+			return true;
+		}
+
+		Vector3T<T> vertexWorldPositions[3];
+		Vector2T<T> vertexScreenPositions[3];
+		computeVertexPositions<Rank::NUM_ALPHA>(alpha, rotation, translation, vertexWorldPositions, vertexScreenPositions);
+		T barycentricCoordinates[3];
+		computeBarycentricCoordinates(vertexScreenPositions, barycentricCoordinates);
+
+		Vector3T<T> worldPos = Vector3T<T>::Zero();
+		for (int i = 0; i < 3; i++) {
+			worldPos += barycentricCoordinates[i] * vertexWorldPositions[i];
+		}
+		writeGeometryResiduals(worldPos, residual);
+		return true;
+	}
+};
+
+// Color residuals of a pixel (0-2) over beta only. The barycentric coordinates are those of the last
+// rasterization, so they are held fixed within an iteration instead of following alpha.
+template <typename Rank>
+struct ColorResidualFunctor : public PixelResidual {
+	static const int NUM_RESIDUALS = 3;
+
+	explicit ColorResidualFunctor(const PixelResidual& pixel) : PixelResidual(pixel) {}
+
+	template <typename T>
+	bool operator()(T const* beta, T* residual) const {
+		if (!rasterizerResult.isValid) {
+			std::fill(residual, residual + NUM_RESIDUALS, T(0));
+			return true;
+		}
+
+		Vector3T<T> vertexAlbedos[3];
+		computeVertexAlbedos<Rank::NUM_BETA>(beta, vertexAlbedos);
+		Vector3T<T> albedo = Vector3T<T>::Zero();
+		for (int i = 0; i < 3; i++) {
+			albedo += T(rasterizerResult.barycentricCoordinates(i)) * vertexAlbedos[i];
+		}
+		writeColorResiduals(albedo, residual);
+		return true;
+	}
+};
+
+// Residuals of all pixels of an image tile in one block. Ceres keeps track of far fewer blocks and
+// Jacobian pointers this way, and evaluates the pixels of a tile in one pass.
+template <typename PixelFunctor>
+struct TileResidualFunctor {
+	std::vector<PixelFunctor> pixels;
+
+	template <typename T>
+	bool operator()(T const* p0, T* residual) const {
+		for (size_t i = 0; i < pixels.size(); i++) {
+			pixels[i](p0, residual + PixelFunctor::NUM_RESIDUALS * i);
+		}
+		return true;
+	}
+
+	template <typename T>
+	bool operator()(T const* p0, T const* p1, T* residual) const {
+		for (size_t i = 0; i < pixels.size(); i++) {
+			pixels[i](p0, p1, residual + PixelFunctor::NUM_RESIDUALS * i);
+		}
+		return true;
+	}
+
+	template <typename T>
+	bool operator()(T const* p0, T const* p1, T const* p2, T* residual) const {
+		for (size_t i = 0; i < pixels.size(); i++) {
+			pixels[i](p0, p1, p2, residual + PixelFunctor::NUM_RESIDUALS * i);
+		}
+		return true;
+	}
+
+	template <typename T>
+	bool operator()(T const* p0, T const* p1, T const* p2, T const* p3, T* residual) const {
+		for (size_t i = 0; i < pixels.size(); i++) {
+			pixels[i](p0, p1, p2, p3, residual + PixelFunctor::NUM_RESIDUALS * i);
+		}
+		return true;
+	}
+};
+
+// The factors are those of the default rank for all ranks, so the prior of a coefficient doesn't change
+// with the rank.
+template <typename Rank>
+struct RegularizerFunctor
+{
+	static const int NUM_RESIDUALS = Rank::NUM_ALPHA + Rank::NUM_BETA;
+
+	template <typename T>
+	bool operator()(T const* alpha, T const* beta, T* residual) const {
+		T factor = T(gSettings.regStrengthAlpha / NUM_ALPHA_VEC);
+		for (int i = 0; i < Rank::NUM_ALPHA; i++) {
+			residual[i] = factor * alpha[i];
+		}
+		factor = T(gSettings.regStrengthBeta / NUM_BETA_VEC);
+		for (int i = 0; i < Rank::NUM_BETA; i++) {
+			residual[Rank::NUM_ALPHA + i] = factor * beta[i];
+		}
+		return true;
+	}
+};
+
+// Adds the residuals of every stride-th valid input pixel of the organized cloud, using the
+// rasterization results of the same frame size. If a sampler is given, only its sample of these pixels
+// is added, with its weights. With a tile size, the pixels of each tileSize x tileSize image tile share
+// one residual block, otherwise every pixel gets its own. With separateColor, geometry and color get
+// separate blocks over alpha and beta (see ColorResidualFunctor), otherwise one block covers both.
+// The pose correction is optimized if rotation and translation are not null. alpha and beta have the
+// coefficients of the rank.
+// Returns the number of pixels added.
+unsigned int addPixelResidualBlocks(ceres::Problem& problem, const pcl::PointCloud<pcl::PointXYZRGBNormal>& cloud,
+	const std::vector<PixelData>& pixelResults, const FaceModel& model, const Eigen::Matrix4f& pose,
+	const Eigen::Matrix3f& intrinsics, const Eigen::Vector3f& colorDelta, unsigned int stride, unsigned int tileSize,
+	bool separateColor, PixelSampler* sampler, const ModelRank& rank, double* alpha, double* beta,
+	double* rotation = nullptr, double* translation = nullptr);
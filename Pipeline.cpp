@@ -0,0 +1,82 @@
+#include "stdafx.h"
+#include "Pipeline.h"
+#include "CoarseAlignment.h"
+#include "Settings.h"
+#include "Profiler.h"
+#include "Log.h"
+
+ReconstructionOptions ReconstructionOptions::fromSettings() {
+	ReconstructionOptions options;
+	options.skipICP = gSettings.skipICP;
+	options.skipOptimization = gSettings.skipOptimization;
+	options.timeBudgetMs = gSettings.timeBudgetMs;
+	return options;
+}
+
+ReconstructionResult reconstructFace(const FaceModel& model, const Sensor& inputSensor, FitWorkspace* workspace, const ReconstructionOptions& options) {
+	PROFILE_SCOPE("reconstruction");
+	ReconstructionResult result;
+	auto ms = [](std::chrono::high_resolution_clock::time_point from, std::chrono::high_resolution_clock::time_point to) {
+		return std::chrono::duration<double, std::milli>(to - from).count();
+	};
+
+	const bool budgeted = options.timeBudgetMs > 0;
+	result.budget.budgetMs = budgeted ? options.timeBudgetMs : 0.0;
+
+	LOG_INFO << "Coarse alignment ...";
+	auto timeStart = std::chrono::high_resolution_clock::now();
+	result.poseWithoutICP = computeCoarseAlignmentProcrustes(model, inputSensor);
+	auto timeProcrustes = std::chrono::high_resolution_clock::now();
+	result.pose = result.poseWithoutICP;
+	const bool icpOverBudget = budgeted && !options.skipICP
+		&& !StageCostModel::instance().planICP(0.5 * (options.timeBudgetMs - ms(timeStart, timeProcrustes)));
+	if (options.skipICP) {
+		LOG_INFO << "Skipping ICP.";
+	}
+	else if (icpOverBudget) {
+		LOG_INFO << "Skipping ICP to meet the time budget.";
+		result.budget.cuts.push_back("icp skipped");
+	}
+	else {
+		result.pose = computeCoarseAlignmentICP(model, inputSensor, result.poseWithoutICP);
+	}
+	auto timeICP = std::chrono::high_resolution_clock::now();
+	if (!options.skipICP && !icpOverBudget) {
+		StageCostModel::instance().addICP(ms(timeProcrustes, timeICP));
+	}
+
+	if (options.skipOptimization) {
+		LOG_INFO << "Skipping parameter optimization.";
+		result.params = model.createDefaultParameters();
+	}
+	else {
+		LOG_INFO << "Optimizing parameters ...";
+		OptimizerOptions optimizerOptions;
+		optimizerOptions.workspace = workspace;
+		// Whatever is left; at least a moment, so the optimizer reports what it had to skip.
+		optimizerOptions.timeBudgetMs = budgeted ? std::max(options.timeBudgetMs - ms(timeStart, timeICP), 1e-3) : 0.0;
+		result.params = optimizeParameters(model, result.pose, inputSensor, optimizerOptions, &result.optimizerReport);
+		result.pose = result.optimizerReport.refinedPose;
+		result.budget.cuts.insert(result.budget.cuts.end(), result.optimizerReport.budgetCuts.begin(), result.optimizerReport.budgetCuts.end());
+	}
+	auto timeOptimization = std::chrono::high_resolution_clock::now();
+
+	result.timings.procrustesMs = ms(timeStart, timeProcrustes);
+	result.timings.icpMs = ms(timeProcrustes, timeICP);
+	result.timings.optimizationMs = ms(timeICP, timeOptimization);
+	result.timings.totalMs = ms(timeStart, timeOptimization);
+
+	LOG_INFO << "Timings: procrustes " << result.timings.procrustesMs << " ms, icp "
+		<< (options.skipICP ? "skipped" : std::to_string(result.timings.icpMs) + " ms")
+		<< ", optimization " << result.timings.optimizationMs << " ms, total " << result.timings.totalMs << " ms";
+	if (budgeted) {
+		result.budget.met = result.timings.totalMs <= options.timeBudgetMs;
+		std::string cuts;
+		for (const std::string& cut : result.budget.cuts) {
+			cuts += (cuts.empty() ? "" : ", ") + cut;
+		}
+		LOG_INFO << "Time budget " << options.timeBudgetMs << " ms " << (result.budget.met ? "met" : "missed")
+			<< (cuts.empty() ? "" : " (" + cuts + ")");
+	}
+	return result;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "FaceModel.h"
+#include "Sensor.h"
+#include "Optimizer.h"
+#include "TimeBudget.h"
+
+// Wall time of the pipeline stages of one reconstruction, in milliseconds.
+struct StageTimings {
+	double procrustesMs = 0;
+	double icpMs = 0;
+	double optimizationMs = 0;
+	double totalMs = 0;
+};
+
+struct ReconstructionResult {
+	FaceParameters params;
+	// Final pose of the face.
+	Eigen::Matrix4f pose;
+	// Pose after Procrustes, before ICP and pose refinement.
+	Eigen::Matrix4f poseWithoutICP;
+	StageTimings timings;
+	// Solver statistics, zero if the optimization was skipped.
+	OptimizerReport optimizerReport;
+	BudgetReport budget;
+};
+
+// Stages to run for one reconstruction. The daemon overrides the settings per request.
+struct ReconstructionOptions {
+	bool skipICP;
+	bool skipOptimization;
+	// Wall time of the reconstruction (0 = unlimited). ICP is skipped if it isn't expected to leave
+	// half of the time to the optimization, which gets the rest (see OptimizerOptions::timeBudgetMs).
+	double timeBudgetMs;
+
+	static ReconstructionOptions fromSettings();
+};
+
+// Runs coarse alignment and parameter optimization on one input.
+// The workspace is optional, batch workers pass their own to reuse its buffers.
+ReconstructionResult reconstructFace(const FaceModel& model, const Sensor& inputSensor, FitWorkspace* workspace = nullptr,
+	const ReconstructionOptions& options = ReconstructionOptions::fromSettings());
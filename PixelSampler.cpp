@@ -0,0 +1,92 @@
+#include "stdafx.h"
+#include <algorithm>
+#include <numeric>
+#include "PixelSampler.h"
+
+void PixelSampler::sample(const std::vector<unsigned int>& candidates, const std::vector<double>& norms, unsigned int width,
+	std::vector<PixelSample>& outSample) {
+	outSample.clear();
+	if (budget == 0 || candidates.size() <= budget) {
+		outSample.reserve(candidates.size());
+		for (unsigned int index : candidates) {
+			outSample.push_back({ index, 1.0 });
+		}
+		return;
+	}
+
+	// Relative sampling density of each candidate, 1 on average.
+	std::vector<double> density(candidates.size(), 1.0);
+	const bool weighted = importance && norms.size() == candidates.size();
+	if (weighted) {
+		const double meanNorm = std::accumulate(norms.begin(), norms.end(), 0.0) / norms.size();
+		if (meanNorm > 0) {
+			for (size_t i = 0; i < candidates.size(); i++) {
+				density[i] = 0.5 + 0.5 * norms[i] / meanNorm;
+			}
+		}
+	}
+
+	// Candidates (positions in the candidate list) per stratum.
+	std::vector<std::vector<unsigned int>> strata(1);
+	if (tileSize > 0) {
+		const unsigned int tilesX = (width + tileSize - 1) / tileSize;
+		const unsigned int tilesY = (*std::max_element(candidates.begin(), candidates.end()) / width) / tileSize + 1;
+		strata.resize(tilesX * tilesY);
+		for (unsigned int i = 0; i < candidates.size(); i++) {
+			const unsigned int x = candidates[i] % width;
+			const unsigned int y = candidates[i] / width;
+			strata[(y / tileSize) * tilesX + x / tileSize].push_back(i);
+		}
+	}
+	else {
+		strata[0].resize(candidates.size());
+		std::iota(strata[0].begin(), strata[0].end(), 0u);
+	}
+
+	const double totalMass = std::accumulate(density.begin(), density.end(), 0.0);
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	std::vector<double> cumulative;
+	outSample.reserve(budget + strata.size());
+	for (std::vector<unsigned int>& stratum : strata) {
+		if (stratum.empty()) {
+			continue;
+		}
+		double mass = 0;
+		for (unsigned int i : stratum) {
+			mass += density[i];
+		}
+		// Share of the budget, rounded up or down at random so the expected total is the budget. The weights
+		// divide by the expected count rather than the drawn one (Horvitz-Thompson), so strata that draw
+		// nothing in one iteration are made up for by the larger weights of the iterations that draw some.
+		const double share = budget * mass / totalMass;
+		const unsigned int count = unsigned(share) + (uniform(rng) < share - std::floor(share) ? 1u : 0u);
+
+		if (!weighted) {
+			// Uniform without replacement (partial Fisher-Yates shuffle). A stratum smaller than its share
+			// is taken whole.
+			const unsigned int drawn = std::min(count, unsigned(stratum.size()));
+			const double weight = double(stratum.size()) / std::min(share, double(stratum.size()));
+			for (unsigned int k = 0; k < drawn; k++) {
+				std::swap(stratum[k], stratum[k + rng() % (stratum.size() - k)]);
+				outSample.push_back({ candidates[stratum[k]], weight });
+			}
+		}
+		else if (count > 0) {
+			// By density, with replacement.
+			cumulative.resize(stratum.size());
+			double sum = 0;
+			for (size_t k = 0; k < stratum.size(); k++) {
+				sum += density[stratum[k]];
+				cumulative[k] = sum;
+			}
+			for (unsigned int k = 0; k < count; k++) {
+				size_t pick = std::upper_bound(cumulative.begin(), cumulative.end(), uniform(rng) * sum) - cumulative.begin();
+				pick = std::min(pick, stratum.size() - 1);
+				const unsigned int i = stratum[pick];
+				outSample.push_back({ candidates[i], mass / (share * density[i]) });
+			}
+		}
+	}
+	// Frame order, for memory locality when evaluating.
+	std::sort(outSample.begin(), outSample.end(), [](const PixelSample& a, const PixelSample& b) { return a.index < b.index; });
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <random>
+#include <vector>
+
+// A sampled pixel of an organized frame (index y * width + x) and the weight of its residuals.
+struct PixelSample {
+	unsigned int index;
+	double weight;
+};
+
+// Draws a fixed budget of pixels from the candidates of every iteration, so the cost of an iteration
+// is bounded by the budget rather than by the size of the face in pixels. The weights make weighted
+// sums over a sample unbiased estimates of the sums over all candidates, so costs and the balance
+// with the regularizer don't change with the budget.
+// With strata, the budget is split among square screen tiles by their share of the candidates, which
+// spreads the sample evenly over the face. With importance, pixels are drawn with a density of half
+// uniform and half proportional to their residual norm, so the weights of pixels with small residuals
+// stay bounded. The random sequence only depends on the seed.
+class PixelSampler {
+public:
+	// budget 0 keeps all candidates. tileSize 0 doesn't stratify.
+	PixelSampler(unsigned int budget, unsigned int tileSize, bool importance, unsigned int seed)
+		: budget(budget), tileSize(tileSize), importance(importance), rng(seed) {}
+
+	// Whether sample() needs the residual norms of the candidates.
+	bool usesImportance() const { return importance && budget > 0; }
+
+	// Candidates are pixel indices in a frame of the given width; norms are their residual norms if
+	// usesImportance(), otherwise ignored.
+	void sample(const std::vector<unsigned int>& candidates, const std::vector<double>& norms, unsigned int width,
+		std::vector<PixelSample>& outSample);
+
+private:
+	unsigned int budget;
+	unsigned int tileSize;
+	bool importance;
+	std::mt19937 rng;
+};
@@ -0,0 +1,135 @@
+#include "stdafx.h"
+#include "Profiler.h"
+#include "Log.h"
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+// Small sequential thread ids for the trace, instead of the opaque std::thread::id.
+static int currentThreadIndex() {
+	static std::atomic<int> nextIndex{ 0 };
+	static thread_local int index = nextIndex++;
+	return index;
+}
+
+// Resident set size and its peak in MB.
+static void queryMemory(double& outResidentMB, double& outPeakMB) {
+	outResidentMB = 0;
+	outPeakMB = 0;
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		outResidentMB = counters.WorkingSetSize / (1024.0 * 1024.0);
+		outPeakMB = counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+	}
+#else
+	std::ifstream statm("/proc/self/statm");
+	size_t totalPages, residentPages;
+	if (statm >> totalPages >> residentPages) {
+		outResidentMB = residentPages * double(sysconf(_SC_PAGESIZE)) / (1024.0 * 1024.0);
+	}
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+		outPeakMB = usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+		outPeakMB = usage.ru_maxrss / 1024.0;
+#endif
+	}
+#endif
+}
+
+Profiler& Profiler::instance() {
+	static Profiler profiler;
+	return profiler;
+}
+
+void Profiler::recordEvent(const char* name, Clock::time_point start, Clock::time_point end) {
+	int thread = currentThreadIndex();
+	double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (events.size() < MAX_EVENTS) {
+		events.push_back(Event{ name, start, end, thread });
+	}
+	StageTotals& stage = totals[name];
+	stage.count++;
+	stage.totalMs += ms;
+	stage.maxMs = std::max(stage.maxMs, ms);
+}
+
+void Profiler::recordMemory(const char* label) {
+	if (!enabled) {
+		return;
+	}
+	MemorySample sample{ label, Clock::now(), 0, 0 };
+	queryMemory(sample.residentMB, sample.peakMB);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (memorySamples.size() < MAX_EVENTS) {
+		memorySamples.push_back(sample);
+	}
+}
+
+void Profiler::writeJson(std::ostream& out) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	out << "{\"stages\": {";
+	bool first = true;
+	for (const auto& stage : totals) {
+		out << (first ? "" : ", ") << "\"" << stage.first << "\": {\"count\": " << stage.second.count
+			<< ", \"total_ms\": " << stage.second.totalMs
+			<< ", \"mean_ms\": " << stage.second.totalMs / stage.second.count
+			<< ", \"max_ms\": " << stage.second.maxMs << "}";
+		first = false;
+	}
+
+	double peakMB = 0;
+	out << "}, \"memory\": [";
+	for (size_t i = 0; i < memorySamples.size(); i++) {
+		const MemorySample& sample = memorySamples[i];
+		out << (i > 0 ? ", " : "") << "{\"after\": \"" << sample.label << "\", \"rss_mb\": " << sample.residentMB
+			<< ", \"peak_rss_mb\": " << sample.peakMB << "}";
+		peakMB = std::max(peakMB, sample.peakMB);
+	}
+	out << "], \"peak_rss_mb\": " << peakMB << "}" << std::endl;
+}
+
+void Profiler::writeChromeTrace(std::ostream& out) const {
+	auto micros = [this](Clock::time_point time) {
+		return std::chrono::duration<double, std::micro>(time - startTime).count();
+	};
+
+	std::lock_guard<std::mutex> lock(mutex);
+	out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+	bool first = true;
+	for (const Event& event : events) {
+		out << (first ? "" : ",") << "\n{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread
+			<< ", \"ts\": " << micros(event.start) << ", \"dur\": " << micros(event.end) - micros(event.start) << "}";
+		first = false;
+	}
+	for (const MemorySample& sample : memorySamples) {
+		out << (first ? "" : ",") << "\n{\"name\": \"memory\", \"ph\": \"C\", \"pid\": 1, \"ts\": " << micros(sample.time)
+			<< ", \"args\": {\"rss_mb\": " << sample.residentMB << "}}";
+		first = false;
+	}
+	out << "\n]}" << std::endl;
+}
+
+void writeProfilerReports(const std::string& jsonFile, const std::string& traceFile) {
+	Profiler& profiler = Profiler::instance();
+	if (!jsonFile.empty()) {
+		std::ofstream out(jsonFile);
+		profiler.writeJson(out);
+		LOG_INFO << "Profile written to " << jsonFile;
+	}
+	if (!traceFile.empty()) {
+		std::ofstream out(traceFile);
+		profiler.writeChromeTrace(out);
+		LOG_INFO << "Trace written to " << traceFile;
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Collects timed pipeline stages and memory samples. Disabled by default, then recording is a no-op.
+// Thread-safe; events remember the recording thread, so concurrent jobs show up as separate tracks.
+class Profiler {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	static Profiler& instance();
+
+	void setEnabled(bool enabled) { this->enabled = enabled; }
+	bool isEnabled() const { return enabled; }
+
+	void recordEvent(const char* name, Clock::time_point start, Clock::time_point end);
+	// Samples the resident and peak memory of the process after the given stage.
+	void recordMemory(const char* label);
+
+	// Per-stage count, total, mean and max time, plus the memory samples.
+	void writeJson(std::ostream& out) const;
+	// Chrome trace event format (chrome://tracing, Perfetto).
+	void writeChromeTrace(std::ostream& out) const;
+
+private:
+	struct Event {
+		const char* name;
+		Clock::time_point start;
+		Clock::time_point end;
+		int thread;
+	};
+	struct StageTotals {
+		size_t count = 0;
+		double totalMs = 0;
+		double maxMs = 0;
+	};
+	struct MemorySample {
+		const char* label;
+		Clock::time_point time;
+		double residentMB;
+		double peakMB;
+	};
+
+	// Keep memory bounded for long-running processes, the totals are kept for all events.
+	static const size_t MAX_EVENTS = 1000000;
+
+	std::atomic<bool> enabled{ false };
+	const Clock::time_point startTime = Clock::now();
+	mutable std::mutex mutex;
+	std::vector<Event> events;
+	std::map<std::string, StageTotals> totals;
+	std::vector<MemorySample> memorySamples;
+};
+
+// Records the lifetime of a scope as one event. The name must be a string literal.
+class ScopedTimer {
+public:
+	explicit ScopedTimer(const char* name) : name(name), start(Profiler::Clock::now()) {}
+	~ScopedTimer() {
+		Profiler& profiler = Profiler::instance();
+		if (profiler.isEnabled()) {
+			profiler.recordEvent(name, start, Profiler::Clock::now());
+		}
+	}
+
+private:
+	const char* name;
+	const Profiler::Clock::time_point start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ScopedTimer PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+// Writes the reports of the profiler to the given files (skipped if empty).
+void writeProfilerReports(const std::string& jsonFile, const std::string& traceFile);
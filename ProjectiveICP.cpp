@@ -0,0 +1,122 @@
+#include "stdafx.h"
+#include "ProjectiveICP.h"
+
+using namespace Eigen;
+
+typedef Matrix<double, 6, 6> Matrix6d;
+typedef Matrix<double, 6, 1> Vector6d;
+
+Matrix4f ProjectiveICP::estimatePose(const Matrix3Xf& sourcePoints, const Matrix3Xf& sourceNormals,
+	const pcl::PointCloud<pcl::PointXYZRGBNormal>& target, const Matrix4f& initialPose, ICPStats* stats) const {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	const int width = target.width;
+	const int height = target.height;
+	const int numPoints = sourcePoints.cols();
+	const float maxDistSq = maxCorrespondenceDistance * maxCorrespondenceDistance;
+
+	Matrix4f pose = initialPose;
+	ICPStats result;
+	result.numSourcePoints = numPoints;
+
+	for (int iteration = 0; iteration < maxIterations; iteration++) {
+		const Matrix3f linear = pose.topLeftCorner<3, 3>();
+		const Vector3f translation = pose.topRightCorner<3, 1>();
+		// Rotation without scale, for the normals.
+		const Matrix3f rotation = linear / std::cbrt(linear.determinant());
+
+		Matrix6d JtJ = Matrix6d::Zero();
+		Vector6d Jtr = Vector6d::Zero();
+		double sumSqDist = 0;
+		int numCorrespondences = 0;
+
+		#pragma omp parallel
+		{
+			Matrix6d localJtJ = Matrix6d::Zero();
+			Vector6d localJtr = Vector6d::Zero();
+			double localSumSqDist = 0;
+			int localCount = 0;
+
+			#pragma omp for nowait
+			for (int i = 0; i < numPoints; i++) {
+				Vector3f q = linear * sourcePoints.col(i) + translation;
+				if (q.z() <= 0) {
+					continue;
+				}
+
+				// Projective data association.
+				Vector3f projected = intrinsics * q;
+				int x = int(projected.x() / projected.z() + 0.5f);
+				int y = int(projected.y() / projected.z() + 0.5f);
+				if (x < 0 || y < 0 || x >= width || y >= height) {
+					continue;
+				}
+				const auto& t = target(x, y);
+				if (!std::isfinite(t.z) || !std::isfinite(t.normal_x)) {
+					continue;
+				}
+
+				Vector3f d(t.x, t.y, t.z);
+				Vector3f n(t.normal_x, t.normal_y, t.normal_z);
+				Vector3f diff = q - d;
+				if (diff.squaredNorm() > maxDistSq) {
+					continue;
+				}
+				// Normal orientation of the model isn't consistent with the input, so compare undirected normals.
+				if (std::abs((rotation * sourceNormals.col(i)).dot(n)) < minNormalCosine) {
+					continue;
+				}
+
+				// Point-to-plane residual, linearized for a small rotation w and translation v:
+				// r(w, v) = n . (q + w x q + v - d) = r + (q x n) . w + n . v
+				double r = n.dot(diff);
+				Vector6d J;
+				J.head<3>() = q.cross(n).cast<double>();
+				J.tail<3>() = n.cast<double>();
+				localJtJ.selfadjointView<Upper>().rankUpdate(J);
+				localJtr += J * r;
+				localSumSqDist += r * r;
+				localCount++;
+			}
+
+			#pragma omp critical
+			{
+				JtJ += localJtJ;
+				Jtr += localJtr;
+				sumSqDist += localSumSqDist;
+				numCorrespondences += localCount;
+			}
+		}
+
+		result.iterations = iteration + 1;
+		result.numCorrespondences = numCorrespondences;
+		result.rmse = numCorrespondences > 0 ? float(std::sqrt(sumSqDist / numCorrespondences)) : 0.0f;
+		if (numCorrespondences < 6) {
+			break;
+		}
+
+		Vector6d delta = JtJ.selfadjointView<Upper>().ldlt().solve(-Jtr);
+		Vector3f w = delta.head<3>().cast<float>();
+		Vector3f v = delta.tail<3>().cast<float>();
+
+		Matrix4f increment = Matrix4f::Identity();
+		float angle = w.norm();
+		if (angle > 0) {
+			increment.topLeftCorner<3, 3>() = AngleAxisf(angle, w / angle).toRotationMatrix();
+		}
+		increment.topRightCorner<3, 1>() = v;
+		pose = increment * pose;
+
+		if (delta.norm() < convergenceEpsilon) {
+			result.converged = true;
+			break;
+		}
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+	result.timeMs = std::chrono::duration<double, std::milli>(end - start).count();
+	if (stats) {
+		*stats = result;
+	}
+	return pose;
+}
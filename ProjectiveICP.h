@@ -0,0 +1,39 @@
+#pragma once
+#include <pcl/common/common.h>
+
+// Convergence and timing statistics of an ICP run.
+struct ICPStats {
+	int iterations = 0;
+	bool converged = false;
+	// Number of correspondences used in the last iteration, out of all source points.
+	int numCorrespondences = 0;
+	int numSourcePoints = 0;
+	// Root mean square point-to-plane distance of the last iteration.
+	float rmse = 0;
+	double timeMs = 0;
+};
+
+// Point-to-plane ICP for organized target clouds. Instead of searching nearest neighbors in a
+// kd-tree, each source point is projected into the target image with the camera intrinsics and
+// matched with the target point at that pixel (projective data association), which is O(1).
+// The pose is updated with a 6-DoF Gauss-Newton step on the linearized point-to-plane distances.
+class ProjectiveICP {
+public:
+	explicit ProjectiveICP(const Eigen::Matrix3f& intrinsics) : intrinsics(intrinsics) {}
+
+	int maxIterations = 20;
+	// Correspondences further apart than this (in meters) are rejected.
+	float maxCorrespondenceDistance = 0.02f;
+	// Correspondences whose normals enclose a larger angle are rejected (cosine of the angle).
+	float minNormalCosine = 0.5f;
+	// Stop once the update step is smaller than this.
+	float convergenceEpsilon = 1e-5f;
+
+	// Estimates the pose aligning the source points to the organized target cloud, starting at initialPose.
+	// The linear part of initialPose may contain a uniform scale, which is kept.
+	Eigen::Matrix4f estimatePose(const Eigen::Matrix3Xf& sourcePoints, const Eigen::Matrix3Xf& sourceNormals,
+		const pcl::PointCloud<pcl::PointXYZRGBNormal>& target, const Eigen::Matrix4f& initialPose, ICPStats* stats = nullptr) const;
+
+private:
+	const Eigen::Matrix3f intrinsics;
+};
@@ -1,5 +1,8 @@
 #include "stdafx.h"
 #include "Rasterizer.h"
+#include "Settings.h"
+#include "Profiler.h"
+#include "Log.h"
 
 using namespace Eigen;
 
@@ -24,27 +27,37 @@ public:
 
 
 void Rasterizer::compute(const FaceParameters& params) {
-	std::cout << "          Alpha: " << params.alpha.head<4>().transpose() << std::endl;
-	std::cout << "          Beta: " << params.beta.head<4>().transpose() << ", etc." << std::endl;
-	std::cout << "          Rasterization: project ..." << std::flush;
-
 	Matrix3Xf projectedVertices;
 	Matrix4Xi vertexAlbedos;
 	Matrix3Xf worldNormals;
-	project(params, projectedVertices, vertexAlbedos, worldNormals);
-	rasterize(projectedVertices, vertexAlbedos, worldNormals);
+	{
+		PROFILE_SCOPE("rasterizer project");
+		project(params, projectedVertices, vertexAlbedos, worldNormals);
+	}
+	{
+		PROFILE_SCOPE("rasterizer rasterize");
+		rasterize(projectedVertices, vertexAlbedos, worldNormals);
+	}
+
+	LOG_DEBUG << "Rasterization " << numCalls << ": alpha " << params.alpha.head(std::min<Index>(4, params.alpha.size())).transpose()
+		<< ", beta " << params.beta.head(std::min<Index>(4, params.beta.size())).transpose()
+		<< ", etc., valid pixels: " << std::count_if(pixelResults.begin(), pixelResults.end(), [](const PixelData& px) { return px.isValid; });
+	if (gSettings.debugImages) {
+		PROFILE_SCOPE("rasterizer debug images");
+		writeDebugImages();
+	}
 
 	numCalls++;
 }
 
 void Rasterizer::project(const FaceParameters& params, Matrix3Xf& outProjectedVertices, Matrix4Xi& outVertexAlbedos, Matrix3Xf& outWorldNormals) {
-	VectorXf flatVertices = model.computeShape(params);
+	VectorXf flatVertices = hasRank ? model.computeShape(params, rank) : model.computeShape(params);
 	Matrix3Xf worldVertices = pose.topLeftCorner<3, 3>() * Map<Matrix3Xf>(flatVertices.data(), 3, model.getNumVertices());
 	worldVertices.colwise() += pose.topRightCorner<3, 1>();
 	// Project to screen space.
 	outProjectedVertices = intrinsics * worldVertices;
 
-	outVertexAlbedos = model.computeColors(params);
+	outVertexAlbedos = hasRank ? model.computeColors(params, rank) : model.computeColors(params);
 
 	Matrix3Xf normals = model.computeNormals(flatVertices);
 	// Only apply rotation of pose to normals.
@@ -55,9 +68,7 @@ void Rasterizer::rasterize(const Matrix3Xf& projectedVertices, const Matrix4Xi&
 	// Reset output.
 	std::fill(pixelResults.begin(), pixelResults.end(), PixelData());
 
-	std::cout << " rasterize ..." << std::flush;
-
-	ArrayXXf depthBuffer(frameSize.x(), frameSize.y());
+	ArrayXXf& depthBuffer = buffers.depthBuffer;
 	depthBuffer.setConstant(std::numeric_limits<float>::infinity());
 
 	Vector3f L = Vector3f(0, 0, -1);
@@ -131,11 +142,6 @@ void Rasterizer::rasterize(const Matrix3Xf& projectedVertices, const Matrix4Xi&
 			}
 		}
 	}
-
-	size_t filledPx = std::count_if(pixelResults.begin(), pixelResults.end(), [](const PixelData& px) { return px.isValid; });
-	std::cout << " (valid pixels: " << filledPx << ")";
-	writeDebugImages();
-	std::cout << " done!" << std::endl;
 }
 
 
@@ -154,7 +160,7 @@ Vector3f Rasterizer::getAverageColor() {
 
 
 void Rasterizer::writeDebugImages() {
-	std::cout << " saving bmp ..." << std::flush;
+	ArrayXXf& depthBuffer = buffers.depthBuffer;
 	BMP bmp(frameSize.x(), frameSize.y());
 	BMP bmpCol(frameSize.x(), frameSize.y());
 	// replace infinity values in buffer with 0
@@ -15,28 +15,48 @@ struct PixelData {
 	bool isValid;
 };
 
+// Frame buffers of the rasterizer. Can be kept alive between rasterizers (e.g. per worker thread)
+// to avoid reallocating them for every fit.
+struct RasterizerBuffers {
+	std::vector<PixelData> pixelResults;
+	Eigen::ArrayXXf depthBuffer;
+};
+
 class Rasterizer {
+private:
+	RasterizerBuffers ownBuffers;
+	RasterizerBuffers& buffers;
+
 public:
 	const FaceModel& model;
-	std::vector<PixelData> pixelResults;
+	std::vector<PixelData>& pixelResults;
 
-	Rasterizer(Eigen::Array2i frameSize, const FaceModel& model, const Eigen::Matrix4f& pose, const Eigen::Matrix3f& intrinsics)
-		: frameSize(frameSize), model(model), pose(pose), intrinsics(intrinsics),
-		pixelResults(frameSize.x() * frameSize.y()), depthBuffer(frameSize.x(), frameSize.y()) {}
+	// Uses the given buffers if not null, otherwise allocates its own.
+	Rasterizer(Eigen::Array2i frameSize, const FaceModel& model, const Eigen::Matrix4f& pose, const Eigen::Matrix3f& intrinsics, RasterizerBuffers* sharedBuffers = nullptr)
+		: buffers(sharedBuffers ? *sharedBuffers : ownBuffers), model(model), pixelResults(buffers.pixelResults),
+		frameSize(frameSize), pose(pose), intrinsics(intrinsics) {
+		buffers.pixelResults.resize(frameSize.x() * frameSize.y());
+		buffers.depthBuffer.resize(frameSize.x(), frameSize.y());
+	}
 
 	void compute(const FaceParameters& params);
 	Eigen::Vector3f getAverageColor();
 
+	// The parameters beyond the rank are zero, so only the basis products of the rank are computed.
+	void setRank(const ModelRank& rank) { this->rank = rank; hasRank = true; }
+
+	// The two steps of compute(), without logging. Exposed for benchmarking.
+	void project(const FaceParameters& params, Eigen::Matrix3Xf& outProjectedVertices, Eigen::Matrix4Xi& outVertexAlbedos, Eigen::Matrix3Xf& outWorldNormals);
+	void rasterize(const Eigen::Matrix3Xf& projectedVertices, const Eigen::Matrix4Xi& vertexAlbedos, const Eigen::Matrix3Xf& worldNormals);
+
 private:
 	const Eigen::Array2i frameSize;
 	const Eigen::Matrix4f& pose;
 	const Eigen::Matrix3f& intrinsics;
 
+	ModelRank rank;
+	bool hasRank = false;
 	int numCalls = 0;
-	Eigen::ArrayXXf depthBuffer;
-
-	void project(const FaceParameters& params, Eigen::Matrix3Xf& outProjectedVertices, Eigen::Matrix4Xi& outVertexAlbedos, Eigen::Matrix3Xf& outWorldNormals);
-	void rasterize(const Eigen::Matrix3Xf& projectedVertices, const Eigen::Matrix4Xi& vertexAlbedos, const Eigen::Matrix3Xf& worldNormals);
 
 	void writeDebugImages();
 };
@@ -1,23 +1,27 @@
 #pragma once
+#include <chrono>
 #include <pcl/io/io.h>
 #include <pcl/io/pcd_io.h>
 #include <pcl/features/integral_image_normal.h>
-#include <pcl/visualization/cloud_viewer.h>
 #include <pcl/features/normal_3d.h>
 
 #include "FeaturePointExtractor.h"
+#include "Profiler.h"
 
 class Sensor {
 public:
     pcl::PointCloud<pcl::PointXYZRGB>::Ptr m_cloud;
 	std::vector<Eigen::Vector3f>  m_featurePoints;
 	Eigen::Matrix3f m_cameraIntrinsics;
+	// Time at which the frame was captured.
+	std::chrono::system_clock::time_point m_captureTime;
 
-    explicit Sensor() : m_cloud(new pcl::PointCloud<pcl::PointXYZRGB>) {
+    explicit Sensor() : m_cloud(new pcl::PointCloud<pcl::PointXYZRGB>), m_captureTime(std::chrono::system_clock::now()) {
 		
 	}
 
 	pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr compute_normals() const {
+		PROFILE_SCOPE("normals");
 		// load point cloud
 		pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGB>);
 		cloud = m_cloud;
@@ -0,0 +1,83 @@
+#include "stdafx.h"
+#include <thread>
+#include "Settings.h"
+#include "CoarseAlignment.h"
+#include "Optimizer.h"
+
+Settings gSettings;
+
+unsigned int getThreadsPerJob() {
+	if (gSettings.threadsPerJob > 0) {
+		return gSettings.threadsPerJob;
+	}
+	return std::max(std::thread::hardware_concurrency() / std::max(gSettings.jobs, 1u), 1u);
+}
+
+void addSettingsOptions(cxxopts::Options& options) {
+	options.add_options()
+		("model-dir", "Directory of the morphable model.", cxxopts::value(gSettings.modelDir)->default_value("../data/MorphableModel/"))
+		("synthetic-model", "Use the procedural face model instead of the morphable model, e.g. for frames of synthetic_frames.", cxxopts::value(gSettings.syntheticModel)->default_value("false"))
+		("l,auto-landmarks", "Detect feature points automatically if the input has no .points file.", cxxopts::value(gSettings.autoLandmarks)->default_value("false"))
+		("o,skip-optimization", "Skip fine optimization of face parameters completely.", cxxopts::value(gSettings.skipOptimization)->default_value("false"))
+		("time-budget-ms", "Time budget of a reconstruction in milliseconds (0 = unlimited). ICP and the optimization are shortened to meet it.", cxxopts::value(gSettings.timeBudgetMs)->default_value("0"))
+		("skip-icp", "Skip ICP and start the optimization from the Procrustes alignment.", cxxopts::value(gSettings.skipICP)->default_value("false"))
+		("icp", "ICP variant for coarse alignment (projective, pcl).", cxxopts::value(gSettings.icpMethod)->default_value("projective"))
+		("icp-iterations", "Maximum number of projective ICP iterations.", cxxopts::value(gSettings.icpMaxIterations)->default_value("20"))
+		("icp-samples", "Number of normal-space sampled model vertices used for ICP (0 = use --icp-stride).", cxxopts::value(gSettings.icpSamples)->default_value("2000"))
+		("icp-stride", "Use every n-th model vertex for ICP if no samples are used.", cxxopts::value(gSettings.icpStride)->default_value("4"))
+		("icp-refine-full", "Refine the projective ICP result on all model vertices.", cxxopts::value(gSettings.icpRefineFull)->default_value("false"))
+		("p,opt-pose", "Refine the pose jointly with the face parameters.", cxxopts::value(gSettings.optimizePose)->default_value("false"))
+		("model-rank", "Shape coefficients to optimize, with half as many albedo coefficients (10, 20, 40, 80, 160 or 199, others are rounded down).", cxxopts::value(gSettings.modelRank)->default_value("160"))
+		("opt-stride", "Pixel stride for fine optimization (>= 1).", cxxopts::value(gSettings.optimizationStride)->default_value("2"))
+		("opt-tile-size", "Group the pixels of square image tiles of this size into one residual block (0 = a block per pixel).", cxxopts::value(gSettings.optimizationTileSize)->default_value("0"))
+		("opt-joint-residuals", "Evaluate geometry and color of a pixel in one block over shape and albedo, instead of a geometry block over the shape and a color block over the albedo.", cxxopts::value(gSettings.jointResiduals)->default_value("false"))
+		("opt-solver", "Solver of the parameter optimization (ceres, alternating).", cxxopts::value(gSettings.optimizationSolver)->default_value("ceres"))
+		("opt-polish-iterations", "Ceres iterations after the alternating solver (0 = none).", cxxopts::value(gSettings.polishIterations)->default_value("0"))
+		("opt-precision", "Precision of the alternating solver (double, float, mixed = float and a last iteration in double).", cxxopts::value(gSettings.optimizationPrecision)->default_value("double"))
+		("opt-linear-solver", "Linear solver of the alternating solver (normal, cg = matrix-free conjugate gradient).", cxxopts::value(gSettings.linearSolver)->default_value("normal"))
+		("opt-cg-iterations", "Maximum conjugate gradient iterations per step of the alternating solver.", cxxopts::value(gSettings.cgIterations)->default_value("25"))
+		("opt-unlock", "Leading shape and albedo coefficients the alternating solver starts with, doubled when the cost stops decreasing (0 = all).", cxxopts::value(gSettings.unlockCoefficients)->default_value("0"))
+		("opt-samples", "Pixels sampled at random per iteration from the stride grid (0 = all). The Ceres solver samples once per solve.", cxxopts::value(gSettings.sampleBudget)->default_value("0"))
+		("opt-sample-tile", "Stratify the sample by square screen tiles of this size (0 = no strata).", cxxopts::value(gSettings.sampleTileSize)->default_value("0"))
+		("opt-sample-importance", "Sample pixels with large residuals more often (and weight them less).", cxxopts::value(gSettings.sampleImportance)->default_value("false"))
+		("opt-sample-seed", "Seed of the pixel sampling.", cxxopts::value(gSettings.sampleSeed)->default_value("1"))
+		("s,opt-step", "Initial trust region size of the optimization.", cxxopts::value(gSettings.initialStepSize)->default_value("0.1"))
+		("S,opt-max-step", "Maximum trust region size of the optimization.", cxxopts::value(gSettings.maxStepSize)->default_value("0.25"))
+		("r,opt-reg-alpha", "Regularization strength for alpha parameters.", cxxopts::value(gSettings.regStrengthAlpha)->default_value("1.0"))
+		("R,opt-reg-beta", "Regularization strength for beta parameters.", cxxopts::value(gSettings.regStrengthBeta)->default_value("1.0"))
+		("live", "Fit frames received on this UNIX domain socket instead of the input file.", cxxopts::value(gSettings.liveSocket)->default_value(""))
+		("queue-capacity", "Maximum number of queued live frames.", cxxopts::value(gSettings.queueCapacity)->default_value("4"))
+		("drop-policy", "What to do with live frames when the queue is full (drop-oldest, drop-newest, block).", cxxopts::value(gSettings.dropPolicy)->default_value("drop-oldest"))
+		("metrics", "File to write live ingestion or daemon metrics to as JSON (default: print to the console).", cxxopts::value(gSettings.metricsFile)->default_value(""))
+		("output", "Output directory of the headless batch mode.", cxxopts::value(gSettings.outputDir)->default_value("output"))
+		("export", "Formats the results are exported in: ply, obj, npy, txt (comma separated).", cxxopts::value(gSettings.exportFormats)->default_value("ply,npy"))
+		("t,track", "Fit the inputs as frame sequence, each frame starting from the previous result.", cxxopts::value(gSettings.track)->default_value("false"))
+		("track-iterations", "Maximum optimizer iterations per tracked frame.", cxxopts::value(gSettings.trackIterations)->default_value("5"))
+		("track-icp-iterations", "Maximum ICP iterations per tracked frame.", cxxopts::value(gSettings.trackICPIterations)->default_value("5"))
+		("track-max-rmse", "Fit a tracked frame from scratch if the ICP rmse (in meters) exceeds this.", cxxopts::value(gSettings.trackMaxRmse)->default_value("0.005"))
+		("track-min-inliers", "Fit a tracked frame from scratch if fewer ICP correspondences are found (fraction of samples).", cxxopts::value(gSettings.trackMinInliers)->default_value("0.3"))
+		("profile", "Write per-stage timings and memory counters as JSON to this file.", cxxopts::value(gSettings.profileFile)->default_value(""))
+		("trace", "Write the stage timings in Chrome trace event format to this file.", cxxopts::value(gSettings.traceFile)->default_value(""))
+		("daemon", "Run as reconstruction service that reads JSON jobs from the daemon socket or stdin.", cxxopts::value(gSettings.daemon)->default_value("false"))
+		("daemon-socket", "UNIX domain socket the daemon accepts jobs on (empty = stdin/stdout).", cxxopts::value(gSettings.daemonSocket)->default_value(""))
+		("j,jobs", "Number of inputs fitted concurrently in batch and daemon mode.", cxxopts::value(gSettings.jobs)->default_value("1"))
+		("threads-per-job", "Number of threads used within one fit (0 = hardware threads / jobs).", cxxopts::value(gSettings.threadsPerJob)->default_value("0"))
+		("log-level", "Messages to print: error, warning, info or debug.", cxxopts::value(gSettings.logLevel)->default_value("info"))
+		("inputs", "Input files, glob patterns or @list files for the headless batch mode.", cxxopts::value(gSettings.inputFiles))
+		;
+}
+
+bool checkSettings() {
+	bool ok = true;
+	OptimizationSolver solver;
+	if (!parseOptimizationSolver(gSettings.optimizationSolver, solver)) {
+		std::cerr << "Unknown solver " << gSettings.optimizationSolver << std::endl;
+		ok = false;
+	}
+	ICPMethod icpMethod;
+	if (!parseICPMethod(gSettings.icpMethod, icpMethod)) {
+		std::cerr << "Unknown ICP variant " << gSettings.icpMethod << std::endl;
+		ok = false;
+	}
+	return ok;
+}
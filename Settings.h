@@ -1,16 +1,107 @@
 #pragma once
+#include <string>
+#include <vector>
+
+namespace cxxopts { class Options; }
 
 // Stores command line parameters.
 struct Settings {
+	std::string modelDir;
+	// Use the procedural model (FaceModel::createSynthetic) instead of the model directory.
+	bool syntheticModel;
 	std::string inputFile;
+	bool autoLandmarks;
 	
 	bool skipOptimization;
+	// Wall time of a reconstruction in milliseconds (0 = unlimited, see ReconstructionOptions).
+	double timeBudgetMs;
+
+	bool skipICP;
+	std::string icpMethod;
+	unsigned int icpMaxIterations;
+	unsigned int icpStride;
+	unsigned int icpSamples;
+	bool icpRefineFull;
 	
+	bool optimizePose;
+	// Shape coefficients to optimize, with half as many albedo coefficients. Rounded down to a rank
+	// with compiled kernels (see ModelRank.h).
+	unsigned int modelRank;
 	unsigned int optimizationStride;
+	// Pixels of square image tiles of this size share one residual block (0 = a block per pixel).
+	unsigned int optimizationTileSize;
+	// One residual block per pixel over alpha and beta, instead of separate geometry and color blocks.
+	bool jointResiduals;
+	// ceres or alternating (closed-form solves per rasterization, see AlternatingSolver.h). After the
+	// alternating solver, Ceres runs polishIterations more iterations, which also refine the pose.
+	std::string optimizationSolver;
+	unsigned int polishIterations;
+	// Precision of the alternating solver: double, float or mixed (see SolverPrecision).
+	std::string optimizationPrecision;
+	// Linear solver of the alternating solver: normal (normal equations) or cg (matrix-free conjugate
+	// gradient with at most cgIterations products per step, see LinearSolver).
+	std::string linearSolver;
+	unsigned int cgIterations;
+	// Coefficients of each basis the alternating solver starts with, doubled whenever the cost stops
+	// decreasing (0 = all, see AlternatingSolverOptions::initialCoefficients).
+	unsigned int unlockCoefficients;
+	// Pixels sampled per iteration from the stride grid (0 = all), stratified by screen tiles of
+	// sampleTileSize (0 = none) and drawn by residual norm with sampleImportance (see PixelSampler).
+	unsigned int sampleBudget;
+	unsigned int sampleTileSize;
+	bool sampleImportance;
+	unsigned int sampleSeed;
 	float regStrengthAlpha;
 	float regStrengthBeta;
 	double initialStepSize;
 	double maxStepSize;
+
+	// Write bitmaps of the input and of every rasterization to the working directory.
+	bool debugImages;
+	// error, warning, info or debug (debug messages need a build with ENABLE_DEBUG_LOG).
+	std::string logLevel;
+
+	// Live ingestion from a frame source socket (empty = read inputFile).
+	std::string liveSocket;
+	unsigned int queueCapacity;
+	std::string dropPolicy;
+	std::string metricsFile;
+
+	// Headless batch mode: inputs (files, glob patterns or @list files) and where to write the results.
+	bool headless;
+	std::vector<std::string> inputFiles;
+	std::string outputDir;
+	// Comma separated export formats (ply, obj, npy, txt).
+	std::string exportFormats;
+	// Tracking: frames are fitted in order, each starting from the previous result.
+	bool track;
+	unsigned int trackIterations;
+	unsigned int trackICPIterations;
+	// The frame is fitted from scratch if the ICP rmse (meters) is larger or the inlier ratio is smaller.
+	float trackMaxRmse;
+	float trackMinInliers;
+
+	// Stage timings and memory counters as JSON report and as Chrome trace (disabled if empty).
+	std::string profileFile;
+	std::string traceFile;
+
+	// Reconstruction service, reads jobs from the socket or from stdin if no socket is given.
+	bool daemon;
+	std::string daemonSocket;
+
+	// Number of inputs fitted concurrently, and threads used within one fit.
+	unsigned int jobs;
+	unsigned int threadsPerJob;
 };
 
 extern Settings gSettings;
+
+// Threads used within one fit. 0 in the settings means the hardware threads divided by the number of jobs.
+unsigned int getThreadsPerJob();
+
+// Registers the options shared by all executables running the reconstruction pipeline.
+void addSettingsOptions(cxxopts::Options& options);
+
+// Checks the names given to the enum-like options, so typos fail at startup instead of falling back
+// to a default. Prints the unknown ones and returns false if there are any.
+bool checkSettings();
@@ -0,0 +1,207 @@
+#include "stdafx.h"
+#include "SocketFrameSource.h"
+#include "Log.h"
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+bool writeAll(int fd, const void* data, size_t size) {
+	const char* p = static_cast<const char*>(data);
+	while (size > 0) {
+		ssize_t n = ::send(fd, p, size, MSG_NOSIGNAL);
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR)
+				continue;
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+static bool readAll(int fd, void* data, size_t size) {
+	char* p = static_cast<char*>(data);
+	while (size > 0) {
+		ssize_t n = ::read(fd, p, size);
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR)
+				continue;
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+int connectUnixSocket(const std::string& socketPath) {
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(address.sun_path)) {
+		return -1;
+	}
+	strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+	int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+		::close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+bool SocketLineReader::readLine(std::string& outLine) {
+	size_t searchFrom = 0;
+	while (true) {
+		size_t newline = buffer.find('\n', searchFrom);
+		if (newline != std::string::npos) {
+			outLine.assign(buffer, 0, newline);
+			buffer.erase(0, newline + 1);
+			return true;
+		}
+		if (buffer.size() > maxLineLength) {
+			return false;
+		}
+		searchFrom = buffer.size();
+
+		char chunk[64 * 1024];
+		ssize_t n = ::read(fd, chunk, sizeof(chunk));
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		buffer.append(chunk, n);
+	}
+}
+
+bool sendFrame(int fd, const Frame& frame) {
+	FrameHeader header;
+	header.magic = FRAME_MAGIC;
+	header.width = frame.cloud->width;
+	header.height = frame.cloud->height;
+	header.sequence = frame.sequence;
+	header.captureTimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(frame.captureTime.time_since_epoch()).count();
+	for (int i = 0; i < 9; i++) {
+		header.intrinsics[i] = frame.cameraIntrinsics(i / 3, i % 3);
+	}
+
+	std::vector<WirePoint> points = cloudToWirePoints(*frame.cloud);
+
+	return writeAll(fd, &header, sizeof(header))
+		&& writeAll(fd, points.data(), points.size() * sizeof(WirePoint));
+}
+
+bool receiveFrame(int fd, Frame& outFrame) {
+	FrameHeader header;
+	if (!readAll(fd, &header, sizeof(header))) {
+		return false;
+	}
+	if (header.magic != FRAME_MAGIC || header.width == 0 || header.height == 0 || header.width * uint64_t(header.height) > (1u << 24)) {
+		LOG_ERROR << "Received malformed frame header.";
+		return false;
+	}
+
+	std::vector<WirePoint> points(header.width * header.height);
+	if (!readAll(fd, points.data(), points.size() * sizeof(WirePoint))) {
+		return false;
+	}
+
+	outFrame.cloud = wirePointsToCloud(points.data(), header.width, header.height);
+	for (int i = 0; i < 9; i++) {
+		outFrame.cameraIntrinsics(i / 3, i % 3) = header.intrinsics[i];
+	}
+	outFrame.sequence = header.sequence;
+	outFrame.captureTime = std::chrono::system_clock::time_point(
+		std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(header.captureTimeNs)));
+	return true;
+}
+
+SocketFrameSource::~SocketFrameSource() {
+	stop();
+}
+
+bool SocketFrameSource::start(FrameQueue& queue) {
+	listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listenFd < 0) {
+		LOG_ERROR << "Couldn't create socket: " << strerror(errno);
+		return false;
+	}
+
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(address.sun_path)) {
+		LOG_ERROR << "Socket path too long: " << socketPath;
+		::close(listenFd);
+		listenFd = -1;
+		return false;
+	}
+	strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+	::unlink(socketPath.c_str());
+
+	if (::bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || ::listen(listenFd, 4) < 0) {
+		LOG_ERROR << "Couldn't listen on " << socketPath << ": " << strerror(errno);
+		::close(listenFd);
+		listenFd = -1;
+		return false;
+	}
+
+	running = true;
+	receiver = std::thread(&SocketFrameSource::receiveLoop, this, std::ref(queue));
+	return true;
+}
+
+void SocketFrameSource::stop() {
+	running = false;
+	// unblocks accept() and read()
+	{
+		std::lock_guard<std::mutex> lock(clientMutex);
+		if (clientFd >= 0) {
+			::shutdown(clientFd, SHUT_RDWR);
+		}
+	}
+	int fd = listenFd.exchange(-1);
+	if (fd >= 0) {
+		::shutdown(fd, SHUT_RDWR);
+		::close(fd);
+	}
+	if (receiver.joinable()) {
+		receiver.join();
+	}
+	::unlink(socketPath.c_str());
+}
+
+void SocketFrameSource::receiveLoop(FrameQueue& queue) {
+	do {
+		int fd = ::accept(listenFd, nullptr, nullptr);
+		if (fd < 0) {
+			break;
+		}
+		{
+			std::lock_guard<std::mutex> lock(clientMutex);
+			if (!running) {
+				::close(fd);
+				break;
+			}
+			clientFd = fd;
+		}
+		LOG_INFO << "Frame source connected on " << socketPath;
+
+		Frame frame;
+		while (running && receiveFrame(fd, frame)) {
+			queue.push(std::move(frame));
+		}
+		{
+			std::lock_guard<std::mutex> lock(clientMutex);
+			clientFd = -1;
+		}
+		::close(fd);
+		LOG_INFO << "Frame source disconnected.";
+	} while (running && keepListening);
+
+	queue.close();
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "FrameQueue.h"
+
+// Wire format of a frame sent over a stream socket: a FrameHeader followed by
+// width * height WirePoints in row-major order. Invalid points have NaN coordinates.
+#pragma pack(push, 1)
+struct FrameHeader {
+	uint32_t magic;
+	uint32_t width;
+	uint32_t height;
+	uint64_t sequence;
+	// Capture time in nanoseconds since the epoch of the system clock.
+	int64_t captureTimeNs;
+	float intrinsics[9];
+};
+#pragma pack(pop)
+
+const uint32_t FRAME_MAGIC = 0x314d5246; // "FRM1"
+
+// Writes all bytes to a socket. Returns false if the connection is broken.
+bool writeAll(int fd, const void* data, size_t size);
+// Connects to a UNIX domain socket. Returns -1 on failure.
+int connectUnixSocket(const std::string& socketPath);
+
+// Buffered reading of newline terminated lines from a socket.
+class SocketLineReader {
+public:
+	SocketLineReader(int fd, size_t maxLineLength) : fd(fd), maxLineLength(maxLineLength) {}
+
+	// Returns false on end of stream, errors or lines longer than the limit.
+	bool readLine(std::string& outLine);
+
+private:
+	const int fd;
+	const size_t maxLineLength;
+	std::string buffer;
+};
+
+// Writes a frame to a file descriptor. Returns false if the connection is broken.
+bool sendFrame(int fd, const Frame& frame);
+// Reads a frame from a file descriptor. Returns false on end of stream or malformed data.
+bool receiveFrame(int fd, Frame& outFrame);
+
+// Frame source that listens on a UNIX domain socket and pushes all frames received from
+// connecting clients (e.g. the frame_replay tool) into the queue. The queue is closed when
+// the last client disconnects, unless the source keeps listening for new clients.
+class SocketFrameSource : public FrameSource {
+public:
+	SocketFrameSource(const std::string& socketPath, bool keepListening = false)
+		: socketPath(socketPath), keepListening(keepListening) {}
+	~SocketFrameSource();
+
+	bool start(FrameQueue& queue) override;
+	void stop() override;
+
+private:
+	const std::string socketPath;
+	const bool keepListening;
+
+	std::atomic<int> listenFd{ -1 };
+	// The connected client, published under the mutex so stop() either sees it or the receiver sees
+	// that a stop started.
+	std::mutex clientMutex;
+	int clientFd = -1;
+	std::atomic<bool> running{ false };
+	std::thread receiver;
+
+	void receiveLoop(FrameQueue& queue);
+};
@@ -0,0 +1,202 @@
+#include "stdafx.h"
+#include "SyntheticFrame.h"
+#include "OptimizerFunctors.h"
+#include "VirtualSensor.h"
+
+using namespace Eigen;
+
+Matrix3f syntheticIntrinsics(Array2i frameSize) {
+	Matrix3f intrinsics = VirtualSensor::intrinsicsForWidth(frameSize.x());
+	if (frameSize.x() != 960) {
+		intrinsics(0, 2) = frameSize.x() / 2.0f;
+		intrinsics(1, 2) = frameSize.y() / 2.0f;
+	}
+	return intrinsics;
+}
+
+Matrix4f frontalFacePose(float distance) {
+	// The model's nose points to +z and its top to +y, the camera looks along +z with y pointing down.
+	Matrix4f pose = Matrix4f::Identity();
+	pose.topLeftCorner<3, 3>() = AngleAxisf(float(EIGEN_PI), Vector3f::UnitX()).toRotationMatrix();
+	pose(2, 3) = distance;
+	return pose;
+}
+
+pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr renderFaceCloud(const FaceModel& model, const FaceParameters& params,
+	const Matrix4f& pose, const Matrix3f& intrinsics, Array2i frameSize, RasterizerBuffers* buffers) {
+	Rasterizer rasterizer(frameSize, model, pose, intrinsics, buffers);
+	Matrix3Xf projectedVertices;
+	Matrix4Xi vertexAlbedos;
+	Matrix3Xf worldNormals;
+	rasterizer.project(params, projectedVertices, vertexAlbedos, worldNormals);
+	rasterizer.rasterize(projectedVertices, vertexAlbedos, worldNormals);
+	Matrix3Xf worldVertices = intrinsics.inverse() * projectedVertices;
+
+	pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGBNormal>);
+	cloud->width = frameSize.x();
+	cloud->height = frameSize.y();
+	cloud->is_dense = false;
+	cloud->points.resize(cloud->width * cloud->height);
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	for (size_t i = 0; i < cloud->points.size(); i++) {
+		const PixelData& pixel = rasterizer.pixelResults[i];
+		pcl::PointXYZRGBNormal& point = cloud->points[i];
+		if (!pixel.isValid) {
+			point.x = point.y = point.z = nan;
+			point.normal_x = point.normal_y = point.normal_z = nan;
+			continue;
+		}
+		Vector3f position = Vector3f::Zero();
+		Vector3f normal = Vector3f::Zero();
+		for (int k = 0; k < 3; k++) {
+			position += pixel.barycentricCoordinates(k) * worldVertices.col(pixel.vertexIndices[k]);
+			normal += pixel.barycentricCoordinates(k) * worldNormals.col(pixel.vertexIndices[k]);
+		}
+		normal.normalize();
+		if (normal.dot(position) > 0) {
+			normal = -normal;
+		}
+		point.x = position.x();
+		point.y = position.y();
+		point.z = position.z();
+		point.normal_x = normal.x();
+		point.normal_y = normal.y();
+		point.normal_z = normal.z();
+		point.r = uint8_t(std::min(255.0f, std::max(0.0f, pixel.albedo.x())));
+		point.g = uint8_t(std::min(255.0f, std::max(0.0f, pixel.albedo.y())));
+		point.b = uint8_t(std::min(255.0f, std::max(0.0f, pixel.albedo.z())));
+	}
+	return cloud;
+}
+
+// Index of the model vertex closest to each feature point, so the feature points follow the shape.
+static std::vector<unsigned int> featurePointVertices(const FaceModel& model) {
+	Map<const Matrix3Xf> vertices(model.m_averageMesh.vertices.data(), 3, model.getNumVertices());
+	std::vector<unsigned int> indices;
+	for (const Vector3f& point : model.m_averageFeaturePoints) {
+		Index nearest;
+		(vertices.colwise() - point).colwise().squaredNorm().minCoeff(&nearest);
+		indices.push_back(static_cast<unsigned int>(nearest));
+	}
+	return indices;
+}
+
+// Random parameters for the coefficients the optimizer fits, the others stay zero.
+static FaceParameters randomParameters(const FaceModel& model, const SyntheticFrameOptions& options, std::mt19937& rng) {
+	FaceParameters params = model.createDefaultParameters();
+	std::normal_distribution<float> alpha(0.0f, options.alphaStd);
+	std::normal_distribution<float> beta(0.0f, options.betaStd);
+	for (int i = 0; i < std::min<int>(params.alpha.size(), NUM_ALPHA_VEC); i++) {
+		params.alpha(i) = alpha(rng);
+	}
+	for (int i = 0; i < std::min<int>(params.beta.size(), NUM_BETA_VEC); i++) {
+		params.beta(i) = beta(rng);
+	}
+	return params;
+}
+
+// Frontal pose with a random rotation of up to maxRotation degrees and a random position in front of the camera.
+static Matrix4f randomPose(const SyntheticFrameOptions& options, std::mt19937& rng) {
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> distance(0.6f, 0.9f);
+	Vector3f axis(uniform(rng), uniform(rng), uniform(rng));
+	float angle = uniform(rng) * options.maxRotation * float(EIGEN_PI) / 180.0f;
+
+	Matrix4f pose = frontalFacePose(distance(rng));
+	Matrix3f rotation = AngleAxisf(angle, axis.normalized()).toRotationMatrix();
+	pose.topLeftCorner<3, 3>() = rotation * pose.topLeftCorner<3, 3>();
+	pose(0, 3) = 0.05f * uniform(rng);
+	pose(1, 3) = 0.05f * uniform(rng);
+	return pose;
+}
+
+// Converts the rendering to what a depth camera would deliver: a wall behind the face, depth noise
+// growing with the squared distance (like structured light sensors), color noise and holes.
+static pcl::PointCloud<pcl::PointXYZRGB>::Ptr simulateSensor(const pcl::PointCloud<pcl::PointXYZRGBNormal>& rendering,
+	const Matrix3f& intrinsics, const SyntheticFrameOptions& options, std::mt19937& rng) {
+	const int width = rendering.width;
+	const int height = rendering.height;
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGB>);
+	cloud->width = width;
+	cloud->height = height;
+	cloud->is_dense = false;
+	cloud->points.resize(width * height);
+
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	const Matrix3f inverseIntrinsics = intrinsics.inverse();
+	std::normal_distribution<float> normal(0.0f, 1.0f);
+	auto noisyColor = [&](float value) {
+		return uint8_t(std::min(255.0f, std::max(0.0f, value + options.colorNoise * normal(rng))));
+	};
+
+	size_t numValid = 0;
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			const pcl::PointXYZRGBNormal& rendered = rendering(x, y);
+			pcl::PointXYZRGB& point = (*cloud)(x, y);
+			Vector3f position;
+			Vector3f color;
+			if (std::isfinite(rendered.z)) {
+				position = Vector3f(rendered.x, rendered.y, rendered.z);
+				color = Vector3f(rendered.r, rendered.g, rendered.b);
+			}
+			else if (options.background > 0) {
+				position = inverseIntrinsics * Vector3f(x + 0.5f, y + 0.5f, 1.0f) * options.background;
+				color = Vector3f(120, 125, 130);
+			}
+			else {
+				point.x = point.y = point.z = nan;
+				continue;
+			}
+			// Noise along the viewing ray, sigma in mm at 1 m.
+			float z = position.z();
+			position *= 1.0f + options.depthNoise * 0.001f * z * normal(rng);
+			point.x = position.x();
+			point.y = position.y();
+			point.z = position.z();
+			point.r = noisyColor(color.x());
+			point.g = noisyColor(color.y());
+			point.b = noisyColor(color.z());
+			numValid++;
+		}
+	}
+
+	// Holes as discs of missing depth, until the requested fraction of the valid pixels is removed.
+	std::uniform_int_distribution<int> centerX(0, width - 1), centerY(0, height - 1);
+	std::uniform_real_distribution<float> radius(2.0f * width / 640.0f, 8.0f * width / 640.0f);
+	size_t numHolePixels = 0;
+	const size_t targetHolePixels = size_t(std::min(options.holes, 1.0f) * numValid);
+	while (numHolePixels < targetHolePixels) {
+		int cx = centerX(rng), cy = centerY(rng);
+		float r = radius(rng);
+		for (int y = std::max(0, int(cy - r)); y <= std::min(height - 1, int(cy + r)); y++) {
+			for (int x = std::max(0, int(cx - r)); x <= std::min(width - 1, int(cx + r)); x++) {
+				pcl::PointXYZRGB& point = (*cloud)(x, y);
+				if ((x - cx) * (x - cx) + (y - cy) * (y - cy) <= r * r && std::isfinite(point.z)) {
+					point.x = point.y = point.z = nan;
+					numHolePixels++;
+				}
+			}
+		}
+	}
+	return cloud;
+}
+
+Array2i syntheticFrameSize(unsigned int width) {
+	return Array2i(width, width == 960 ? 540 : width * 3 / 4);
+}
+
+SyntheticFrame generateSyntheticFrame(const FaceModel& model, const SyntheticFrameOptions& options, std::mt19937& rng) {
+	SyntheticFrame frame;
+	frame.intrinsics = syntheticIntrinsics(options.frameSize);
+	frame.params = randomParameters(model, options, rng);
+	frame.pose = randomPose(options, rng);
+	auto rendering = renderFaceCloud(model, frame.params, frame.pose, frame.intrinsics, options.frameSize);
+	frame.cloud = simulateSensor(*rendering, frame.intrinsics, options, rng);
+
+	VectorXf vertices = model.computeShape(frame.params);
+	for (unsigned int index : featurePointVertices(model)) {
+		frame.featurePoints.push_back(frame.pose.topLeftCorner<3, 3>() * vertices.segment<3>(3 * index) + frame.pose.topRightCorner<3, 1>());
+	}
+	return frame;
+}
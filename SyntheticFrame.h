@@ -0,0 +1,55 @@
+#pragma once
+#include <random>
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include "FaceModel.h"
+#include "Rasterizer.h"
+
+// Camera intrinsics for a rendered frame, those VirtualSensor::intrinsicsForWidth infers when the
+// frame is loaded again, with the principal point in the center of the frame.
+Eigen::Matrix3f syntheticIntrinsics(Eigen::Array2i frameSize);
+
+// Pose that places the model upright at the given distance in front of the camera, facing it.
+Eigen::Matrix4f frontalFacePose(float distance);
+
+// Renders the face like a depth camera with the given intrinsics would see it, into an organized
+// cloud of the frame size. Pixels not covered by the face are NaN. The normals are interpolated
+// from the vertex normals and point towards the camera.
+pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr renderFaceCloud(const FaceModel& model, const FaceParameters& params,
+	const Eigen::Matrix4f& pose, const Eigen::Matrix3f& intrinsics, Eigen::Array2i frameSize,
+	RasterizerBuffers* buffers = nullptr);
+
+// Randomization and sensor simulation of generated frames.
+struct SyntheticFrameOptions {
+	Eigen::Array2i frameSize = Eigen::Array2i(640, 480);
+	// Standard deviations of the random shape and albedo parameters, in model standard deviations.
+	float alphaStd = 1.0f;
+	float betaStd = 1.0f;
+	// Maximum head rotation away from the camera in degrees.
+	float maxRotation = 15.0f;
+	// Depth noise standard deviation in mm at 1 m distance.
+	float depthNoise = 1.5f;
+	// Color noise standard deviation (0-255).
+	float colorNoise = 3.0f;
+	// Fraction of the valid pixels removed as holes.
+	float holes = 0.02f;
+	// Distance of the wall behind the face in m, 0 for no background.
+	float background = 1.2f;
+};
+
+// Frame rendered from known parameters.
+struct SyntheticFrame {
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud;
+	Eigen::Matrix3f intrinsics;
+	// Feature points of the deformed and posed face, in the order of the model's feature points.
+	std::vector<Eigen::Vector3f> featurePoints;
+	FaceParameters params;
+	Eigen::Matrix4f pose;
+};
+
+// Frame size for a width, 16:9 for 960 pixels like the recorded dataset, otherwise 4:3.
+Eigen::Array2i syntheticFrameSize(unsigned int width);
+
+// Renders a face with random parameters (for the coefficients the optimizer fits) in a random pose
+// and simulates the noise and holes of a depth camera.
+SyntheticFrame generateSyntheticFrame(const FaceModel& model, const SyntheticFrameOptions& options, std::mt19937& rng);
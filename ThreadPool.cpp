@@ -0,0 +1,101 @@
+#include "stdafx.h"
+#include "ThreadPool.h"
+
+static thread_local int tCurrentWorker = -1;
+
+ThreadPool::ThreadPool(unsigned int numThreads) {
+	numThreads = std::max(numThreads, 1u);
+	for (unsigned int i = 0; i < numThreads; i++) {
+		queues.emplace_back(new WorkerQueue());
+	}
+	for (unsigned int i = 0; i < numThreads; i++) {
+		threads.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	wait();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	taskAvailable.notify_all();
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
+
+int ThreadPool::currentWorker() {
+	return tCurrentWorker;
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+	size_t target;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		target = tCurrentWorker >= 0 && size_t(tCurrentWorker) < queues.size() ? tCurrentWorker : nextQueue++ % queues.size();
+		pending++;
+	}
+	{
+		std::lock_guard<std::mutex> lock(queues[target]->mutex);
+		queues[target]->tasks.push_back(std::move(task));
+	}
+	// Only announce the task once it is in a deque, so a claimed task can always be found.
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		unclaimed++;
+	}
+	taskAvailable.notify_one();
+}
+
+void ThreadPool::wait() {
+	std::unique_lock<std::mutex> lock(mutex);
+	allDone.wait(lock, [this] { return pending == 0; });
+}
+
+std::function<void()> ThreadPool::takeTask(unsigned int index) {
+	// The caller claimed a task, so one of the deques holds at least one.
+	while (true) {
+		{
+			WorkerQueue& own = *queues[index];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.tasks.empty()) {
+				std::function<void()> task = std::move(own.tasks.back());
+				own.tasks.pop_back();
+				return task;
+			}
+		}
+		for (size_t offset = 1; offset < queues.size(); offset++) {
+			WorkerQueue& victim = *queues[(index + offset) % queues.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.tasks.empty()) {
+				std::function<void()> task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				return task;
+			}
+		}
+		std::this_thread::yield();
+	}
+}
+
+void ThreadPool::workerLoop(unsigned int index) {
+	tCurrentWorker = int(index);
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			taskAvailable.wait(lock, [this] { return stopping || unclaimed > 0; });
+			if (unclaimed == 0) {
+				return;
+			}
+			unclaimed--;
+		}
+
+		std::function<void()> task = takeTask(index);
+		task();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--pending == 0) {
+			allDone.notify_all();
+		}
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size thread pool with one task deque per worker. Workers take their own tasks
+// newest first and steal the oldest tasks of other workers when they run out.
+class ThreadPool {
+public:
+	explicit ThreadPool(unsigned int numThreads);
+	// Waits for all submitted tasks.
+	~ThreadPool();
+
+	// Tasks submitted from a worker go to its own deque, others are distributed round-robin.
+	void submit(std::function<void()> task);
+	// Blocks until all submitted tasks are finished.
+	void wait();
+
+	unsigned int size() const { return static_cast<unsigned int>(threads.size()); }
+
+	// Index of the calling worker thread in its pool, or -1 outside of a pool.
+	static int currentWorker();
+
+private:
+	struct WorkerQueue {
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	std::vector<std::thread> threads;
+
+	std::mutex mutex;
+	std::condition_variable taskAvailable;
+	std::condition_variable allDone;
+	// Tasks in the deques that no worker has claimed yet.
+	size_t unclaimed = 0;
+	// Tasks submitted but not finished.
+	size_t pending = 0;
+	size_t nextQueue = 0;
+	bool stopping = false;
+
+	void workerLoop(unsigned int index);
+	std::function<void()> takeTask(unsigned int index);
+};
@@ -0,0 +1,105 @@
+#include "stdafx.h"
+#include "TimeBudget.h"
+
+namespace {
+	// Weight of a new measurement in the moving averages.
+	const double SMOOTHING = 0.3;
+	// Share of the remaining time that is planned, the rest absorbs the error of the estimate.
+	const double PLANNED_SHARE = 0.8;
+	// Fewer pixels than this make a poor fit; then the iterations are reduced instead, down to MIN_ITERATIONS.
+	const unsigned int MIN_PIXELS = 1000;
+	const int MIN_ITERATIONS = 5;
+	// ICP runs once after this many skips in a row to measure it again.
+	const unsigned int ICP_PROBE_INTERVAL = 10;
+
+	void average(double& estimate, double measurement, bool first) {
+		estimate = first ? measurement : (1.0 - SMOOTHING) * estimate + SMOOTHING * measurement;
+	}
+}
+
+StageCostModel& StageCostModel::instance() {
+	static StageCostModel model;
+	return model;
+}
+
+double StageCostModel::getICPMs() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return icpMs;
+}
+
+bool StageCostModel::planICP(double availableMs) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (icpMs <= availableMs) {
+		icpSkips = 0;
+		return true;
+	}
+	if (++icpSkips >= ICP_PROBE_INTERVAL) {
+		icpSkips = 0;
+		icpProbe = true;
+		return true;
+	}
+	return false;
+}
+
+void StageCostModel::addICP(double ms) {
+	std::lock_guard<std::mutex> lock(mutex);
+	average(icpMs, ms, icpMs == 0 || icpProbe);
+	icpProbe = false;
+}
+
+OptimizationPlan StageCostModel::planOptimization(OptimizationSolver solver, double remainingMs, double rasterizeMs,
+	unsigned int numPixels, unsigned int stride, unsigned int sampleBudget, int maxIterations) const {
+	double buildMs, iterationMs;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const SolverCosts& costs = solverCosts[int(solver)];
+		buildMs = costs.buildMsPerPixel;
+		iterationMs = costs.iterationMsPerPixel;
+	}
+	OptimizationPlan plan;
+	plan.stride = std::max(stride, 1u);
+	plan.sampleBudget = sampleBudget;
+	plan.maxIterations = maxIterations;
+	// Pixels the settings ask for.
+	double pixels = double(numPixels) / (plan.stride * plan.stride);
+	if (sampleBudget > 0) {
+		pixels = std::min(pixels, double(sampleBudget));
+	}
+
+	// Time of K iterations over N pixels: N * build + K * (rasterize + N * iteration).
+	const double plannedMs = PLANNED_SHARE * remainingMs;
+	auto pixelsFor = [&](int iterations) {
+		return (plannedMs - iterations * rasterizeMs) / (buildMs + iterations * iterationMs);
+	};
+	if (pixelsFor(maxIterations) >= pixels) {
+		return plan;
+	}
+	// Fewer pixels first, then fewer iterations down to MIN_ITERATIONS, then fewer pixels again.
+	int iterations = maxIterations;
+	if (pixelsFor(iterations) < MIN_PIXELS) {
+		iterations = int((plannedMs - MIN_PIXELS * buildMs) / (rasterizeMs + MIN_PIXELS * iterationMs));
+		iterations = std::min(std::max(iterations, std::min(MIN_ITERATIONS, maxIterations)), maxIterations);
+	}
+	const double affordable = pixelsFor(iterations);
+	if (affordable < 1.0 || iterations < 1) {
+		plan.skip = true;
+		return plan;
+	}
+	plan.maxIterations = iterations;
+	plan.sampleBudget = unsigned(affordable);
+	// Coarser grid with about the affordable pixels, which spreads them over the face and saves
+	// collecting candidates; the sampler trims the rest.
+	plan.stride = std::max(plan.stride, unsigned(std::sqrt(numPixels / affordable)));
+	return plan;
+}
+
+void StageCostModel::addOptimization(OptimizationSolver solver, unsigned int numPixels, int iterations, double buildMs, double iterationsMs) {
+	if (numPixels == 0 || iterations == 0) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	SolverCosts& costs = solverCosts[int(solver)];
+	average(costs.buildMsPerPixel, buildMs / numPixels, !costs.measured);
+	average(costs.iterationMsPerPixel, std::max(iterationsMs, 0.0) / (double(iterations) * numPixels), !costs.measured);
+	costs.measured = true;
+}
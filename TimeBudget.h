@@ -0,0 +1,69 @@
+#pragma once
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Outcome of a reconstruction with a time budget.
+struct BudgetReport {
+	// Zero without a budget.
+	double budgetMs = 0;
+	bool met = true;
+	// Stages skipped or shortened to fit the budget, e.g. "icp skipped" or "iterations 50 -> 12".
+	std::vector<std::string> cuts;
+};
+
+// How the optimization is scaled down to fit the time left.
+struct OptimizationPlan {
+	// Nothing fits, not even one iteration.
+	bool skip = false;
+	unsigned int stride = 1;
+	// Pixels per iteration (see PixelSampler), 0 = all of the stride grid.
+	unsigned int sampleBudget = 0;
+	int maxIterations = 0;
+};
+
+// Solvers of the parameter optimization. Their costs per pixel differ a lot, so they are modeled
+// separately.
+enum class OptimizationSolver { Ceres, Alternating };
+
+// Costs of the pipeline stages, measured on the previous fits of this process and used to plan
+// fits within a time budget. Starts from rough priors, then follows the measurements with a moving
+// average, so it adapts to the machine, the model and the number of concurrent jobs. Thread-safe.
+class StageCostModel {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	static StageCostModel& instance();
+
+	// Expected ICP time, 0 before the first measurement.
+	double getICPMs() const;
+	// Whether to run ICP with availableMs left for it: if it is expected to fit, and otherwise every
+	// ICP_PROBE_INTERVAL-th time, so that an estimate from a slow run (e.g. with cold caches) gets
+	// measured again rather than skipping ICP for good. The measurement of a probe replaces the estimate.
+	bool planICP(double availableMs);
+	void addICP(double ms);
+
+	// Largest fit of the solver with about the configured iterations that ends within remainingMs.
+	// rasterizeMs is the time of one rasterization, numPixels the valid input pixels at stride 1.
+	OptimizationPlan planOptimization(OptimizationSolver solver, double remainingMs, double rasterizeMs, unsigned int numPixels,
+		unsigned int stride, unsigned int sampleBudget, int maxIterations) const;
+	// Time of a finished solve: problem construction, and the iterations without rasterization.
+	void addOptimization(OptimizationSolver solver, unsigned int numPixels, int iterations, double buildMs, double iterationsMs);
+
+private:
+	mutable std::mutex mutex;
+	// Zero until measured.
+	double icpMs = 0;
+	// ICP skips since the last run, and whether the current run is a probe.
+	unsigned int icpSkips = 0;
+	bool icpProbe = false;
+	// Per pixel, for building the problem and for one iteration (evaluation and linear solve).
+	struct SolverCosts {
+		double buildMsPerPixel = 0.002;
+		double iterationMsPerPixel = 0.05;
+		bool measured = false;
+	};
+	// Indexed by OptimizationSolver.
+	SolverCosts solverCosts[2];
+};
@@ -0,0 +1,84 @@
+#include "stdafx.h"
+#include "Tracker.h"
+#include "CoarseAlignment.h"
+#include "LandmarkDetector.h"
+#include "Settings.h"
+#include "Profiler.h"
+#include "Log.h"
+
+bool FaceTracker::isTrackLost(const ICPStats& stats) const {
+	float inlierRatio = stats.numSourcePoints > 0 ? float(stats.numCorrespondences) / stats.numSourcePoints : 0.0f;
+	return stats.numCorrespondences < 6 || stats.rmse > gSettings.trackMaxRmse || inlierRatio < gSettings.trackMinInliers;
+}
+
+TrackingResult FaceTracker::track(Sensor& inputSensor) {
+	PROFILE_SCOPE("tracked frame");
+	TrackingResult result;
+	auto ms = [](std::chrono::high_resolution_clock::time_point from, std::chrono::high_resolution_clock::time_point to) {
+		return std::chrono::duration<double, std::milli>(to - from).count();
+	};
+	auto timeStart = std::chrono::high_resolution_clock::now();
+
+	if (initialized) {
+		result.pose = refinePoseProjectiveICP(model, params, inputSensor, pose, gSettings.trackICPIterations, &result.icpStats);
+		if (isTrackLost(result.icpStats)) {
+			LOG_INFO << "Lost track (rmse " << result.icpStats.rmse << ", " << result.icpStats.numCorrespondences << "/"
+				<< result.icpStats.numSourcePoints << " correspondences), fitting from scratch.";
+			initialized = false;
+		}
+	}
+
+	if (!initialized) {
+		if (inputSensor.m_featurePoints.empty()) {
+			LandmarkDetector detector(inputSensor.m_cameraIntrinsics);
+			if (!detector.detect(*inputSensor.compute_normals(), inputSensor.m_featurePoints)) {
+				result.faceFound = false;
+				result.params = model.createDefaultParameters();
+				result.pose = result.poseWithoutICP = Eigen::Matrix4f::Identity();
+				return result;
+			}
+		}
+		// The budget is per frame, including the ICP of a lost track.
+		ReconstructionOptions options = ReconstructionOptions::fromSettings();
+		if (options.timeBudgetMs > 0) {
+			options.timeBudgetMs = std::max(options.timeBudgetMs - ms(timeStart, std::chrono::high_resolution_clock::now()), 1e-3);
+		}
+		ReconstructionResult full = reconstructFace(model, inputSensor, &workspace, options);
+		static_cast<ReconstructionResult&>(result) = full;
+		result.reinitialized = true;
+		numReinitializations++;
+	}
+	else {
+		auto timeICP = std::chrono::high_resolution_clock::now();
+		result.poseWithoutICP = pose;
+		result.timings.icpMs = ms(timeStart, timeICP);
+		const bool budgeted = gSettings.timeBudgetMs > 0;
+		result.budget.budgetMs = budgeted ? gSettings.timeBudgetMs : 0.0;
+
+		if (gSettings.skipOptimization) {
+			result.params = params;
+		}
+		else {
+			OptimizerOptions optimizerOptions;
+			optimizerOptions.initialParams = &params;
+			optimizerOptions.maxIterations = int(gSettings.trackIterations);
+			optimizerOptions.workspace = &workspace;
+			// Whatever the ICP left, as in reconstructFace.
+			optimizerOptions.timeBudgetMs = budgeted ? std::max(gSettings.timeBudgetMs - ms(timeStart, timeICP), 1e-3) : 0.0;
+			result.params = optimizeParameters(model, result.pose, inputSensor, optimizerOptions, &result.optimizerReport);
+			result.pose = result.optimizerReport.refinedPose;
+			result.budget.cuts = result.optimizerReport.budgetCuts;
+		}
+		auto timeOptimization = std::chrono::high_resolution_clock::now();
+		result.timings.optimizationMs = ms(timeICP, timeOptimization);
+		result.timings.totalMs = ms(timeStart, timeOptimization);
+		if (budgeted) {
+			result.budget.met = result.timings.totalMs <= gSettings.timeBudgetMs;
+		}
+	}
+
+	params = result.params;
+	pose = result.pose;
+	initialized = true;
+	return result;
+}
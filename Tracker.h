@@ -0,0 +1,40 @@
+#pragma once
+#include "Pipeline.h"
+#include "ProjectiveICP.h"
+
+struct TrackingResult : ReconstructionResult {
+	// False if no face was found to (re)initialize on, the parameters and pose are then meaningless.
+	bool faceFound = true;
+	// Whether the frame was fitted from scratch (first frame or lost track).
+	bool reinitialized = false;
+	// Alignment quality of the pose refinement from the previous frame.
+	ICPStats icpStats;
+};
+
+// Fits a sequence of frames of one subject. Every frame starts from the pose and parameters of the
+// previous one: Procrustes is skipped, the pose is refined by a short projective ICP of the fitted
+// shape and the optimizer runs a capped number of iterations. When the ICP alignment gets worse
+// than the configured thresholds, the frame is fitted from scratch.
+class FaceTracker {
+public:
+	explicit FaceTracker(const FaceModel& model) : model(model) {}
+
+	// Feature points are only needed (and detected if missing) when fitting from scratch.
+	TrackingResult track(Sensor& inputSensor);
+
+	// Fits the next frame from scratch.
+	void reset() { initialized = false; }
+
+	unsigned int getNumReinitializations() const { return numReinitializations; }
+
+private:
+	const FaceModel& model;
+	FitWorkspace workspace;
+
+	bool initialized = false;
+	FaceParameters params;
+	Eigen::Matrix4f pose;
+	unsigned int numReinitializations = 0;
+
+	bool isTrackLost(const ICPStats& stats) const;
+};
@@ -1,43 +1,64 @@
 #pragma once
 #include "Sensor.h"
 #include "FeaturePointExtractor.h"
+#include "LandmarkDetector.h"
+#include "Settings.h"
+#include "Profiler.h"
+#include "Log.h"
 #include <pcl/io/pcd_io.h>
 
 class VirtualSensor : public Sensor {
 public:
 
 	explicit VirtualSensor(const std::string& filenamePcd, const std::string& filenameFeaturePoints) : Sensor() {
+		PROFILE_SCOPE("sensor load");
 		// load point cloud from file
 		if (pcl::io::loadPCDFile<pcl::PointXYZRGB>(filenamePcd, *m_cloud) == -1) {
-			std::cerr << "Couldn't read the pcd file " << filenamePcd << std::endl;
+			LOG_ERROR << "Couldn't read the pcd file " << filenamePcd;
 			exit(-1);
 		}
 
-		// load feature points from file
-		FeaturePointExtractor inputFeatureExtractor(filenameFeaturePoints, m_cloud);
-		m_featurePoints = inputFeatureExtractor.m_points;
+		m_cameraIntrinsics = intrinsicsForWidth(m_cloud->width);
 
-		// Use image width as a dirty workaround to infer the correct intrinsics from the input.
-		if (m_cloud->width == 640) {
-			// kinect
-			m_cameraIntrinsics <<
+		std::ifstream featurePointsFile(filenameFeaturePoints);
+		if (!featurePointsFile.is_open() && gSettings.autoLandmarks) {
+			// detect feature points, so that batch runs don't need hand-made files
+			LandmarkDetector detector(m_cameraIntrinsics);
+			if (!detector.detect(*compute_normals(), m_featurePoints)) {
+				LOG_ERROR << "Couldn't detect feature points in " << filenamePcd;
+				exit(-1);
+			}
+		}
+		else {
+			// load feature points from file
+			FeaturePointExtractor inputFeatureExtractor(filenameFeaturePoints, m_cloud);
+			m_featurePoints = inputFeatureExtractor.m_points;
+		}
+
+	};
+
+	// Use image width as a dirty workaround to infer the correct intrinsics from the input.
+	static Eigen::Matrix3f intrinsicsForWidth(unsigned int width) {
+		Eigen::Matrix3f intrinsics;
+		if (width != 960) {
+			// kinect, other widths (e.g. synthetic frames) are assumed to be scaled kinect frames
+			intrinsics <<
 				583.2829786373293, 0.0, 320.0,
 				0.0, 579.4112549695428, 240.0,
 				0.0, 0.0, 1.0;
+			intrinsics.topRows(2) *= width / 640.0f;
 		}
 		else {
 			// constants from the test RGBD dataset
-			m_cameraIntrinsics <<
+			intrinsics <<
 				1052.667867276341, 0, 962.4130834944134,
 				0, 1052.020917785721, 536.2206151001486,
 				0, 0, 1;
 
 			// since we care about the depth image and it is half the resolution of the color image,
 			// we need to adjust the intrinsics accordingly
-			m_cameraIntrinsics.topRows(2) /= 2;
+			intrinsics.topRows(2) /= 2;
 		}
-
-
-	};
-
+		return intrinsics;
+	}
 };
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include "stdafx.h"
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+#include <pcl/io/pcd_io.h>
+#include "SocketFrameSource.h"
+#include "Json.h"
+#include "Metrics.h"
+
+// Load generator for the reconstruction daemon: every connection sends its requests one after
+// another and waits for each result, so the concurrency equals the number of connections.
+int main(int argc, char **argv) {
+	std::string socketPath;
+	std::vector<std::string> inputFiles;
+	unsigned int numRequests;
+	unsigned int concurrency;
+	bool sendInline;
+	bool skipOptimization;
+	double timeBudgetMs;
+	bool shutdownDaemon;
+	try {
+		cxxopts::Options options(argv[0], "Sends reconstruction jobs to the daemon and reports request latencies.");
+		options.add_options()
+			("help", "Print help.")
+			("socket", "UNIX domain socket of the daemon.", cxxopts::value(socketPath)->default_value("/tmp/face_reconstruction_daemon.sock"))
+			("requests", "Total number of requests, looping over the inputs.", cxxopts::value(numRequests)->default_value("10"))
+			("concurrency", "Number of connections sending requests in parallel.", cxxopts::value(concurrency)->default_value("1"))
+			("inline", "Send the point clouds inline instead of their paths.", cxxopts::value(sendInline)->default_value("false"))
+			("skip-optimization", "Ask the daemon to skip the parameter optimization.", cxxopts::value(skipOptimization)->default_value("false"))
+			("time-budget-ms", "Time budget per request, as daemon option (0 = the daemon's).", cxxopts::value(timeBudgetMs)->default_value("0"))
+			("shutdown", "Shut the daemon down afterwards.", cxxopts::value(shutdownDaemon)->default_value("false"))
+			("inputs", "Input point cloud files (*.pcd).", cxxopts::value(inputFiles))
+			;
+		options.parse_positional("inputs");
+		options.positional_help("[inputs...]").show_positional_help();
+
+		auto result = options.parse(argc, argv);
+		if (result.count("help") || inputFiles.empty()) {
+			std::cout << options.help() << std::endl;
+			return 0;
+		}
+	}
+	catch (cxxopts::OptionException e) {
+		std::cerr << e.what() << std::endl;
+		return -2;
+	}
+
+	// Build the request bodies up front, so encoding doesn't count as latency.
+	std::string options = std::string("\"options\": {\"skip_optimization\": ") + (skipOptimization ? "true" : "false")
+		+ (timeBudgetMs > 0 ? ", \"time_budget_ms\": " + std::to_string(timeBudgetMs) : std::string()) + "}";
+	std::vector<std::string> bodies;
+	for (const std::string& file : inputFiles) {
+		if (!sendInline) {
+			char* absolutePath = realpath(file.c_str(), nullptr);
+			bodies.push_back("\"input\": " + jsonString(absolutePath ? absolutePath : file) + ", " + options);
+			free(absolutePath);
+			continue;
+		}
+		pcl::PointCloud<pcl::PointXYZRGB> cloud;
+		if (pcl::io::loadPCDFile<pcl::PointXYZRGB>(file, cloud) == -1) {
+			std::cerr << "Couldn't read the pcd file " << file << std::endl;
+			return -1;
+		}
+		std::vector<WirePoint> points = cloudToWirePoints(cloud);
+		bodies.push_back("\"frame\": {\"width\": " + std::to_string(cloud.width) + ", \"height\": " + std::to_string(cloud.height)
+			+ ", \"points\": \"" + encodeBase64(points.data(), points.size() * sizeof(WirePoint)) + "\"}, " + options);
+	}
+
+	LatencyStats latency;
+	std::atomic<unsigned int> nextRequest{ 0 };
+	std::atomic<unsigned int> numFailed{ 0 };
+	std::atomic<unsigned int> numOverBudget{ 0 };
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> connections;
+	for (unsigned int c = 0; c < std::max(concurrency, 1u); c++) {
+		connections.emplace_back([&] {
+			int fd = connectUnixSocket(socketPath);
+			if (fd < 0) {
+				std::cerr << "Couldn't connect to " << socketPath << std::endl;
+				numFailed++;
+				return;
+			}
+			SocketLineReader reader(fd, 1 << 20);
+			unsigned int request;
+			while ((request = nextRequest++) < numRequests) {
+				std::string line = "{\"id\": " + std::to_string(request) + ", " + bodies[request % bodies.size()] + "}\n";
+				auto sent = std::chrono::steady_clock::now();
+				std::string response;
+				if (!writeAll(fd, line.data(), line.size()) || !reader.readLine(response)) {
+					std::cerr << "Connection to the daemon closed." << std::endl;
+					numFailed++;
+					break;
+				}
+				latency.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sent).count());
+
+				JsonValue result;
+				std::string error;
+				if (!parseJson(response, result, error) || result.getString("status") != "ok") {
+					std::cerr << "Request " << request << " failed: " << (error.empty() ? result.getString("error") : error) << std::endl;
+					numFailed++;
+				}
+				else if (result.find("budget") && !result.find("budget")->getBool("met", true)) {
+					numOverBudget++;
+				}
+			}
+			::close(fd);
+		});
+	}
+	for (std::thread& connection : connections) {
+		connection.join();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << "{\"requests\": " << latency.count() << ", \"failed\": " << numFailed << ", \"over_budget\": " << numOverBudget
+		<< ", \"concurrency\": " << concurrency
+		<< ", \"seconds\": " << seconds << ", \"requests_per_second\": " << latency.count() / seconds << ", \"latency\": ";
+	latency.writeJson(std::cout);
+	std::cout << "}" << std::endl;
+
+	// Server-side view, which also includes the queue wait.
+	int fd = connectUnixSocket(socketPath);
+	if (fd >= 0) {
+		std::string command = shutdownDaemon ? "{\"command\": \"stats\"}\n{\"command\": \"shutdown\"}\n" : "{\"command\": \"stats\"}\n";
+		SocketLineReader reader(fd, 1 << 20);
+		std::string response;
+		if (writeAll(fd, command.data(), command.size()) && reader.readLine(response)) {
+			std::cout << response << std::endl;
+		}
+		::close(fd);
+	}
+	return numFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,83 @@
+#include "stdafx.h"
+#include <thread>
+#include <unistd.h>
+#include "SocketFrameSource.h"
+#include "VirtualSensor.h"
+
+// Local stand-in for a live RGB-D camera: replays recorded point clouds over a UNIX domain
+// socket at a target frame rate, so the ingest and fit path can be load-tested on one machine.
+int main(int argc, char **argv) {
+	std::string socketPath;
+	std::vector<std::string> inputFiles;
+	double fps;
+	unsigned int numFrames;
+	try {
+		cxxopts::Options options(argv[0], "Replays recorded point clouds as a live frame source.");
+		options.add_options()
+			("help", "Print help.")
+			("socket", "UNIX domain socket to send the frames to.", cxxopts::value(socketPath)->default_value("/tmp/face_reconstruction.sock"))
+			("fps", "Target frame rate.", cxxopts::value(fps)->default_value("15"))
+			("frames", "Number of frames to send, looping over the inputs (0 = each input once).", cxxopts::value(numFrames)->default_value("0"))
+			("inputs", "Input point cloud files (*.pcd).", cxxopts::value(inputFiles))
+			;
+		options.parse_positional("inputs");
+		options.positional_help("[inputs...]").show_positional_help();
+
+		auto result = options.parse(argc, argv);
+		if (result.count("help") || inputFiles.empty()) {
+			std::cout << options.help() << std::endl;
+			return 0;
+		}
+		if (!(fps > 0)) {
+			std::cerr << "The frame rate must be positive." << std::endl;
+			return -2;
+		}
+	}
+	catch (cxxopts::OptionException e) {
+		std::cerr << e.what() << std::endl;
+		return -2;
+	}
+
+	std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> clouds;
+	for (const auto& file : inputFiles) {
+		pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGB>);
+		if (pcl::io::loadPCDFile<pcl::PointXYZRGB>(file, *cloud) == -1) {
+			std::cerr << "Couldn't read the pcd file " << file << std::endl;
+			return -1;
+		}
+		clouds.push_back(cloud);
+	}
+	if (numFrames == 0) {
+		numFrames = clouds.size();
+	}
+
+	int fd = connectUnixSocket(socketPath);
+	if (fd < 0) {
+		std::cerr << "Couldn't connect to " << socketPath << std::endl;
+		return -1;
+	}
+
+	std::cout << "Sending " << numFrames << " frames at " << fps << " fps to " << socketPath << " ..." << std::endl;
+	auto frameInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / fps));
+	auto nextFrame = std::chrono::steady_clock::now();
+	auto start = nextFrame;
+	for (unsigned int i = 0; i < numFrames; i++) {
+		std::this_thread::sleep_until(nextFrame);
+		nextFrame += frameInterval;
+
+		Frame frame;
+		frame.cloud = clouds[i % clouds.size()];
+		frame.cameraIntrinsics = VirtualSensor::intrinsicsForWidth(frame.cloud->width);
+		frame.sequence = i;
+		frame.captureTime = std::chrono::system_clock::now();
+		if (!sendFrame(fd, frame)) {
+			std::cerr << "Connection closed after " << i << " frames." << std::endl;
+			break;
+		}
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Done, effective rate " << numFrames / seconds << " fps." << std::endl;
+
+	::close(fd);
+	return 0;
+}
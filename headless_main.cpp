@@ -0,0 +1,57 @@
+#include "stdafx.h"
+#include "Settings.h"
+#include "HeadlessRunner.h"
+#include "Daemon.h"
+#include "Profiler.h"
+#include "Log.h"
+
+// Entry point of the reconstruction without viewer, for batch processing on machines without display.
+int main(int argc, char **argv) {
+	try {
+		cxxopts::Options options(argv[0], "Reconstructs faces from RGB-D images without viewer.");
+		options.add_options()
+			("help", "Print help.")
+			("debug-images", "Write bitmaps of the input and of every rasterization.", cxxopts::value(gSettings.debugImages)->default_value("false"))
+			;
+		addSettingsOptions(options);
+		options.parse_positional("inputs");
+		options.positional_help("inputs...").show_positional_help();
+
+		auto result = options.parse(argc, argv);
+		if (result.count("help")) {
+			std::cout << options.help() << std::endl;
+			return 0;
+		}
+	}
+	catch (cxxopts::OptionException e) {
+		std::cerr << e.what() << std::endl;
+		return -2;
+	}
+	if (!Log::setLevel(gSettings.logLevel)) {
+		std::cerr << "Unknown log level " << gSettings.logLevel << std::endl;
+		return -2;
+	}
+	if (!checkSettings()) {
+		return -2;
+	}
+
+	gSettings.headless = true;
+	Profiler::instance().setEnabled(!gSettings.profileFile.empty() || !gSettings.traceFile.empty());
+
+	int status;
+	if (gSettings.daemon) {
+		status = runDaemon();
+	}
+	else if (!gSettings.liveSocket.empty()) {
+		status = runLiveIngest();
+	}
+	else if (gSettings.inputFiles.empty()) {
+		std::cerr << "No inputs given. Pass files, glob patterns or @list files." << std::endl;
+		return -2;
+	}
+	else {
+		status = runHeadlessBatch(gSettings.inputFiles);
+	}
+	writeProfilerReports(gSettings.profileFile, gSettings.traceFile);
+	return status;
+}
@@ -0,0 +1,114 @@
+#include "stdafx.h"
+#include <iomanip>
+#include "Settings.h"
+#include "VirtualSensor.h"
+#include "FaceModel.h"
+#include "CoarseAlignment.h"
+#include "ProjectiveICP.h"
+#include "Log.h"
+
+using namespace Eigen;
+
+// Rotation angle (degrees) and translation distance (mm) between two poses.
+static std::pair<float, float> poseError(const Matrix4f& a, const Matrix4f& b) {
+	Matrix3f ra = a.topLeftCorner<3, 3>() / std::cbrt(a.topLeftCorner<3, 3>().determinant());
+	Matrix3f rb = b.topLeftCorner<3, 3>() / std::cbrt(b.topLeftCorner<3, 3>().determinant());
+	float angle = AngleAxisf(ra.transpose() * rb).angle() * 180.0f / float(EIGEN_PI);
+	float distance = (a.topRightCorner<3, 1>() - b.topRightCorner<3, 1>()).norm() * 1000.0f;
+	return { angle, distance };
+}
+
+// Measures the trade-off between ICP latency and pose error for different numbers of
+// normal-space sampled model vertices. The error is measured against projective ICP
+// on all model vertices run to convergence.
+int main(int argc, char **argv) {
+	unsigned int repetitions;
+	try {
+		cxxopts::Options options(argv[0], "Benchmarks coarse alignment with sampled model vertices.");
+		options.add_options()
+			("help", "Print help.")
+			("input", "Input point cloud file (*.pcl).", cxxopts::value(gSettings.inputFile)->default_value("../data/rgbd_face_dataset/006_00_cloud.pcd"))
+			("repetitions", "Number of timed runs per configuration.", cxxopts::value(repetitions)->default_value("10"))
+			;
+		addSettingsOptions(options);
+		options.parse_positional("input");
+		options.positional_help("[input]").show_positional_help();
+
+		auto result = options.parse(argc, argv);
+		if (result.count("help")) {
+			std::cout << options.help() << std::endl;
+			return 0;
+		}
+	}
+	catch (cxxopts::OptionException e) {
+		std::cerr << e.what() << std::endl;
+		return -2;
+	}
+	if (!Log::setLevel(gSettings.logLevel)) {
+		std::cerr << "Unknown log level " << gSettings.logLevel << std::endl;
+		return -2;
+	}
+	if (!checkSettings()) {
+		return -2;
+	}
+
+	std::string inputFace = gSettings.inputFile;
+	std::string inputFeatures = inputFace.substr(0, inputFace.length() - 3) + "points";
+	Sensor inputSensor = VirtualSensor(inputFace, inputFeatures);
+	FaceModel model = FaceModel::fromSettings();
+
+	Matrix4f initialPose = computeCoarseAlignmentProcrustes(model, inputSensor);
+	pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr target = inputSensor.compute_normals();
+	Map<const Matrix3Xf> modelVertices(model.m_averageMesh.vertices.data(), 3, model.getNumVertices());
+
+	ProjectiveICP icp(inputSensor.m_cameraIntrinsics);
+	icp.maxIterations = 100;
+	icp.convergenceEpsilon = 1e-7f;
+	Matrix4f reference = icp.estimatePose(modelVertices, model.m_averageNormals, *target, initialPose);
+	icp.maxIterations = 20;
+	icp.convergenceEpsilon = 1e-5f;
+
+	std::cout << std::endl << std::setw(10) << "samples" << std::setw(10) << "refine"
+		<< std::setw(12) << "time [ms]" << std::setw(12) << "iterations"
+		<< std::setw(12) << "rot [deg]" << std::setw(12) << "trans [mm]" << std::endl;
+
+	auto run = [&](const std::string& label, const Matrix3Xf& points, const Matrix3Xf& normals, bool refineFull) {
+		double totalMs = 0;
+		ICPStats stats;
+		Matrix4f pose;
+		for (unsigned int r = 0; r < repetitions; r++) {
+			auto start = std::chrono::high_resolution_clock::now();
+			pose = icp.estimatePose(points, normals, *target, initialPose, &stats);
+			if (refineFull) {
+				ProjectiveICP refineIcp(inputSensor.m_cameraIntrinsics);
+				refineIcp.maxIterations = 3;
+				pose = refineIcp.estimatePose(modelVertices, model.m_averageNormals, *target, pose);
+			}
+			totalMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		}
+		auto error = poseError(reference, pose);
+		std::cout << std::setw(10) << label << std::setw(10) << (refineFull ? "yes" : "no")
+			<< std::setw(12) << totalMs / repetitions << std::setw(12) << stats.iterations
+			<< std::setw(12) << error.first << std::setw(12) << error.second << std::endl;
+	};
+
+	for (unsigned int numSamples : { 250u, 500u, 1000u, 2000u, 4000u, 8000u }) {
+		std::vector<unsigned int> indices = model.computeNormalSpaceSample(numSamples);
+		Matrix3Xf points(3, indices.size()), normals(3, indices.size());
+		for (size_t i = 0; i < indices.size(); i++) {
+			points.col(i) = modelVertices.col(indices[i]);
+			normals.col(i) = model.m_averageNormals.col(indices[i]);
+		}
+		run(std::to_string(indices.size()), points, normals, false);
+		run(std::to_string(indices.size()), points, normals, true);
+	}
+	run("all", modelVertices, model.m_averageNormals, false);
+
+	// The kd-tree ICP this replaces, for reference.
+	auto start = std::chrono::high_resolution_clock::now();
+	Matrix4f pclPose = computeCoarseAlignmentPCLICP(model, inputSensor, initialPose);
+	double pclMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	auto pclError = poseError(reference, pclPose);
+	std::cout << "PCL ICP: " << pclMs << " ms, rot " << pclError.first << " deg, trans " << pclError.second << " mm" << std::endl;
+	return 0;
+}
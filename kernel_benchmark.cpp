@@ -0,0 +1,488 @@
+#include "stdafx.h"
+#include <map>
+#include <memory>
+#include <benchmark/benchmark.h>
+#include <pcl/common/io.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "Settings.h"
+#include "FaceModel.h"
+#include "Rasterizer.h"
+#include "Optimizer.h"
+#include "OptimizerFunctors.h"
+#include "AlternatingSolver.h"
+#include "ProcrustesAligner.h"
+#include "ProjectiveICP.h"
+#include "SyntheticFrame.h"
+#include "Log.h"
+
+using namespace Eigen;
+
+// Microbenchmarks of the numeric kernels of the pipeline, on synthetic models of different sizes.
+// If the MorphableModel data is found (--model-dir), the model kernels are measured on it as well,
+// as "real" variants. Google Benchmark flags (e.g. --benchmark_filter) are passed through.
+
+static const float FACE_DISTANCE = 0.7f;
+
+// Models are created once and kept for all benchmarks. Vertex count 0 stands for the real model,
+// which has a fixed rank.
+static const FaceModel& getModel(unsigned int numVertices, unsigned int numEigenVec) {
+	static std::map<std::pair<unsigned int, unsigned int>, std::unique_ptr<FaceModel>> cache;
+	auto& model = cache[{ numVertices, numVertices == 0 ? 0 : numEigenVec }];
+	if (!model) {
+		if (numVertices == 0) {
+			model.reset(new FaceModel(gSettings.modelDir));
+		}
+		else {
+			unsigned int gridSize = static_cast<unsigned int>(std::lround(std::sqrt(double(numVertices))));
+			model.reset(new FaceModel(FaceModel::createSynthetic(gridSize, numEigenVec)));
+		}
+	}
+	return *model;
+}
+
+static void setThreads(int numThreads) {
+#ifdef _OPENMP
+	omp_set_num_threads(numThreads);
+#endif
+}
+
+// Random parameters within the typical range of fitted faces.
+static FaceParameters randomParameters(const FaceModel& model, unsigned int seed) {
+	std::mt19937 rng(seed);
+	std::normal_distribution<float> normal(0.0f, 0.5f);
+	FaceParameters params = model.createDefaultParameters();
+	for (int i = 0; i < params.alpha.size(); i++) {
+		params.alpha(i) = normal(rng);
+	}
+	return params;
+}
+
+// Slightly rotated and shifted pose, as left after coarse alignment.
+static Matrix4f perturbedPose(const Matrix4f& pose) {
+	Matrix4f perturbation = Matrix4f::Identity();
+	perturbation.topLeftCorner<3, 3>() = AngleAxisf(2.0f * float(EIGEN_PI) / 180.0f, Vector3f(1, 2, 0).normalized()).toRotationMatrix();
+	perturbation.topRightCorner<3, 1>() = Vector3f(0.004f, -0.003f, 0.005f);
+	return perturbation * pose;
+}
+
+// Model kernels. Args: vertex count, PCA rank.
+
+static void BM_ComputeShape(benchmark::State& state) {
+	const FaceModel& model = getModel(state.range(0), state.range(1));
+	FaceParameters params = randomParameters(model, 1);
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(model.computeShape(params));
+	}
+	state.SetItemsProcessed(state.iterations() * model.getNumVertices());
+}
+
+static void BM_ComputeColors(benchmark::State& state) {
+	const FaceModel& model = getModel(state.range(0), state.range(1));
+	FaceParameters params = model.createDefaultParameters();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(model.computeColors(params));
+	}
+	state.SetItemsProcessed(state.iterations() * model.getNumVertices());
+}
+
+// Args: vertex count.
+static void BM_ComputeNormals(benchmark::State& state) {
+	const FaceModel& model = getModel(state.range(0), 10);
+	VectorXf vertices = model.computeShape(randomParameters(model, 1));
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(model.computeNormals(vertices));
+	}
+	state.SetItemsProcessed(state.iterations() * model.getNumVertices());
+}
+
+static void modelArguments(benchmark::internal::Benchmark* b) {
+	for (int numVertices : { 2500, 10000, 53361 }) {
+		for (int numEigenVec : { 10, 40, 80, 160, 199 }) {
+			b->Args({ numVertices, numEigenVec });
+		}
+	}
+	b->ArgNames({ "vertices", "rank" })->Unit(benchmark::kMicrosecond);
+}
+BENCHMARK(BM_ComputeShape)->Apply(modelArguments);
+BENCHMARK(BM_ComputeColors)->Apply(modelArguments);
+
+// Shape from the coefficients of a compiled rank (see ModelRank.h) of a model with all 199 vectors, as
+// the rasterizer computes it during a fit. Args: vertex count, rank.
+static void BM_ComputeShapeRank(benchmark::State& state) {
+	const FaceModel& model = getModel(state.range(0), SYNTHETIC_NUM_EIGEN_VEC);
+	ModelRank rank;
+	if (!selectModelRank(unsigned(state.range(1)), model.getNumEigenVec(), unsigned(model.m_albedoBasis.cols()), rank)) {
+		state.SkipWithError("no compiled rank fits the model");
+		return;
+	}
+	FaceParameters params = randomParameters(model, 1);
+	params.alpha.tail(params.alpha.size() - rank.numAlpha).setZero();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(model.computeShape(params, rank));
+	}
+	state.SetItemsProcessed(state.iterations() * model.getNumVertices());
+}
+BENCHMARK(BM_ComputeShapeRank)
+	->ArgsProduct({ { 2500, 10000, 53361 }, { 10, 20, 40, 80, 160, 199 } })
+	->ArgNames({ "vertices", "rank" })->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ComputeNormals)->Arg(2500)->Arg(10000)->Arg(53361)->ArgName("vertices")->Unit(benchmark::kMicrosecond);
+
+// Rasterizer. Args: vertex count and PCA rank, or vertex count and frame width.
+
+static void BM_RasterizerProject(benchmark::State& state) {
+	const FaceModel& model = getModel(state.range(0), state.range(1));
+	FaceParameters params = model.createDefaultParameters();
+	Array2i frameSize = syntheticFrameSize(640);
+	Matrix3f intrinsics = syntheticIntrinsics(frameSize);
+	Matrix4f pose = frontalFacePose(FACE_DISTANCE);
+	Rasterizer rasterizer(frameSize, model, pose, intrinsics);
+	Matrix3Xf projectedVertices, worldNormals;
+	Matrix4Xi vertexAlbedos;
+	for (auto _ : state) {
+		rasterizer.project(params, projectedVertices, vertexAlbedos, worldNormals);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * model.getNumVertices());
+}
+BENCHMARK(BM_RasterizerProject)->Apply(modelArguments);
+
+static void BM_RasterizerRasterize(benchmark::State& state) {
+	const FaceModel& model = getModel(state.range(0), 10);
+	FaceParameters params = model.createDefaultParameters();
+	Array2i frameSize = syntheticFrameSize(state.range(1));
+	Matrix3f intrinsics = syntheticIntrinsics(frameSize);
+	Matrix4f pose = frontalFacePose(FACE_DISTANCE);
+	Rasterizer rasterizer(frameSize, model, pose, intrinsics);
+	Matrix3Xf projectedVertices, worldNormals;
+	Matrix4Xi vertexAlbedos;
+	rasterizer.project(params, projectedVertices, vertexAlbedos, worldNormals);
+	for (auto _ : state) {
+		rasterizer.rasterize(projectedVertices, vertexAlbedos, worldNormals);
+		benchmark::ClobberMemory();
+	}
+	state.counters["pixels"] = double(std::count_if(rasterizer.pixelResults.begin(), rasterizer.pixelResults.end(),
+		[](const PixelData& px) { return px.isValid; }));
+	state.SetItemsProcessed(state.iterations() * model.m_averageMesh.triangles.cols());
+}
+BENCHMARK(BM_RasterizerRasterize)
+	->ArgsProduct({ { 2500, 10000, 53361 }, { 320, 640, 960 } })
+	->ArgNames({ "vertices", "width" })->Unit(benchmark::kMicrosecond);
+
+// Optimizer. The functors are compiled per rank (see ModelRank.h); unless noted, these run the
+// default rank on a model of rank NUM_ALPHA_VEC.
+
+// Rendered input frame with the rasterization of the average face, as at the start of a fit.
+struct OptimizerFixture {
+	const FaceModel& model;
+	Array2i frameSize;
+	Matrix3f intrinsics;
+	Matrix4f pose;
+	Vector3f colorDelta = Vector3f::Zero();
+	pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr input;
+	Rasterizer rasterizer;
+
+	OptimizerFixture(int width, unsigned int numEigenVec = NUM_ALPHA_VEC)
+		: model(getModel(10000, numEigenVec)), frameSize(syntheticFrameSize(width)),
+		intrinsics(syntheticIntrinsics(frameSize)), pose(frontalFacePose(FACE_DISTANCE)),
+		input(renderFaceCloud(model, randomParameters(model, 2), perturbedPose(pose), intrinsics, frameSize)),
+		rasterizer(frameSize, model, pose, intrinsics) {
+		Matrix3Xf projectedVertices, worldNormals;
+		Matrix4Xi vertexAlbedos;
+		rasterizer.project(model.createDefaultParameters(), projectedVertices, vertexAlbedos, worldNormals);
+		rasterizer.rasterize(projectedVertices, vertexAlbedos, worldNormals);
+	}
+};
+
+// One pixel residual with Jacobians, with the functor of a compiled rank on a model with all 199
+// vectors. Args: whether the pose correction is optimized as well, rank.
+static void BM_ResidualEvaluation(benchmark::State& state) {
+	OptimizerFixture fixture(640, SYNTHETIC_NUM_EIGEN_VEC);
+	const bool withPose = state.range(0) != 0;
+	ModelRank rank;
+	if (!selectModelRank(unsigned(state.range(1)), fixture.model.getNumEigenVec(), unsigned(fixture.model.m_albedoBasis.cols()), rank)) {
+		state.SkipWithError("no compiled rank fits the model");
+		return;
+	}
+
+	// Center pixel, which is covered by both the input and the rendering.
+	int index = (fixture.frameSize.y() / 2) * fixture.frameSize.x() + fixture.frameSize.x() / 2;
+	const pcl::PointXYZRGBNormal& point = fixture.input->points[index];
+	if (!std::isfinite(point.z) || !fixture.rasterizer.pixelResults[index].isValid) {
+		state.SkipWithError("center pixel not covered by the face");
+		return;
+	}
+	PixelResidual pixel(point, fixture.rasterizer.pixelResults[index], fixture.model, fixture.pose, fixture.intrinsics, fixture.colorDelta);
+	std::unique_ptr<ceres::CostFunction> costFunction(dispatchRank(rank, [&](auto fixedRank) -> ceres::CostFunction* {
+		typedef decltype(fixedRank) Rank;
+		if (withPose) {
+			return new ceres::AutoDiffCostFunction<ResidualFunctor<Rank>, NUM_DENSE_RESIDUALS, Rank::NUM_ALPHA, Rank::NUM_BETA, NUM_ROTATION_PARAMS, NUM_TRANSLATION_PARAMS>(
+				new ResidualFunctor<Rank>(pixel));
+		}
+		return new ceres::AutoDiffCostFunction<ResidualFunctor<Rank>, NUM_DENSE_RESIDUALS, Rank::NUM_ALPHA, Rank::NUM_BETA>(new ResidualFunctor<Rank>(pixel));
+	}));
+
+	std::vector<double> alpha(rank.numAlpha), beta(rank.numBeta);
+	double rotation[NUM_ROTATION_PARAMS] = { 1, 0, 0, 0 };
+	double translation[NUM_TRANSLATION_PARAMS] = { 0, 0, 0 };
+	const double* parameters[] = { alpha.data(), beta.data(), rotation, translation };
+	std::vector<double> jacobianAlpha(NUM_DENSE_RESIDUALS * rank.numAlpha), jacobianBeta(NUM_DENSE_RESIDUALS * rank.numBeta),
+		jacobianRotation(NUM_DENSE_RESIDUALS * NUM_ROTATION_PARAMS), jacobianTranslation(NUM_DENSE_RESIDUALS * NUM_TRANSLATION_PARAMS);
+	double* jacobians[] = { jacobianAlpha.data(), jacobianBeta.data(), jacobianRotation.data(), jacobianTranslation.data() };
+	double residuals[NUM_DENSE_RESIDUALS];
+	for (auto _ : state) {
+		costFunction->Evaluate(parameters, residuals, jacobians);
+		benchmark::ClobberMemory();
+	}
+}
+BENCHMARK(BM_ResidualEvaluation)
+	->ArgsProduct({ { 0, 1 }, { 10, 20, 40, 80, 160, 199 } })
+	->ArgNames({ "pose", "rank" });
+
+// The same pixel as separate geometry (over alpha) and color (over beta) residuals with Jacobians.
+static void BM_SeparateResidualEvaluation(benchmark::State& state) {
+	OptimizerFixture fixture(640);
+	int index = (fixture.frameSize.y() / 2) * fixture.frameSize.x() + fixture.frameSize.x() / 2;
+	const pcl::PointXYZRGBNormal& point = fixture.input->points[index];
+	if (!std::isfinite(point.z) || !fixture.rasterizer.pixelResults[index].isValid) {
+		state.SkipWithError("center pixel not covered by the face");
+		return;
+	}
+	PixelResidual pixel(point, fixture.rasterizer.pixelResults[index], fixture.model, fixture.pose, fixture.intrinsics, fixture.colorDelta);
+	typedef GeometryResidualFunctor<DefaultRank> Geometry;
+	typedef ColorResidualFunctor<DefaultRank> Color;
+	ceres::AutoDiffCostFunction<Geometry, Geometry::NUM_RESIDUALS, NUM_ALPHA_VEC> geometry(new Geometry(pixel));
+	ceres::AutoDiffCostFunction<Color, Color::NUM_RESIDUALS, NUM_BETA_VEC> color(new Color(pixel));
+
+	std::vector<double> alpha(NUM_ALPHA_VEC), beta(NUM_BETA_VEC);
+	const double* alphaParameters[] = { alpha.data() };
+	const double* betaParameters[] = { beta.data() };
+	std::vector<double> jacobianAlpha(Geometry::NUM_RESIDUALS * NUM_ALPHA_VEC), jacobianBeta(Color::NUM_RESIDUALS * NUM_BETA_VEC);
+	double* alphaJacobians[] = { jacobianAlpha.data() };
+	double* betaJacobians[] = { jacobianBeta.data() };
+	double residuals[NUM_DENSE_RESIDUALS];
+	for (auto _ : state) {
+		geometry.Evaluate(alphaParameters, residuals, alphaJacobians);
+		color.Evaluate(betaParameters, residuals, betaJacobians);
+		benchmark::ClobberMemory();
+	}
+}
+BENCHMARK(BM_SeparateResidualEvaluation);
+
+// Problem construction with a residual block per pixel (tile 0) or per tile.
+// Args: frame width, tile size, whether geometry and color have separate blocks.
+static void BM_ProblemBuild(benchmark::State& state) {
+	OptimizerFixture fixture(state.range(0));
+	std::vector<double> alpha(NUM_ALPHA_VEC), beta(NUM_BETA_VEC);
+	unsigned int numPixels = 0;
+	int numBlocks = 0;
+	for (auto _ : state) {
+		std::unique_ptr<ceres::Problem> problem(new ceres::Problem());
+		numPixels = addPixelResidualBlocks(*problem, *fixture.input, fixture.rasterizer.pixelResults, fixture.model,
+			fixture.pose, fixture.intrinsics, fixture.colorDelta, 1, unsigned(state.range(1)), state.range(2) != 0, nullptr, ModelRank(), alpha.data(), beta.data());
+		state.PauseTiming();
+		numBlocks = problem->NumResidualBlocks();
+		problem.reset();
+		state.ResumeTiming();
+	}
+	state.counters["pixels"] = numPixels;
+	state.counters["blocks"] = numBlocks;
+}
+BENCHMARK(BM_ProblemBuild)
+	->ArgsProduct({ { 320, 640, 960 }, { 0, 8, 16, 32 }, { 0, 1 } })
+	->ArgNames({ "width", "tile", "separate" })->Unit(benchmark::kMillisecond);
+
+// Cost and gradient of the whole problem, as done by the solver in every iteration.
+// Args: frame width, tile size (0 = a block per pixel), separate geometry and color blocks, threads.
+static void BM_ProblemEvaluate(benchmark::State& state) {
+	OptimizerFixture fixture(state.range(0));
+	std::vector<double> alpha(NUM_ALPHA_VEC), beta(NUM_BETA_VEC);
+	ceres::Problem problem;
+	unsigned int numPixels = addPixelResidualBlocks(problem, *fixture.input, fixture.rasterizer.pixelResults, fixture.model,
+		fixture.pose, fixture.intrinsics, fixture.colorDelta, 1, unsigned(state.range(1)), state.range(2) != 0, nullptr, ModelRank(), alpha.data(), beta.data());
+	ceres::Problem::EvaluateOptions options;
+	options.num_threads = int(state.range(3));
+	double cost;
+	std::vector<double> gradient;
+	for (auto _ : state) {
+		problem.Evaluate(options, &cost, nullptr, &gradient, nullptr);
+	}
+	state.counters["pixels"] = numPixels;
+	state.counters["blocks"] = problem.NumResidualBlocks();
+}
+BENCHMARK(BM_ProblemEvaluate)
+	->ArgsProduct({ { 320, 640, 960 }, { 0, 16 }, { 0, 1 }, { 1, 2, 4, 8 } })
+	->ArgNames({ "width", "tile", "separate", "threads" })->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Alternating solver from the average face, in double, float and mixed precision (see SolverPrecision),
+// with normal equations or conjugate gradients. Reports the relative difference of the fitted parameters
+// to the double normal equations solution, and the final cost.
+// Args: frame width, precision (0 double, 1 float, 2 mixed), linear solver (0 normal, 1 cg).
+static void BM_AlternatingSolve(benchmark::State& state) {
+	OptimizerFixture fixture(state.range(0));
+	std::vector<double> alpha(NUM_ALPHA_VEC), beta(NUM_BETA_VEC);
+	auto rasterize = [&] {
+		FaceParameters params = fixture.model.createDefaultParameters();
+		params.alpha.head<NUM_ALPHA_VEC>() = Map<const VectorXd>(alpha.data(), NUM_ALPHA_VEC).cast<float>();
+		params.beta.head<NUM_BETA_VEC>() = Map<const VectorXd>(beta.data(), NUM_BETA_VEC).cast<float>();
+		fixture.rasterizer.compute(params);
+	};
+	AlternatingSolverOptions options;
+	options.stride = 2;
+	options.maxIterations = 20;
+	std::fill(alpha.begin(), alpha.end(), 0.0);
+	std::fill(beta.begin(), beta.end(), 0.0);
+	rasterize();
+	solveAlternating(fixture.model, *fixture.input, fixture.rasterizer.pixelResults, rasterize, fixture.pose,
+		fixture.intrinsics, fixture.colorDelta, options, ModelRank(), alpha.data(), beta.data());
+	VectorXd referenceAlpha = Map<const VectorXd>(alpha.data(), NUM_ALPHA_VEC);
+	VectorXd referenceBeta = Map<const VectorXd>(beta.data(), NUM_BETA_VEC);
+
+	options.precision = state.range(1) == 0 ? SolverPrecision::Double
+		: state.range(1) == 1 ? SolverPrecision::Float : SolverPrecision::Mixed;
+	options.linearSolver = state.range(2) == 0 ? LinearSolver::NormalEquations : LinearSolver::ConjugateGradient;
+	AlternatingSolverReport report;
+	for (auto _ : state) {
+		state.PauseTiming();
+		std::fill(alpha.begin(), alpha.end(), 0.0);
+		std::fill(beta.begin(), beta.end(), 0.0);
+		rasterize();
+		state.ResumeTiming();
+		report = solveAlternating(fixture.model, *fixture.input, fixture.rasterizer.pixelResults, rasterize, fixture.pose,
+			fixture.intrinsics, fixture.colorDelta, options, ModelRank(), alpha.data(), beta.data());
+	}
+	state.counters["iterations"] = report.iterations;
+	state.counters["cg_iterations"] = report.cgIterations;
+	state.counters["cost"] = report.finalCost;
+	state.counters["alpha_error"] = (Map<const VectorXd>(alpha.data(), NUM_ALPHA_VEC) - referenceAlpha).norm() / referenceAlpha.norm();
+	state.counters["beta_error"] = (Map<const VectorXd>(beta.data(), NUM_BETA_VEC) - referenceBeta).norm() / referenceBeta.norm();
+}
+BENCHMARK(BM_AlternatingSolve)
+	->ArgsProduct({ { 320, 640 }, { 0, 1, 2 }, { 0, 1 } })
+	->ArgNames({ "width", "precision", "cg" })->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Whole parameter optimization from the average face with Ceres, the baseline, and with the
+// alternating solver without polish, on the same input. Reports the final cost, so the time of the
+// solvers can be compared at their accuracy. Args: frame width, solver (0 ceres, 1 alternating).
+static void BM_SolverComparison(benchmark::State& state) {
+	OptimizerFixture fixture(state.range(0));
+	Sensor sensor;
+	pcl::copyPointCloud(*fixture.input, *sensor.m_cloud);
+	sensor.m_cameraIntrinsics = fixture.intrinsics;
+
+	const Settings settings = gSettings;
+	gSettings.optimizationSolver = state.range(1) == 0 ? "ceres" : "alternating";
+	gSettings.optimizationStride = 2;
+	gSettings.polishIterations = 0;
+	gSettings.optimizePose = false;
+	OptimizerOptions options;
+	options.maxIterations = 20;
+	OptimizerReport report;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(optimizeParameters(fixture.model, fixture.pose, sensor, options, &report));
+	}
+	gSettings = settings;
+	state.counters["iterations"] = report.iterations;
+	state.counters["pixels"] = report.numPixels;
+	state.counters["cost"] = report.finalCost;
+}
+BENCHMARK(BM_SolverComparison)
+	->ArgsProduct({ { 320, 640 }, { 0, 1 } })
+	->ArgNames({ "width", "alternating" })->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Coarse alignment.
+
+// Args: number of corresponding points (6 landmarks up to dense correspondences).
+static void BM_Procrustes(benchmark::State& state) {
+	std::mt19937 rng(3);
+	std::uniform_real_distribution<float> uniform(-0.1f, 0.1f);
+	Matrix4f pose = perturbedPose(frontalFacePose(FACE_DISTANCE));
+	std::vector<Vector3f> source, target;
+	for (int i = 0; i < state.range(0); i++) {
+		source.emplace_back(uniform(rng), uniform(rng), uniform(rng));
+		target.push_back((pose * source.back().homogeneous()).head<3>());
+	}
+	ProcrustesAligner aligner;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(aligner.estimatePose(source, target));
+	}
+}
+BENCHMARK(BM_Procrustes)->Arg(6)->Arg(68)->Arg(1000)->ArgName("points");
+
+// Projective ICP with a fixed number of iterations. Args: sampled model vertices, frame width, threads.
+static void BM_ProjectiveICP(benchmark::State& state) {
+	const FaceModel& model = getModel(53361, 10);
+	Array2i frameSize = syntheticFrameSize(state.range(1));
+	Matrix3f intrinsics = syntheticIntrinsics(frameSize);
+	Matrix4f pose = frontalFacePose(FACE_DISTANCE);
+	auto target = renderFaceCloud(model, model.createDefaultParameters(), pose, intrinsics, frameSize);
+
+	std::vector<unsigned int> indices = model.computeNormalSpaceSample(state.range(0));
+	Matrix3Xf points(3, indices.size()), normals(3, indices.size());
+	for (size_t i = 0; i < indices.size(); i++) {
+		points.col(i) = model.m_averageMesh.vertices.segment<3>(3 * indices[i]);
+		normals.col(i) = model.m_averageNormals.col(indices[i]);
+	}
+
+	ProjectiveICP icp(intrinsics);
+	icp.maxIterations = 10;
+	icp.convergenceEpsilon = 0;
+	Matrix4f initialPose = perturbedPose(pose);
+	setThreads(int(state.range(2)));
+	ICPStats stats;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(icp.estimatePose(points, normals, *target, initialPose, &stats));
+	}
+	setThreads(int(getThreadsPerJob()));
+	state.counters["correspondences"] = stats.numCorrespondences;
+	state.counters["rmse_mm"] = stats.rmse * 1000.0f;
+}
+BENCHMARK(BM_ProjectiveICP)
+	->ArgsProduct({ { 500, 2000, 8000 }, { 320, 640, 960 }, { 1, 2, 4, 8 } })
+	->ArgNames({ "samples", "width", "threads" })->Unit(benchmark::kMicrosecond)->UseRealTime();
+
+int main(int argc, char** argv) {
+	benchmark::Initialize(&argc, argv);
+	try {
+		cxxopts::Options options(argv[0], "Microbenchmarks of the numeric kernels. Also accepts the Google Benchmark flags.");
+		options.add_options()
+			("help", "Print help.")
+			;
+		addSettingsOptions(options);
+
+		auto result = options.parse(argc, argv);
+		if (result.count("help")) {
+			std::cout << options.help() << std::endl;
+			return 0;
+		}
+	}
+	catch (cxxopts::OptionException e) {
+		std::cerr << e.what() << std::endl;
+		return -2;
+	}
+	if (!Log::setLevel(gSettings.logLevel)) {
+		std::cerr << "Unknown log level " << gSettings.logLevel << std::endl;
+		return -2;
+	}
+	if (!checkSettings()) {
+		return -2;
+	}
+
+	// The kernels print nothing, but the model loader and rasterizer setup do.
+	gSettings.debugImages = false;
+	if (std::ifstream(gSettings.modelDir + "averageMesh.off").good()) {
+		const FaceModel& real = getModel(0, 0);
+		int rank = int(real.getNumEigenVec());
+		benchmark::RegisterBenchmark("BM_ComputeShape/real", BM_ComputeShape)->Args({ 0, rank })->Unit(benchmark::kMicrosecond);
+		benchmark::RegisterBenchmark("BM_ComputeColors/real", BM_ComputeColors)->Args({ 0, rank })->Unit(benchmark::kMicrosecond);
+		benchmark::RegisterBenchmark("BM_ComputeNormals/real", BM_ComputeNormals)->Arg(0)->Unit(benchmark::kMicrosecond);
+		benchmark::RegisterBenchmark("BM_RasterizerProject/real", BM_RasterizerProject)->Args({ 0, rank })->Unit(benchmark::kMicrosecond);
+	}
+	else {
+		std::cerr << "No morphable model in " << gSettings.modelDir << ", running on synthetic models only." << std::endl;
+	}
+
+	benchmark::RunSpecifiedBenchmarks();
+	return 0;
+}
@@ -2,8 +2,11 @@
 #include "Settings.h"
 #include "VirtualSensor.h"
 #include "FaceModel.h"
-#include "CoarseAlignment.h"
-#include "Optimizer.h"
+#include "Pipeline.h"
+#include "HeadlessRunner.h"
+#include "Daemon.h"
+#include "Profiler.h"
+#include "FeaturePointPicker.h"
 #include "utils.h"
 #include <pcl/io/io.h>
 #include <pcl/io/pcd_io.h>
@@ -11,13 +14,9 @@
 #include <pcl/visualization/cloud_viewer.h>
 #include <pcl/features/normal_3d.h>
 #include "SwitchControl.h"
+#include "Log.h"
 
-const std::string baseModelDir = "../data/MorphableModel/";
-
-Settings gSettings;
-pcl::visualization::PCLVisualizer viewer("PCL Viewer");
-
-void highlightFeaturePoints(std::vector<Eigen::Vector3f> &featurePoints, const std::string &name) {
+void highlightFeaturePoints(pcl::visualization::PCLVisualizer& viewer, std::vector<Eigen::Vector3f> &featurePoints, const std::string &name) {
     pcl::PointCloud<pcl::PointXYZRGB>::Ptr points_to_highlight(new pcl::PointCloud<pcl::PointXYZRGB>);
 
     for (auto const &point: featurePoints) {
@@ -42,15 +41,12 @@ int main(int argc, char **argv) {
 		options.add_options()
 			("help", "Print help.")
 			("input", "Input point cloud file (*.pcl).", cxxopts::value(gSettings.inputFile)->default_value("../data/rgbd_face_dataset/006_00_cloud.pcd"))
-			("o,skip-optimization", "Skip fine optimization of face parameters completely.", cxxopts::value(gSettings.skipOptimization)->default_value("false"))
-			("opt-stride", "Pixel stride for fine optimization (>= 1).", cxxopts::value(gSettings.optimizationStride)->default_value("2"))
-			("s,opt-step", "Initial trust region size of the optimization.", cxxopts::value(gSettings.initialStepSize)->default_value("0.1"))
-			("S,opt-max-step", "Maximum trust region size of the optimization.", cxxopts::value(gSettings.maxStepSize)->default_value("0.25"))
-			("r,opt-reg-alpha", "Regularization strength for alpha parameters.", cxxopts::value(gSettings.regStrengthAlpha)->default_value("1.0"))
-			("R,opt-reg-beta", "Regularization strength for beta parameters.", cxxopts::value(gSettings.regStrengthBeta)->default_value("1.0"))
+			("headless", "Reconstruct all inputs without viewer and write the results to the output directory.", cxxopts::value(gSettings.headless)->default_value("false"))
+			("debug-images", "Write bitmaps of the input and of every rasterization.", cxxopts::value(gSettings.debugImages)->default_value("true"))
 			;
-		options.parse_positional("input");
-		options.positional_help("[input]").show_positional_help();
+		addSettingsOptions(options);
+		options.parse_positional("inputs");
+		options.positional_help("[inputs...]").show_positional_help();
 
 		auto result = options.parse(argc, argv);
 		if (result.count("help")) {
@@ -62,40 +58,60 @@ int main(int argc, char **argv) {
 		std::cerr << e.what() << std::endl;
 		return -2;
 	}
+	if (!Log::setLevel(gSettings.logLevel)) {
+		std::cerr << "Unknown log level " << gSettings.logLevel << std::endl;
+		return -2;
+	}
+	if (!checkSettings()) {
+		return -2;
+	}
+
+	Profiler::instance().setEnabled(!gSettings.profileFile.empty() || !gSettings.traceFile.empty());
+
+	// Modes without viewer return before any visualization object is constructed.
+	if (gSettings.daemon || !gSettings.liveSocket.empty() || gSettings.headless) {
+		int status;
+		if (gSettings.daemon) {
+			status = runDaemon();
+		}
+		else if (!gSettings.liveSocket.empty()) {
+			status = runLiveIngest();
+		}
+		else {
+			status = runHeadlessBatch(gSettings.inputFiles.empty() ? std::vector<std::string>{ gSettings.inputFile } : gSettings.inputFiles);
+		}
+		writeProfilerReports(gSettings.profileFile, gSettings.traceFile);
+		return status;
+	}
 
-	std::string inputFace = gSettings.inputFile;
+	pcl::visualization::PCLVisualizer viewer("PCL Viewer");
+	manualFeaturePointSelection() = pickFeaturePoints;
+
+	std::string inputFace = gSettings.inputFiles.empty() ? gSettings.inputFile : gSettings.inputFiles[0];
 	std::string inputFeatures = inputFace.substr(0, inputFace.length() - 3) + "points";
-	std::cout << "Loading input data ..." << std::endl;
-	std::cout << "    Input file: " << inputFace << std::endl;
+	LOG_INFO << "Loading input data ...";
+	LOG_INFO << "Input file: " << inputFace;
 	Sensor inputSensor = VirtualSensor(inputFace, inputFeatures);
 	
 	// visualize input point cloud (John)
 	viewer.addPointCloud<pcl::PointXYZRGB>(inputSensor.m_cloud, "inputCloud");
 	viewer.setPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, 2, "inputCloud");
-	highlightFeaturePoints(inputSensor.m_featurePoints, "inputCloudFeatures");
+	highlightFeaturePoints(viewer, inputSensor.m_featurePoints, "inputCloudFeatures");
 
 
-	std::cout << "Loading face model ..." << std::endl;
-	FaceModel model(baseModelDir);
+	LOG_INFO << "Loading face model ...";
+	FaceModel model = FaceModel::fromSettings();
 
-	std::cout << "Coarse alignment ..." << std::endl;
-	Eigen::Matrix4f poseWithoutICP = computeCoarseAlignmentProcrustes(model, inputSensor);
-	Eigen::Matrix4f pose = computeCoarseAlignmentICP(model, inputSensor, poseWithoutICP);
-	
-	FaceParameters params;
-	if (gSettings.skipOptimization) {
-		std::cout << "Skipping parameter optimization." << std::endl;
-		params = model.createDefaultParameters();
-	}
-	else {
-		std::cout << "Optimizing parameters ..." << std::endl;
-		params = optimizeParameters(model, pose, inputSensor);
-	}
+	ReconstructionResult result = reconstructFace(model, inputSensor);
+	const FaceParameters& params = result.params;
+	const Eigen::Matrix4f& pose = result.pose;
+	const Eigen::Matrix4f& poseWithoutICP = result.poseWithoutICP;
 
 	Eigen::VectorXf finalShape = model.computeShape(params);
 	Eigen::Matrix4Xi finalColors = model.computeColors(params);
 
-	std::cout << "Done!" << std::endl;
+	LOG_INFO << "Done!";
+	writeProfilerReports(gSettings.profileFile, gSettings.traceFile);
 
 	// visualize final reconstruction (Steve)
 	pcl::PointCloud<pcl::PointXYZRGB>::Ptr transformedCloud(new pcl::PointCloud<pcl::PointXYZRGB>());
@@ -110,7 +126,7 @@ int main(int argc, char **argv) {
 	FaceParameters defaultParams = model.createDefaultParameters();
 
 	SwitchControl sc(viewer, states, "a", "Tab", [&](int state, const std::vector<int>&props) {
-		std::cout << "Switching to " << (state == 0 ? "optimized" : "default") << " face." << std::endl;
+		LOG_INFO << "Switching to " << (state == 0 ? "optimized" : "default") << " face.";
 
 		FaceParameters newParams = (state == 0 ? params : defaultParams);
 		newParams = model.computeShapeAttribute(newParams, props[0], props[1], props[2]);
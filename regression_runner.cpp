@@ -0,0 +1,283 @@
+#include "stdafx.h"
+#include <iomanip>
+#include <map>
+#include "Settings.h"
+#include "FaceModel.h"
+#include "FrameSensor.h"
+#include "HeadlessRunner.h"
+#include "Json.h"
+#include "OptimizerFunctors.h"
+#include "Pipeline.h"
+#include "SyntheticFrame.h"
+#include "utils.h"
+#include "Log.h"
+
+using namespace Eigen;
+
+// Performance and accuracy regression run. Fits frames rendered from known parameters and the
+// recorded frames given as inputs, and checks the measurements against the budgets:
+//   { "<metric>": { "ratio": r, "slack": s, "max": m }, ... }
+// fails a frame if the metric exceeds r * baseline + s (r defaults to 1, the check is skipped
+// without ratio and slack) or the absolute maximum m. The baseline is the report of a previous
+// run (--update-baseline), kept per model as the measurements differ between models. Without a
+// baseline only the maxima are checked, which can't catch regressions, so the run exits with
+// NOT_CONFIGURED (reported as skipped by CTest) unless a maximum is exceeded.
+
+// Exit code of a run without baseline, the SKIP_RETURN_CODE of the CTest target.
+const int NOT_CONFIGURED = 77;
+
+typedef std::map<std::string, double> Metrics;
+
+// Rotation angle (degrees) and translation distance (mm) between two poses.
+static std::pair<double, double> poseError(const Matrix4f& a, const Matrix4f& b) {
+	Matrix3f ra = a.topLeftCorner<3, 3>() / std::cbrt(a.topLeftCorner<3, 3>().determinant());
+	Matrix3f rb = b.topLeftCorner<3, 3>() / std::cbrt(b.topLeftCorner<3, 3>().determinant());
+	double angle = AngleAxisf(ra.transpose() * rb).angle() * 180.0 / EIGEN_PI;
+	double distance = (a.topRightCorner<3, 1>() - b.topRightCorner<3, 1>()).norm() * 1000.0;
+	return { angle, distance };
+}
+
+// RMS difference of the fitted coefficients.
+static double coefficientRmse(const VectorXf& fitted, const VectorXf& truth, unsigned int count) {
+	int n = std::min<int>(count, std::min(fitted.size(), truth.size()));
+	return n > 0 ? std::sqrt((fitted.head(n) - truth.head(n)).squaredNorm() / n) : 0.0;
+}
+
+// Fits the input repetitions times. Timings are the minimum over the repetitions.
+static Metrics measure(const FaceModel& model, const Sensor& sensor, unsigned int repetitions, FitWorkspace& workspace,
+	ReconstructionResult& outResult) {
+	Metrics metrics;
+	for (unsigned int r = 0; r < std::max(repetitions, 1u); r++) {
+		outResult = reconstructFace(model, sensor, &workspace);
+		const StageTimings& t = outResult.timings;
+		std::pair<const char*, double> stages[] = {
+			{ "procrustes_ms", t.procrustesMs }, { "icp_ms", t.icpMs }, { "optimization_ms", t.optimizationMs }, { "total_ms", t.totalMs } };
+		for (const auto& stage : stages) {
+			metrics[stage.first] = r == 0 ? stage.second : std::min(metrics[stage.first], stage.second);
+		}
+	}
+	metrics["iterations"] = outResult.optimizerReport.iterations;
+	metrics["final_cost"] = outResult.optimizerReport.finalCost;
+	metrics["problem_build_ms"] = outResult.optimizerReport.problemBuildMs;
+	metrics["solver_overhead_ms"] = outResult.optimizerReport.overheadMsPerIteration;
+	return metrics;
+}
+
+// The coefficient errors are over the coefficients of the rank, the others aren't fitted.
+static Metrics measureSynthetic(const FaceModel& model, const ModelRank& rank, const SyntheticFrame& frame, unsigned int repetitions,
+	FitWorkspace& workspace) {
+	Sensor sensor;
+	sensor.m_cloud = frame.cloud;
+	sensor.m_featurePoints = frame.featurePoints;
+	sensor.m_cameraIntrinsics = frame.intrinsics;
+
+	ReconstructionResult result;
+	Metrics metrics = measure(model, sensor, repetitions, workspace, result);
+	metrics["alpha_rmse"] = coefficientRmse(result.params.alpha, frame.params.alpha, rank.numAlpha);
+	metrics["beta_rmse"] = coefficientRmse(result.params.beta, frame.params.beta, rank.numBeta);
+
+	// Distance of the posed vertices, so errors of shape and pose both count.
+	auto posed = [&](const FaceParameters& params, const Matrix4f& pose) {
+		VectorXf vertices = model.computeShape(params);
+		Matrix3Xf points = pose.topLeftCorner<3, 3>() * Map<const Matrix3Xf>(vertices.data(), 3, model.getNumVertices());
+		points.colwise() += pose.topRightCorner<3, 1>();
+		return points;
+	};
+	Matrix3Xf difference = posed(result.params, result.pose) - posed(frame.params, frame.pose);
+	metrics["vertex_rmse_mm"] = std::sqrt(difference.squaredNorm() / model.getNumVertices()) * 1000.0;
+	auto error = poseError(result.pose, frame.pose);
+	metrics["rotation_deg"] = error.first;
+	metrics["translation_mm"] = error.second;
+	return metrics;
+}
+
+static bool readJsonFile(const std::string& path, JsonValue& outValue) {
+	std::ifstream in(path);
+	if (!in) {
+		return false;
+	}
+	std::stringstream text;
+	text << in.rdbuf();
+	std::string error;
+	if (!parseJson(text.str(), outValue, error)) {
+		std::cerr << "Can not parse " << path << ": " << error << std::endl;
+		return false;
+	}
+	return true;
+}
+
+static bool writeReport(const std::string& path, const std::string& modelName, const std::vector<std::pair<std::string, Metrics>>& frames) {
+	std::ofstream out(path);
+	out << std::setprecision(6) << "{" << std::endl;
+	out << "  \"model\": " << jsonString(modelName) << "," << std::endl;
+	out << "  \"frames\": {" << std::endl;
+	for (size_t i = 0; i < frames.size(); i++) {
+		out << "    " << jsonString(frames[i].first) << ": {";
+		bool first = true;
+		for (const auto& metric : frames[i].second) {
+			out << (first ? " " : ", ") << jsonString(metric.first) << ": " << metric.second;
+			first = false;
+		}
+		out << " }" << (i + 1 < frames.size() ? "," : "") << std::endl;
+	}
+	out << "  }" << std::endl << "}" << std::endl;
+	return out.good();
+}
+
+// Checks one metric against its budget. Returns a description of the violation, or an empty string.
+static std::string checkBudget(double value, const JsonValue& budget, const double* baseline) {
+	std::ostringstream violation;
+	violation << std::setprecision(4);
+	if (budget.find("max") && value > budget.getNumber("max")) {
+		violation << value << " > max " << budget.getNumber("max");
+	}
+	else if (baseline && (budget.find("ratio") || budget.find("slack"))) {
+		double limit = budget.getNumber("ratio", 1.0) * *baseline + budget.getNumber("slack");
+		if (value > limit) {
+			violation << value << " > " << limit << " (baseline " << *baseline << ")";
+		}
+	}
+	return violation.str();
+}
+
+int main(int argc, char **argv) {
+	std::string budgetsFile, baselineFile, reportFile;
+	bool updateBaseline;
+	unsigned int numSyntheticFrames, syntheticWidth, repetitions;
+	try {
+		cxxopts::Options options(argv[0], "Fits a fixed corpus and checks time and accuracy against a baseline and budgets.");
+		options.add_options()
+			("help", "Print help.")
+			("budgets", "Budgets of the metrics (JSON).", cxxopts::value(budgetsFile)->default_value("budgets.json"))
+			("baseline", "Baseline report (default: baseline_<model>.json).", cxxopts::value(baselineFile)->default_value(""))
+			("report", "File to write the measurements to (JSON).", cxxopts::value(reportFile)->default_value("regression_report.json"))
+			("update-baseline", "Write the measurements as new baseline instead of checking them.", cxxopts::value(updateBaseline)->default_value("false"))
+			("synthetic-frames", "Number of frames rendered from known parameters.", cxxopts::value(numSyntheticFrames)->default_value("4"))
+			("synthetic-width", "Width of the rendered frames.", cxxopts::value(syntheticWidth)->default_value("320"))
+			("repetitions", "Fits per frame, the timings are the minimum.", cxxopts::value(repetitions)->default_value("1"))
+			("debug-images", "Write bitmaps of the input and of every rasterization.", cxxopts::value(gSettings.debugImages)->default_value("false"))
+			;
+		addSettingsOptions(options);
+		options.parse_positional("inputs");
+		options.positional_help("[recorded inputs...]").show_positional_help();
+
+		auto result = options.parse(argc, argv);
+		if (result.count("help")) {
+			std::cout << options.help() << std::endl;
+			return 0;
+		}
+	}
+	catch (cxxopts::OptionException e) {
+		std::cerr << e.what() << std::endl;
+		return -2;
+	}
+	if (!Log::setLevel(gSettings.logLevel)) {
+		std::cerr << "Unknown log level " << gSettings.logLevel << std::endl;
+		return -2;
+	}
+	if (!checkSettings()) {
+		return -2;
+	}
+
+	JsonValue budgets;
+	if (!readJsonFile(budgetsFile, budgets) || !budgets.isObject()) {
+		std::cerr << "Can not read the budgets " << budgetsFile << std::endl;
+		return -2;
+	}
+
+	if (!gSettings.syntheticModel && !std::ifstream(gSettings.modelDir + "averageMesh.off").good()) {
+		std::cout << "No morphable model in " << gSettings.modelDir << ", using the synthetic model." << std::endl;
+		gSettings.syntheticModel = true;
+	}
+	const std::string modelName = gSettings.syntheticModel ? "synthetic" : "morphable";
+	if (baselineFile.empty()) {
+		baselineFile = "baseline_" + modelName + ".json";
+	}
+	FaceModel model = FaceModel::fromSettings();
+	ModelRank rank;
+	if (!selectModelRank(gSettings.modelRank, model.getNumEigenVec(), unsigned(model.m_albedoBasis.cols()), rank)) {
+		return -2;
+	}
+	std::cout << "Fitting " << rank.numAlpha << " shape and " << rank.numBeta << " albedo coefficients." << std::endl;
+	FitWorkspace workspace;
+	std::vector<std::pair<std::string, Metrics>> frames;
+
+	// Frames rendered from known parameters, the same ones in every run.
+	SyntheticFrameOptions frameOptions;
+	frameOptions.frameSize = syntheticFrameSize(syntheticWidth);
+	std::mt19937 rng(1);
+	for (unsigned int i = 0; i < numSyntheticFrames; i++) {
+		SyntheticFrame frame = generateSyntheticFrame(model, frameOptions, rng);
+		std::ostringstream name;
+		name << "synthetic_" << std::setw(3) << std::setfill('0') << i;
+		frames.emplace_back(name.str(), measureSynthetic(model, rank, frame, repetitions, workspace));
+	}
+
+	// Recorded frames, without ground truth. They need the morphable model and are skipped if missing,
+	// since the data isn't part of the repository.
+	for (const std::string& file : expandInputs(gSettings.inputFiles)) {
+		FrameSensor sensor;
+		if (gSettings.syntheticModel || !sensor.loadFile(file)) {
+			std::cout << "Skipping " << file << (gSettings.syntheticModel ? " (needs the morphable model)" : " (missing)") << std::endl;
+			continue;
+		}
+		if (sensor.m_featurePoints.empty() && !sensor.detectFeaturePoints()) {
+			std::cout << "Skipping " << file << " (no feature points)" << std::endl;
+			continue;
+		}
+		ReconstructionResult result;
+		frames.emplace_back(fileStem(file), measure(model, sensor, repetitions, workspace, result));
+	}
+
+	if (!writeReport(updateBaseline ? baselineFile : reportFile, modelName, frames)) {
+		std::cerr << "Can not write " << (updateBaseline ? baselineFile : reportFile) << std::endl;
+		return -1;
+	}
+	if (updateBaseline) {
+		std::cout << "Baseline of " << frames.size() << " frames written to " << baselineFile << std::endl;
+		return 0;
+	}
+
+	JsonValue baseline;
+	const JsonValue* baselineFrames = nullptr;
+	if (readJsonFile(baselineFile, baseline) && baseline.find("frames")) {
+		baselineFrames = baseline.find("frames");
+	}
+	else {
+		std::cout << "No baseline " << baselineFile << ", only the absolute budgets are checked and regressions go unnoticed. "
+			<< "Create it with --update-baseline on a reference machine." << std::endl;
+	}
+
+	int numViolations = 0;
+	std::cout << std::endl << std::left << std::setw(24) << "frame" << std::setw(18) << "metric" << std::right
+		<< std::setw(14) << "value" << std::setw(14) << "baseline" << "  status" << std::endl;
+	for (const auto& frame : frames) {
+		const JsonValue* frameBaseline = baselineFrames ? baselineFrames->find(frame.first) : nullptr;
+		for (const auto& metric : frame.second) {
+			const JsonValue* baselineValue = frameBaseline ? frameBaseline->find(metric.first) : nullptr;
+			double baselineNumber = baselineValue ? baselineValue->number : 0;
+			const JsonValue* budget = budgets.find(metric.first);
+			std::string violation = budget ? checkBudget(metric.second, *budget, baselineValue ? &baselineNumber : nullptr) : "";
+			numViolations += !violation.empty();
+
+			std::cout << std::left << std::setw(24) << frame.first << std::setw(18) << metric.first << std::right
+				<< std::fixed << std::setprecision(3) << std::setw(14) << metric.second << std::setw(14);
+			if (baselineValue) {
+				std::cout << baselineNumber;
+			}
+			else {
+				std::cout << "-";
+			}
+			std::cout << "  " << (violation.empty() ? "ok" : "FAIL " + violation) << std::endl;
+		}
+	}
+	std::cout << frames.size() << " frames, " << numViolations << " budget violations, report in " << reportFile << std::endl;
+	if (numViolations > 0) {
+		return 1;
+	}
+	if (!baselineFrames) {
+		std::cout << "Not configured: no baseline to check against." << std::endl;
+		return NOT_CONFIGURED;
+	}
+	return 0;
+}
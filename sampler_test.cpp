@@ -0,0 +1,89 @@
+#include "stdafx.h"
+#include <cmath>
+#include "PixelSampler.h"
+#include "Log.h"
+
+// Checks that the weights of PixelSampler are unbiased: averaged over many seeds, the sum of the
+// weights of the pixels drawn from a set of tiles is its number of candidates. The candidates are a
+// disk, so some tiles on its boundary hold few candidates and get less than one pixel of the budget.
+
+const unsigned int WIDTH = 160;
+const unsigned int HEIGHT = 120;
+const unsigned int TILE_SIZE = 16;
+const unsigned int BUDGET = 200;
+const unsigned int NUM_SEEDS = 2000;
+const double TOLERANCE = 0.05;
+
+static unsigned int tileOf(unsigned int index) {
+	const unsigned int tilesX = (WIDTH + TILE_SIZE - 1) / TILE_SIZE;
+	return (index / WIDTH / TILE_SIZE) * tilesX + (index % WIDTH) / TILE_SIZE;
+}
+
+// Returns the number of failed checks.
+static int checkWeights(const std::vector<unsigned int>& candidates, const std::vector<double>& norms, bool importance) {
+	std::vector<unsigned int> tileCandidates(WIDTH * HEIGHT, 0);
+	for (unsigned int index : candidates) {
+		tileCandidates[tileOf(index)]++;
+	}
+	// Boundary tiles are those with a share of less than one pixel of the budget.
+	auto isSparse = [&](unsigned int index) { return tileCandidates[tileOf(index)] * BUDGET < candidates.size(); };
+	double sparseCandidates = 0;
+	for (unsigned int index : candidates) {
+		if (isSparse(index)) {
+			sparseCandidates++;
+		}
+	}
+
+	double totalWeight = 0, sparseWeight = 0;
+	std::vector<PixelSample> sample;
+	for (unsigned int seed = 0; seed < NUM_SEEDS; seed++) {
+		PixelSampler sampler(BUDGET, TILE_SIZE, importance, seed);
+		sampler.sample(candidates, norms, WIDTH, sample);
+		for (const PixelSample& pixel : sample) {
+			totalWeight += pixel.weight;
+			if (isSparse(pixel.index)) {
+				sparseWeight += pixel.weight;
+			}
+		}
+	}
+	totalWeight /= NUM_SEEDS;
+	sparseWeight /= NUM_SEEDS;
+
+	int numFailed = 0;
+	const char* name = importance ? "importance" : "uniform";
+	LOG_INFO << name << ": all tiles " << totalWeight << " (" << candidates.size() << " candidates), boundary tiles "
+		<< sparseWeight << " (" << sparseCandidates << " candidates)";
+	if (std::abs(totalWeight - candidates.size()) > TOLERANCE * candidates.size()) {
+		LOG_ERROR << name << ": expected sum of weights of all tiles " << totalWeight << ", should be " << candidates.size();
+		numFailed++;
+	}
+	if (std::abs(sparseWeight - sparseCandidates) > TOLERANCE * sparseCandidates) {
+		LOG_ERROR << name << ": expected sum of weights of boundary tiles " << sparseWeight << ", should be " << sparseCandidates;
+		numFailed++;
+	}
+	return numFailed;
+}
+
+int main() {
+	std::vector<unsigned int> candidates;
+	std::vector<double> norms;
+	const double radius = 0.4 * HEIGHT;
+	for (unsigned int y = 0; y < HEIGHT; y++) {
+		for (unsigned int x = 0; x < WIDTH; x++) {
+			const double dx = x - 0.5 * WIDTH, dy = y - 0.5 * HEIGHT;
+			const double r = std::sqrt(dx * dx + dy * dy);
+			if (r < radius) {
+				candidates.push_back(y * WIDTH + x);
+				// Larger residuals towards the boundary, as on a face.
+				norms.push_back(0.01 + r / radius);
+			}
+		}
+	}
+
+	int numFailed = checkWeights(candidates, norms, false) + checkWeights(candidates, norms, true);
+	if (numFailed > 0) {
+		LOG_ERROR << numFailed << " checks failed";
+		return 1;
+	}
+	return 0;
+}
@@ -1,10 +1,10 @@
 #pragma once
 #include <Eigen/Eigen>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <pcl/common/common.h>
 #include <pcl/common/transforms.h>
-#include <pcl/visualization/pcl_visualizer.h>
 #include <random>
 #include <sstream>
 #include "cxxopts.hpp"
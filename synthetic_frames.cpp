@@ -0,0 +1,91 @@
+#include "stdafx.h"
+#include <iomanip>
+#include <pcl/io/pcd_io.h>
+#include "Settings.h"
+#include "FaceModel.h"
+#include "SyntheticFrame.h"
+#include "Export.h"
+#include "utils.h"
+
+using namespace Eigen;
+
+// Renders random faces into organized point clouds like those of the RGB-D face dataset, with
+// ground truth. For every frame <name>_cloud.pcd, the feature points <name>_cloud.points and the
+// parameters and pose <name>_truth_{alpha,beta,pose}.npy and <name>_truth_params.txt are written.
+// frames.txt lists the clouds, to be passed as @list input.
+int main(int argc, char **argv) {
+	SyntheticFrameOptions frameOptions;
+	std::string outputDir;
+	unsigned int count;
+	unsigned int width;
+	unsigned int seed;
+	try {
+		cxxopts::Options options(argv[0], "Generates RGB-D frames of random faces with ground truth parameters.");
+		options.add_options()
+			("help", "Print help.")
+			("model-dir", "Directory of the morphable model.", cxxopts::value(gSettings.modelDir)->default_value("../data/MorphableModel/"))
+			("synthetic-model", "Use the procedural face model instead of the morphable model.", cxxopts::value(gSettings.syntheticModel)->default_value("false"))
+			("output", "Output directory.", cxxopts::value(outputDir)->default_value("../data/synthetic"))
+			("count", "Number of frames.", cxxopts::value(count)->default_value("10"))
+			("width", "Frame width, 640 (Kinect, 4:3) or 960 (dataset, 16:9). Other widths are 4:3 scaled Kinect frames.", cxxopts::value(width)->default_value("640"))
+			("seed", "Seed of the random parameters, poses and noise.", cxxopts::value(seed)->default_value("1"))
+			("alpha-std", "Standard deviation of the shape parameters (in model standard deviations).", cxxopts::value(frameOptions.alphaStd)->default_value("1.0"))
+			("beta-std", "Standard deviation of the albedo parameters (in model standard deviations).", cxxopts::value(frameOptions.betaStd)->default_value("1.0"))
+			("max-rotation", "Maximum head rotation away from the camera in degrees.", cxxopts::value(frameOptions.maxRotation)->default_value("15"))
+			("depth-noise", "Depth noise standard deviation in mm at 1 m distance.", cxxopts::value(frameOptions.depthNoise)->default_value("1.5"))
+			("color-noise", "Color noise standard deviation (0-255).", cxxopts::value(frameOptions.colorNoise)->default_value("3"))
+			("holes", "Fraction of the valid pixels removed as holes.", cxxopts::value(frameOptions.holes)->default_value("0.02"))
+			("background", "Distance of the wall behind the face in m (0 = no background).", cxxopts::value(frameOptions.background)->default_value("1.2"))
+			;
+
+		auto result = options.parse(argc, argv);
+		if (result.count("help")) {
+			std::cout << options.help() << std::endl;
+			return 0;
+		}
+	}
+	catch (cxxopts::OptionException e) {
+		std::cerr << e.what() << std::endl;
+		return -2;
+	}
+
+	if (!makeDirectory(outputDir)) {
+		std::cerr << "Can not create output directory " << outputDir << std::endl;
+		return -1;
+	}
+	if (!gSettings.syntheticModel && !std::ifstream(gSettings.modelDir + "averageMesh.off").good()) {
+		std::cout << "No morphable model in " << gSettings.modelDir << ", using the synthetic model (fit with --synthetic-model)." << std::endl;
+		gSettings.syntheticModel = true;
+	}
+	gSettings.icpSamples = 0;
+	FaceModel model = FaceModel::fromSettings();
+
+	frameOptions.frameSize = syntheticFrameSize(width);
+	std::mt19937 rng(seed);
+	std::ofstream list(outputDir + "/frames.txt");
+
+	for (unsigned int i = 0; i < count; i++) {
+		std::ostringstream name;
+		name << outputDir << "/synthetic_" << std::setw(3) << std::setfill('0') << i;
+
+		SyntheticFrame frame = generateSyntheticFrame(model, frameOptions, rng);
+
+		std::string cloudFile = name.str() + "_cloud.pcd";
+		if (pcl::io::savePCDFileBinary(cloudFile, *frame.cloud) != 0) {
+			std::cerr << "Can not write " << cloudFile << std::endl;
+			return -1;
+		}
+		std::ofstream featurePoints(name.str() + "_cloud.points");
+		for (const Vector3f& point : frame.featurePoints) {
+			featurePoints << point.x() << " " << point.y() << " " << point.z() << std::endl;
+		}
+		if (!featurePoints.good() || !exportFace(model, frame.params, frame.pose, name.str() + "_truth", { ExportFormat::NPY, ExportFormat::Text })) {
+			std::cerr << "Can not write the ground truth of " << cloudFile << std::endl;
+			return -1;
+		}
+		list << cloudFile << std::endl;
+		std::cout << cloudFile << std::endl;
+	}
+	std::cout << count << " frames written, list in " << outputDir << "/frames.txt" << std::endl;
+	return 0;
+}
@@ -1,5 +1,10 @@
 #include <pcl/common/common.h>
 #include <pcl/Vertices.h>
+#include <cerrno>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
 #include "utils.h"
 
 pcl::PointCloud<pcl::PointXYZRGB>::Ptr pointsToCloud(const Eigen::VectorXf& points) {
@@ -62,4 +67,20 @@ std::vector<pcl::Vertices> trianglesToVertexList(const Eigen::Matrix3Xi& triangl
     }
 
     return vertices;
-}
\ No newline at end of file
+}
+
+bool makeDirectory(const std::string& path) {
+#ifdef _WIN32
+	int status = _mkdir(path.c_str());
+#else
+	int status = mkdir(path.c_str(), 0755);
+#endif
+	return status == 0 || errno == EEXIST;
+}
+
+std::string fileStem(const std::string& path) {
+	size_t slash = path.find_last_of("/\\");
+	std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+	size_t dot = name.find_last_of('.');
+	return dot == std::string::npos ? name : name.substr(0, dot);
+}
@@ -7,4 +7,9 @@ pcl::PointCloud<pcl::PointXYZRGB>::Ptr pointsToCloud(const Eigen::VectorXf& poin
 pcl::PointCloud<pcl::PointXYZRGB>::Ptr pointsToCloud(const Eigen::VectorXf& points, const Eigen::Matrix4Xi& vertexColors);
 pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr pointsToCloud(const Eigen::VectorXf& points, const Eigen::Matrix3Xf& normals);
 
-std::vector<pcl::Vertices> trianglesToVertexList(const Eigen::Matrix3Xi& triangles);
\ No newline at end of file
+std::vector<pcl::Vertices> trianglesToVertexList(const Eigen::Matrix3Xi& triangles);
+
+// Creates the directory if it doesn't exist yet (not its parents). Returns false on failure.
+bool makeDirectory(const std::string& path);
+// File name without directory and extension.
+std::string fileStem(const std::string& path);
\ No newline at end of file